@@ -6,15 +6,16 @@
     0x007c00 -> 0x007e00  TinyOS 引导程序代码段和数据段
     0x007e00 -> 0x09efff  空闲空间(计划划分给内核)
         0x007e00 -> 0x007fff 内核程序的栈空间
-        0x008000 -> 0x00Bfff 内核程序的代码与数据
-        0x00C000 -> 0x09efff 内核暂时保留不用
+        0x008000 -> 0x03ffff 内核程序的代码与数据
+        0x040000 -> 0x09efff 内核暂时保留不用
     0x100000 -> 0x1FFFFF  空间空间(计划划分给用户)
 运行模式: 16 位实模式
 段寄存器: CS = DS = ES = SS = 0
 功能：加载内核进入内存
 */
 
-#define KERNEL_BASE 0x8000
+#define KERNEL_BASE     0x8000
+#define KERNEL_SECTORS  448
 
 /* ========================== 初始化代码段 ========================== */
 asm (
@@ -45,9 +46,10 @@ static void BootMain() {
         "int    $0x13\n"
         :: "a"((u16)0), "d"((u16)0)
     );
-    // 将内核加载到 0x8000 处，内核大小为 16K 共计 32 个簇，簇号为 1 至 32
-    for (int i = 0; i < 32; i++)
-        ReadKernel(KERNEL_BASE / 0x10, i * 0x200, i + 1);
+    // 将内核加载到 0x8000 处，内核大小为 224K 共计 448 个簇，簇号为 1 至 448
+    // 每个扇区使用各自的段基址装载，使内核可以超过 64K
+    for (int i = 0; i < KERNEL_SECTORS; i++)
+        ReadKernel((KERNEL_BASE + i * 0x200) / 0x10, 0, i + 1);
     // 交权给操作系统内核 cs = ds = es = ss = 0
     __asm__ __volatile__ (
         "ljmp $0x0, $0x8000\n"
@@ -69,7 +71,7 @@ static void ReadKernel(u32 base, u32 offset, u32 id) {
         "movw   $0x0201, %%ax\n"
         "int    $0x13\n"
         "jc     GoOnReading\n"
-        :: "r"(base),                         // es = 存储地址
+        :: "r"((u16)base),                    // es = 存储地址
            "b"(offset),                       // bx = 存储偏移
            "c"(sector | (cylinder << 8)),     // ch = 柱面号, cl = 起始扇区号
            "d"(0x80 | (head << 8))            // dh = 磁头号，dl = 驱动器号
@@ -0,0 +1,121 @@
+//  apic.c         by OrangeYYC
+//  TinyOS 本地 APIC 与 IO APIC 的驱动程序
+
+#include "common.h"
+
+/* ========================== 本地 APIC 寄存器访问 ========================== */
+// 读本地 APIC 寄存器
+u32 LapicRead(u32 reg) {
+    return *(volatile u32 *)(lapicBase + reg);
+}
+
+// 写本地 APIC 寄存器，写后读一次 ID 寄存器等待写入完成
+void LapicWrite(u32 reg, u32 value) {
+    *(volatile u32 *)(lapicBase + reg) = value;
+    LapicRead(LAPIC_ID);
+}
+
+// 获取当前处理器的 APIC 编号
+u32 LapicId() {
+    if (!lapicBase)
+        return 0;
+    return LapicRead(LAPIC_ID) >> 24;
+}
+
+/* ========================== 本地 APIC 功能函数 ========================== */
+// 本地 APIC 初始化函数，软件使能 APIC 并设置伪中断向量
+void LapicInit() {
+    if (!lapicBase)
+        return;
+    LapicWrite(LAPIC_SVR, LAPIC_ENABLE | INT_VECTOR_SPURIOUS);
+}
+
+// 发送中断结束信号
+void LapicEoi() {
+    if (lapicBase)
+        LapicWrite(LAPIC_EOI, 0);
+}
+
+// 向 APIC 编号为 apicId 的处理器发送处理器间中断，等待发送完成
+void LapicSendIpi(u32 apicId, u32 command) {
+    LapicWrite(LAPIC_ICRHI, apicId << 24);
+    LapicWrite(LAPIC_ICRLO, command);
+    while (LapicRead(LAPIC_ICRLO) & ICR_BUSY) ;
+}
+
+/* ========================== 本地 APIC 定时器 ========================== */
+// 使用 PIT 校准本地定时器和时间戳计数器，在启动处理器上调用一次
+void LapicCalibrate() {
+    LapicWrite(LAPIC_TDCR, 0x3);
+    LapicWrite(LAPIC_TIMER, LAPIC_TIMER_MASKED | INT_VECTOR_APIC_TIMER);
+    LapicWrite(LAPIC_TICR, 0xffffffff);
+    u64 start = ReadTsc();
+    PitWaitMs(10);
+    u32 elapsed = 0xffffffff - LapicRead(LAPIC_TCCR);
+    u32 cycles  = (u32)(ReadTsc() - start);
+    LapicWrite(LAPIC_TICR, 0);
+    lapicTicksPerMs = elapsed / 10;
+    tscPerMs        = cycles / 10;
+}
+
+// 以周期模式启动本地定时器，每秒产生 hz 次中断
+void LapicTimerPeriodic(u32 hz) {
+    if (!lapicBase)
+        return;
+    LapicWrite(LAPIC_TDCR, 0x3);
+    LapicWrite(LAPIC_TIMER, LAPIC_TIMER_PERIODIC | INT_VECTOR_APIC_TIMER);
+    LapicWrite(LAPIC_TICR, lapicTicksPerMs * 1000 / hz);
+    ThisCpu()->oneShot = 0;
+    ThisCpu()->tickTsc = 0;
+}
+
+// 以单次模式启动本地定时器，us 微秒后产生一次中断
+void LapicTimerOneShot(u32 us) {
+    if (!lapicBase)
+        return;
+    u32 count = lapicTicksPerMs * (us / 1000) + lapicTicksPerMs * (us % 1000) / 1000;
+    LapicWrite(LAPIC_TDCR, 0x3);
+    LapicWrite(LAPIC_TIMER, INT_VECTOR_APIC_TIMER);
+    LapicWrite(LAPIC_TICR, count ? count : 1);
+    ThisCpu()->oneShot = 1;
+}
+
+/* ========================== IO APIC ========================== */
+// 读 IO APIC 寄存器
+static u32 IoapicRead(u32 reg) {
+    *(volatile u32 *)(ioapicBase + IOAPIC_REGSEL) = reg;
+    return *(volatile u32 *)(ioapicBase + IOAPIC_WIN);
+}
+
+// 写 IO APIC 寄存器
+static void IoapicWrite(u32 reg, u32 value) {
+    *(volatile u32 *)(ioapicBase + IOAPIC_REGSEL) = reg;
+    *(volatile u32 *)(ioapicBase + IOAPIC_WIN)    = value;
+}
+
+// IO APIC 初始化函数，屏蔽所有的重定向表项
+void IoapicInit() {
+    u32 count = ((IoapicRead(IOAPIC_VER) >> 16) & 0xff) + 1;
+    for (u32 i = 0; i < count; i++) {
+        IoapicWrite(IOAPIC_REDTBL + 2 * i, IOAPIC_MASKED | (INT_VECTOR_IRQ0 + i));
+        IoapicWrite(IOAPIC_REDTBL + 2 * i + 1, 0);
+    }
+}
+
+// 将 ISA 中断 irq 以 vector 向量发送给 APIC 编号为 apicId 的处理器
+void IoapicRoute(u32 irq, u32 vector, u32 apicId) {
+    u32 gsi = irqGsi[irq];
+    u32 low = vector;
+    if ((irqFlags[irq] & IRQ_FLAG_LOW) == IRQ_FLAG_LOW)
+        low |= IOAPIC_LOW;
+    if ((irqFlags[irq] & IRQ_FLAG_LEVEL) == IRQ_FLAG_LEVEL)
+        low |= IOAPIC_LEVEL;
+    IoapicWrite(IOAPIC_REDTBL + 2 * gsi + 1, apicId << 24);
+    IoapicWrite(IOAPIC_REDTBL + 2 * gsi, low);
+}
+
+// 屏蔽 ISA 中断 irq
+void IoapicMask(u32 irq) {
+    u32 reg = IOAPIC_REDTBL + 2 * irqGsi[irq];
+    IoapicWrite(reg, IoapicRead(reg) | IOAPIC_MASKED);
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+//  bench.c         by OrangeYYC
+//  TinyOS 基准测试套件的内核部分
+//
+//  使用 make bench 构建时(BENCH_SUITE)，内核装入 bench1 和 bench2 两个任务代替演示任务，
+//  并在启动过程中测量只能在 Ring0 进行的项目: 页目录切换、读取硬盘和写入文件的速度。
+//  所有结果按 "BENCH 名称 数值 单位" 的格式逐行写到串口，驱动任务 bench1 结束时
+//  输出 "BENCH done" 并通过 QEMU 的 isa-debug-exit 设备结束模拟器
+
+#include "common.h"
+
+#ifdef BENCH_SUITE
+#define BENCH_ROUNDS    1000            // 每项测量的次数，取最小值
+
+u64        benchBootTsc = 0;            // 进入保护模式时的时间戳
+static u64 benchCycles  = 0;            // 启动过程中内核部分的测量使用的周期数，不计入启动时间
+
+// 输出一行结果
+void BenchReport(char *name, u32 value, char *unit) {
+    SerialPrint("BENCH ");
+    SerialPrint(name);
+    SerialPrint(" ");
+    SerialPrintDecimal(value);
+    SerialPrint(" ");
+    SerialPrint(unit);
+    SerialPrint("\n");
+}
+
+// 依次读取 BENCH_TOUCH_PAGES 个 4K 页，返回消耗的周期数；reload 为 1 时先重新加载 cr3
+// 重新加载 cr3 会清空 TLB，此后每一页的第一次访问都需要查找页表
+static u32 TouchPages(int reload) {
+    u64 start = ReadTsc();
+    if (reload)
+        __asm__ __volatile__ (
+            "movl %%cr3, %%eax\n"
+            "movl %%eax, %%cr3\n"
+            ::: "eax", "memory"
+        );
+    for (u32 i = 0; i < BENCH_TOUCH_PAGES; i++)
+        (void)*(volatile u32 *)(PROCESS_PSTART + i * PAGE_SIZE);
+    return (u32)(ReadTsc() - start);
+}
+
+// 页目录切换: 切换页目录(重新加载 cr3)并访问若干页与只访问这些页的时间之差
+// 访问的是第一个 2M 中使用 4K 页表映射的区域，与任务的内存窗口相同
+static void BenchPageDir() {
+    u32 warm = -1, cold = -1;
+    u32 flags = IrqSave();
+    for (u32 i = 0; i < BENCH_ROUNDS; i++) {
+        u32 t = TouchPages(0);
+        if (t < warm)
+            warm = t;
+        t = TouchPages(1);
+        if (t < cold)
+            cold = t;
+    }
+    IrqRestore(flags);
+    BenchReport("pagedir_switch", cold > warm ? cold - warm : 0, "cycles");
+}
+
+// 读取硬盘: 逐个扇区调用 ReadDisk 的平均周期数，以及一次连续读取 BENCH_DISK_SECTORS 个扇区的速度
+// 读到页框池中，在页缓存初始化之前调用
+static void BenchDisk() {
+    u64 start = ReadTsc();
+    for (u32 i = 0; i < BENCH_DISK_SECTORS; i++)
+        ReadDisk(FS_START_SECTOR + i, FRAME_BASE + i * DISK_SECTOR_SIZE);
+    u32 single = (u32)(ReadTsc() - start);
+    start = ReadTsc();
+    ReadDiskExtent(FS_START_SECTOR, BENCH_DISK_SECTORS, FRAME_BASE);
+    u32 extent = (u32)(ReadTsc() - start);
+    BenchReport("disk_read_sector", single / BENCH_DISK_SECTORS, "cycles");
+    BenchReport("disk_read_extent", Div64((u64)BENCH_DISK_SECTORS * DISK_SECTOR_SIZE / 1024 * tscPerMs * 1000, extent), "KB/s");
+}
+
+// 写入文件: 经过页缓存写入 BENCH_WRITE_FILE 并写回硬盘(PageCacheSync)的速度，时间包括写回和硬盘写出缓存
+// 随机小块写入在文件中随机的位置写入 BENCH_WRITE_COUNT 个 BENCH_WRITE_SMALL 字节的块，每块所在的页需要先读入；
+// 顺序写入按 BENCH_WRITE_LARGE 字节的块覆盖整个文件，整页写入不读硬盘，相邻的脏页合并为一条写命令。
+// 同时输出每种写入发出的写命令数；写入的数据取自任务的内存窗口，在页缓存初始化之后、装入任务之前调用
+void BenchWrite() {
+    u8 *block = (u8 *)PROCESS_PSTART;
+    FsEntry *entry = FsLookup(BENCH_WRITE_FILE);
+    if (!entry || entry->size < BENCH_WRITE_LARGE) {
+        Print("[KERNEL] Error: No file for the write benchmark!\n", F_Red | L_Light);
+        return;
+    }
+    u32 seed = 1, blocks = entry->size / BENCH_WRITE_SMALL;
+    u32 cmds = diskWriteCmds;
+    u64 begin = ReadTsc(), start = begin;
+    for (u32 i = 0; i < BENCH_WRITE_COUNT; i++) {
+        seed = seed * 1103515245 + 12345;
+        block[0] = (u8)i;
+        PageCacheWrite(entry, (seed >> 8) % blocks * BENCH_WRITE_SMALL, block, BENCH_WRITE_SMALL, 0);
+    }
+    PageCacheSync(entry);
+    u32 random = (u32)(ReadTsc() - start);
+    BenchReport("disk_write_random", Div64((u64)BENCH_WRITE_COUNT * BENCH_WRITE_SMALL / 1024 * tscPerMs * 1000, random), "KB/s");
+    BenchReport("disk_write_random_cmds", diskWriteCmds - cmds, "count");
+    cmds  = diskWriteCmds;
+    start = ReadTsc();
+    for (u32 off = 0; off + BENCH_WRITE_LARGE <= entry->size; off += BENCH_WRITE_LARGE)
+        PageCacheWrite(entry, off, block, BENCH_WRITE_LARGE, 0);
+    PageCacheSync(entry);
+    u32 seq = (u32)(ReadTsc() - start);
+    BenchReport("disk_write_seq", Div64((u64)(entry->size / BENCH_WRITE_LARGE) * BENCH_WRITE_LARGE / 1024 * tscPerMs * 1000, seq), "KB/s");
+    BenchReport("disk_write_seq_cmds", diskWriteCmds - cmds, "count");
+    benchCycles += ReadTsc() - begin;
+}
+
+// 基准测试套件的内核部分，在时钟校准之后、页缓存初始化之前调用
+void BenchKernel() {
+    u64 start = ReadTsc();
+    Print("[KERNEL] Benchmark Suite: results on serial port\n", F_Cyan | L_Light);
+    BenchReport("tsc_per_ms", tscPerMs, "cycles");
+    BenchReport("cpus", cpuCount, "count");
+    BenchPageDir();
+    BenchDisk();
+    benchCycles += ReadTsc() - start;
+}
+
+// 启动时间: 从进入保护模式到第一次进入任务(时间戳 firstTask)的周期数，不包括启动过程中内核部分的测量，
+// 包括校准时钟等固定的等待时间，不同构建配置之间的差别反映初始化代码的速度
+void BenchBoot(u64 firstTask) {
+    BenchReport("boot_first_task", (u32)(firstTask - benchBootTsc - benchCycles), "cycles");
+}
+
+// 任务结束时调用，驱动任务 bench1 结束时结束模拟器，不在 QEMU 中运行时没有效果
+void BenchTaskExit(PCB *pcb) {
+    if (pcb->pid != 0)
+        return;
+    SerialPrint("BENCH done\n");
+    OutByte(DEBUG_EXIT_PORT, 0);
+}
+#endif
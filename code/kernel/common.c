@@ -12,15 +12,41 @@ Descriptor  gdt[GDT_SIZE]      = {};   // 全局描述符表
 u8          idtPtr[6]          = {};   // 中断向量表指针
 Gate        idt[IDT_SIZE]      = {};   // 中断向量表
 PCB         process[MAX_TASKS] = {};   // 进程表
-TSS         tss                = {};   // 任务状态段
-u32         readyPid           = -1;   // 就绪 pid
+CPU         cpus[MAX_CPUS]     = {};   // 处理器表
+u32         cpuCount           = 1;    // 处理器数量
+u32         lapicBase          = 0;    // 本地 APIC 寄存器地址，为 0 表示不使用 APIC
+u32         ioapicBase         = 0;    // IO APIC 寄存器地址
+u32         ioapicId           = 0;    // IO APIC 编号
+u32         kernelStack[256]   = {};   // 按 APIC 编号索引的各处理器内核栈栈顶
+u32         irqStack[256]      = {};   // 按 APIC 编号索引的各处理器中断栈栈顶
+u32         irqGsi[16]         = {};   // ISA 中断连接的 IO APIC 输入编号
+u16         irqFlags[16]       = {};   // ISA 中断的触发方式与极性
+volatile u64 ticks             = 0;    // 启动处理器的时钟中断计数，由 tickLock 保护
+SeqLock     tickLock           = {};   // 保护时钟中断计数的顺序锁
+u32         lapicTicksPerMs    = 0;    // 本地定时器每毫秒的计数(16 分频)
+u32         tscPerMs           = 0;    // 时间戳计数器每毫秒的计数
+u32         kernelCr4          = 0;    // 开启分页前写入 cr4 的值，应用处理器使用相同的设置
+u64         kernelPat          = 0;    // 页属性表的设置，不为 0 时应用处理器启动时写入相同的值
+VbeInfo     vbeInfo            = {};   // 图形模式的信息，由实模式部分填写
 
+// 以下为访问硬件的函数，在主机上运行测试时(HOSTED)由 code/test/hal.c 提供替代的实现
+#ifndef HOSTED
 /* ========================== 信息显示函数 ========================== */
 int dispX = 0;                                  // 当前光标所在行
 int dispY = 0;                                  // 当前光标所在列
 
-// 写显存辅助函数
+#ifdef VBE
+extern void FbPutCell(u32 id, u32 code, u32 cell);
+#endif
+
+// 写显存辅助函数，图形模式下画到内核输出的离屏表面上
 void WriteToVedio(u32 code, u32 pos) {
+#ifdef VBE
+    if (vbeInfo.base) {
+        FbPutCell(FB_KERNEL, code, pos / 2);
+        return;
+    }
+#endif
     __asm__ __volatile__ (
         "movw   %%ax, %%gs:(%%ebx)\n"
         :: "a"(code), "b"(pos)
@@ -41,6 +67,12 @@ void Print(char *message, int color) {
     }
 }
 
+// 设置光标位置
+void SetCursor(int x, int y) {
+    dispX = x;
+    dispY = y;
+}
+
 // 字符串定位输出函数
 void PrintAtPos(char *message, int color, int x, int y) {
     for (char *c = message; *c; c++) {
@@ -67,6 +99,86 @@ void PrintNumber(u32 value, int color) {
     Print(buffer, color);
 }
 
+// 十进制数字输出函数
+void PrintDecimal(u32 value, int color) {
+    char buffer[12];
+    char *p = buffer + 11;
+    *p = 0;
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    Print(p, color);
+}
+
+/* ========================== 时间戳计数器函数 ========================== */
+// 读取处理器的时间戳计数器
+u64 ReadTsc() {
+    u64 rv;
+    __asm__ __volatile__ (
+        "rdtsc\n"
+        : "=A"(rv)
+    );
+    return rv;
+}
+
+// 计算 64 位的 n / d，结果超出 32 位时返回 0xffffffff，避免使用 libgcc 的 64 位除法
+u32 Div64(u64 n, u32 d) {
+    u32 q, r;
+    if (!d || (u32)(n >> 32) >= d)
+        return 0xffffffff;
+    __asm__ ("divl %4\n" : "=a"(q), "=d"(r) : "a"((u32)n), "d"((u32)(n >> 32)), "rm"(d));
+    return q;
+}
+
+/* ========================== 处理器特性 ========================== */
+// 读取型号相关寄存器 msr
+u64 ReadMsr(u32 msr) {
+    u64 value;
+    __asm__ __volatile__ (
+        "rdmsr\n"
+        : "=A"(value)
+        : "c"(msr)
+    );
+    return value;
+}
+
+// 写入型号相关寄存器 msr
+void WriteMsr(u32 msr, u64 value) {
+    __asm__ __volatile__ (
+        "wrmsr\n"
+        :: "c"(msr), "A"(value)
+    );
+}
+
+// 执行 cpuid 指令，结果依次放入 regs[0..3] (eax ebx ecx edx)
+// 处理器不支持 cpuid 指令(不能修改标志寄存器的 ID 位)时结果全为 0
+void Cpuid(u32 leaf, u32 *regs) {
+    u32 before, after;
+    __asm__ __volatile__ (
+        "pushfl\n"
+        "pushfl\n"
+        "popl   %0\n"
+        "movl   %0, %1\n"
+        "xorl   $0x200000, %1\n"
+        "pushl  %1\n"
+        "popfl\n"
+        "pushfl\n"
+        "popl   %1\n"
+        "popfl\n"
+        : "=&r"(before), "=&r"(after)
+    );
+    if (!((before ^ after) & 0x200000)) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+        return;
+    }
+    __asm__ __volatile__ (
+        "cpuid\n"
+        : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+        : "a"(leaf), "c"(0)
+    );
+}
+
 /* ========================== 端口输入输出函数 ========================== */
 // 用于向端口写入信息的函数
 void OutByte(u16 port, u8 value) {
@@ -100,6 +212,28 @@ u16 InWord(u16 port) {
     return rv;
 }
 
+// 从端口连续读取 count 个字到 buffer
+void InWords(u16 port, void *buffer, u32 count) {
+    __asm__ __volatile__ (
+        "rep insw\n"
+        : "+D"(buffer), "+c"(count)
+        : "d"(port)
+        : "memory"
+    );
+}
+
+// 将 buffer 中的 count 个字连续写到端口
+void OutWords(u16 port, void *buffer, u32 count) {
+    __asm__ __volatile__ (
+        "rep outsw\n"
+        : "+S"(buffer), "+c"(count)
+        : "d"(port)
+        : "memory"
+    );
+}
+
+#endif
+
 /* ========================== 描述符设置函数 ========================== */
 // 设置全局/局部描述符的函数
 void SetDesEntry(Descriptor *des, u32 base, u32 limit, u16 attr) {
@@ -120,22 +254,111 @@ void SetIdtEntry(Gate *pGate, u16 selector, u32 offset, u8 dcount, u8 attr) {
     pGate->offsetHigh = (offset >> 16) & 0xffff; 
 }
 
+#ifndef HOSTED
 /* ========================== 磁盘读写函数 ========================== */
+static u32 diskMultiple = 1;            // 写命令每次数据传输的扇区数，大于 1 时使用 WRITE MULTIPLE
+u32        diskWriteCmds    = 0;        // 发出的写命令数
+u32        diskWriteSectors = 0;        // 写入的扇区数
+
+// 等待硬盘不忙，返回最后读到的状态
+static u8 DiskWait() {
+    u8 status;
+    while ((status = InByte(ATA_COMMAND)) & ATA_SR_BSY) ;
+    return status;
+}
+
+// 发出读写 sector 开始的 n 个扇区的命令 command，扇区数为 0 表示 256 个扇区
+static void DiskCommand(u32 sector, u32 n, u8 command) {
+    OutByte(ATA_FEATURES, 0);
+    OutByte(ATA_COUNT, (u8)n);
+    OutByte(ATA_LBA_LOW, (u8)sector);
+    OutByte(ATA_LBA_MID, (u8)(sector >> 8));
+    OutByte(ATA_LBA_HIGH, (u8)(sector >> 16));
+    // 使用 LBA 模式，选择主盘
+    OutByte(ATA_DRIVE, ATA_LBA | (u8)((sector >> 24) & 0xF));
+    OutByte(ATA_COMMAND, command);
+}
+
+// 磁盘连续读取函数，一条读命令最多读取 256 个扇区，超过时分多次发出
+// sector: 起始扇区编号, count: 扇区数量, buffer: 读取到的内存地址
+void ReadDiskExtent(u32 sector, u32 count, u32 buffer) {
+    u16 *data = (u16 *)buffer;
+    while (count > 0) {
+        u32 n = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        DiskCommand(sector, n, ATA_CMD_READ);
+        // 每个扇区准备就绪后读取数据
+        for (u32 s = 0; s < n; s++) {
+            while ((InByte(ATA_COMMAND) & (ATA_SR_BSY | ATA_SR_DRQ)) != ATA_SR_DRQ);  // 等待数据准备就绪
+            InWords(ATA_DATA, data, DISK_SECTOR_SIZE / 2);
+            data += DISK_SECTOR_SIZE / 2;
+        }
+        sector += n;
+        count  -= n;
+    }
+}
+
 // 磁盘读写函数
 // sector: 读取的扇区编号, buffer: 读取到的内存地址
 void ReadDisk(u32 sector, u32 buffer) {
-    // 设置读取参数
-    OutByte(0x1f1, 0);
-    OutByte(0x1f2, 1);
-    OutByte(0x1f3, (u8)sector);
-    OutByte(0x1f4, (u8)(sector >> 8));
-    OutByte(0x1f5, (u8)(sector >> 16));
-    // 使用 LBA 模式读取，选择主盘
-    OutByte(0x1f6, 0xE0 | (u8)((sector >> 24) & 0xF));
-    OutByte(0x1f7, 0x20);
-    // 循环读取数据
-    u16 *data = (u16 *)buffer;
-    while ((InByte(0x1f7) & 0x88) != 0x8);      // 等待数据准备就绪
-    for (int i = 0; i < 512 / 2; i++)
-        data[i] = InWord(0x1f0);
-}
\ No newline at end of file
+    ReadDiskExtent(sector, 1, buffer);
+}
+
+// 磁盘连续写入函数，把 count 个扇区写到 sector 开始的位置，成功时返回 1
+// 数据依次取自 pages 中的各页，每页提供 PAGE_SIZE / DISK_SECTOR_SIZE 个扇区(最后一页可以不满)，
+// 页缓存中不相邻的脏页可以合并为一条写命令；一条写命令最多写入 ATA_MAX_SECTORS 个扇区，
+// 设置了多扇区模式时每次数据传输 diskMultiple 个扇区，减少等待状态的次数
+int WriteDiskPages(u32 sector, u32 count, u32 *pages) {
+    u32 done = 0;
+    while (done < count) {
+        u32 n = count - done > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count - done;
+        DiskCommand(sector + done, n, diskMultiple > 1 ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_WRITE);
+        for (u32 s = 0; s < n; s++, done++) {
+            if (s % diskMultiple == 0 && (DiskWait() & (ATA_SR_ERR | ATA_SR_DRQ)) != ATA_SR_DRQ)
+                return 0;
+            u32 per = PAGE_SIZE / DISK_SECTOR_SIZE;
+            OutWords(ATA_DATA, (u8 *)pages[done / per] + done % per * DISK_SECTOR_SIZE, DISK_SECTOR_SIZE / 2);
+        }
+        if (DiskWait() & ATA_SR_ERR)
+            return 0;
+        diskWriteCmds++;
+        diskWriteSectors += n;
+    }
+    return 1;
+}
+
+// 把硬盘缓存中的数据写到介质(CACHE FLUSH)，成功时返回 1
+int FlushDisk() {
+    OutByte(ATA_DRIVE, ATA_LBA);
+    OutByte(ATA_COMMAND, ATA_CMD_FLUSH);
+    return !(DiskWait() & ATA_SR_ERR);
+}
+
+// 硬盘初始化函数，读取 IDENTIFY 信息，支持时设置 WRITE MULTIPLE 使用的多扇区模式
+// IDENTIFY 第 47 字的低 8 位为每次数据传输的最大扇区数，取不超过它和 ATA_MULTIPLE_MAX 的 2 的幂
+void DiskInit() {
+    static u16 identify[DISK_SECTOR_SIZE / 2];
+    OutByte(ATA_DRIVE, ATA_LBA);
+    OutByte(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    u8 status = InByte(ATA_COMMAND);
+    if (!status || status == 0xff || (DiskWait() & (ATA_SR_ERR | ATA_SR_DRQ)) != ATA_SR_DRQ) {
+        Print("[KERNEL] Error: No ATA disk found!\n", F_Red | L_Light);
+        return;
+    }
+    InWords(ATA_DATA, identify, DISK_SECTOR_SIZE / 2);
+    u32 max = identify[47] & 0xff, multiple = 1;
+    while (multiple * 2 <= max && multiple * 2 <= ATA_MULTIPLE_MAX)
+        multiple *= 2;
+    if (multiple > 1) {
+        OutByte(ATA_COUNT, (u8)multiple);
+        OutByte(ATA_DRIVE, ATA_LBA);
+        OutByte(ATA_COMMAND, ATA_CMD_SET_MULTIPLE);
+        if (!(DiskWait() & ATA_SR_ERR))
+            diskMultiple = multiple;
+    }
+    Print("[KERNEL] Disk: ", F_Cyan | L_Light);
+    PrintDecimal((identify[61] << 16 | identify[60]) >> 11, F_White | L_Light);
+    Print("M, ", F_White);
+    PrintDecimal(diskMultiple, F_White | L_Light);
+    Print(" sectors per write transfer\n", F_White);
+}
+#endif
@@ -10,13 +10,26 @@
 extern void WriteToVedio (u32 code, u32 pos);
 extern void Print        (char *message, int color);
 extern void PrintAtPos   (char *message, int color, int x, int y);
+extern void SetCursor    (int x, int y);
 extern void PrintNumber  (u32 value, int color);
+extern void PrintDecimal (u32 value, int color);
 extern void OutByte      (u16 port, u8 value);
 extern   u8 InByte       (u16 port);
 extern  u16 InWord       (u16 port);
+extern void InWords      (u16 port, void *buffer, u32 count);
+extern void OutWords     (u16 port, void *buffer, u32 count);
 extern void SetDesEntry  (Descriptor *des, u32 base, u32 limit, u16 attr);
 extern void SetIdtEntry  (Gate *pGate, u16 selector, u32 offset, u8 dcount, u8 attr);
 extern void ReadDisk     (u32 sector, u32 buffer);
+extern void ReadDiskExtent(u32 sector, u32 count, u32 buffer);
+extern  int WriteDiskPages(u32 sector, u32 count, u32 *pages);
+extern  int FlushDisk    ();
+extern void DiskInit     ();
+extern  u64 ReadTsc      ();
+extern void Cpuid        (u32 leaf, u32 *regs);
+extern  u64 ReadMsr      (u32 msr);
+extern void WriteMsr     (u32 msr, u64 value);
+extern  u32 Div64        (u64 n, u32 d);
 
 // 数据段中定义的变量
 extern u32         RAMSize;             // 系统内存大小
@@ -27,7 +40,190 @@ extern Descriptor  gdt[GDT_SIZE];       // 全局描述符表
 extern u8          idtPtr[6];           // 中断向量表指针
 extern Gate        idt[IDT_SIZE];       // 中断向量表
 extern PCB         process[MAX_TASKS];  // 进程表
-extern TSS         tss;                 // 任务状态段
-extern u32         readyPid;            // 就绪 pid
+extern CPU         cpus[MAX_CPUS];      // 处理器表
+extern u32         cpuCount;            // 处理器数量
+extern u32         lapicBase;           // 本地 APIC 寄存器地址
+extern u32         ioapicBase;          // IO APIC 寄存器地址
+extern u32         ioapicId;            // IO APIC 编号
+extern u32         kernelStack[256];    // 按 APIC 编号索引的各处理器内核栈栈顶
+extern u32         irqStack[256];       // 按 APIC 编号索引的各处理器中断栈栈顶
+extern u32         irqGsi[16];          // ISA 中断连接的 IO APIC 输入编号
+extern u16         irqFlags[16];        // ISA 中断的触发方式与极性
+extern volatile u64 ticks;              // 启动处理器的时钟中断计数
+extern SeqLock     tickLock;            // 保护时钟中断计数的顺序锁
+extern u32         lapicTicksPerMs;     // 本地定时器每毫秒的计数
+extern u32         tscPerMs;            // 时间戳计数器每毫秒的计数
+extern u32         kernelCr4;           // 开启分页前写入 cr4 的值
+extern u64         kernelPat;           // 页属性表的设置
+extern VbeInfo     vbeInfo;             // 图形模式的信息
+extern u32         diskWriteCmds;       // 发出的硬盘写命令数
+extern u32         diskWriteSectors;    // 写入硬盘的扇区数
+
+// 进程调度相关的函数与变量
+extern const int   taskCount;           // 任务数量
+extern char       *taskName[MAX_TASKS]; // 每个任务在文件系统中的文件名
+extern u32         procCount;           // 进程表中已使用的表项数量
+extern u32         priority[MAX_TASKS]; // 任务的优先级别
+extern Spinlock    schedLock;           // 调度锁
+extern void choose       (int tick);
+extern void restart      ();
+extern void SchedSetup   (PCB *pcb, u32 policy);
+extern void SchedSleep   (PCB *pcb);
+extern void SchedExit    (PCB *pcb);
+extern  u32 SchedSetEdf  (PCB *pcb, u32 period, u32 budget, u32 deadline);
+extern  u32 SchedWaitPeriod(PCB *pcb);
+extern  u32 SchedSetPriority(PCB *pcb, u32 priority);
+extern void TopDump      ();
+extern void SchedRelease (u32 now);
+extern void EdfReportTask(PCB *pcb);
+extern void EdfReport    ();
+extern void SchedWakeup  (PCB *pcb);
+extern void SchedBenchmark();
+extern char *ReadProcessToMemory(const int pid);
+extern void SetProcessPageTable(int pid);
+extern void SetupProcess ();
+extern  u32 KernelThreadCreate(void (*entry)(), u32 priority, u32 policy);
+extern  int UserRangeOk  (PCB *pcb, u32 va, u32 len);
+extern void CopyToUser   (PCB *pcb, u32 va, void *src, u32 len);
+extern void CopyFromUser (PCB *pcb, u32 va, void *dst, u32 len);
+
+// 多处理器相关的函数
+extern void MpInit       ();
+extern void SmpInit      ();
+extern void SmpBoot      ();
+extern void SmpBenchmark ();
+extern void SmpBenchWorker(CPU *cpu);
+extern CPU *ThisCpu      ();
+extern void SetupCpu     (CPU *cpu);
+extern void MapKernelPage(u32 addr);
+extern  u64 *KernelPte   (u32 addr);
+
+// 同步原语相关的函数
+extern  u32 IrqSave      ();
+extern void IrqRestore   (u32 flags);
+extern void SpinInit     (Spinlock *lock, char *name);
+extern void SpinLock     (Spinlock *lock);
+extern  int SpinTryLock  (Spinlock *lock);
+extern void SpinUnlock   (Spinlock *lock);
+extern  u32 SpinLockIrqSave(Spinlock *lock);
+extern void SpinUnlockIrqRestore(Spinlock *lock, u32 flags);
+extern void ReadLock     (RWLock *lock);
+extern void ReadUnlock   (RWLock *lock);
+extern void WriteLock    (RWLock *lock);
+extern void WriteUnlock  (RWLock *lock);
+extern void WriteSeqLock (SeqLock *lock);
+extern void WriteSeqUnlock(SeqLock *lock);
+extern  u32 ReadSeqBegin (SeqLock *lock);
+extern  int ReadSeqRetry (SeqLock *lock, u32 seq);
+extern void WaitQueueSleep(WaitQueue *queue, PCB *pcb);
+extern  u32 WaitQueueWakeOne(WaitQueue *queue);
+extern void WaitQueueWakeAll(WaitQueue *queue);
+extern void MutexInit    (Mutex *mutex, char *name);
+extern  int MutexLock    (Mutex *mutex, PCB *pcb);
+extern void MutexUnlock  (Mutex *mutex);
+extern void SemInit      (Semaphore *sem, u32 count, char *name);
+extern  int SemDown      (Semaphore *sem, PCB *pcb);
+extern void SemUp        (Semaphore *sem);
+extern void LockStatDump (u32 row);
+
+// 本地 APIC 相关的函数
+extern  u32 LapicRead    (u32 reg);
+extern void LapicWrite   (u32 reg, u32 value);
+extern  u32 LapicId      ();
+extern void LapicInit    ();
+extern void LapicEoi     ();
+extern void LapicSendIpi (u32 apicId, u32 command);
+extern void LapicCalibrate();
+extern void LapicTimerPeriodic(u32 hz);
+extern void LapicTimerOneShot(u32 us);
+extern void IoapicInit   ();
+extern void IoapicRoute  (u32 irq, u32 vector, u32 apicId);
+extern void IoapicMask   (u32 irq);
+
+// 中断控制器相关的函数
+extern void PitInit      (u32 hz);
+extern void PitWaitMs    (u32 ms);
+extern void IrqEnable    (u32 irq, u32 cpu);
+extern void IrqDisable   (u32 irq);
+extern void IrqEoi       (u32 irq);
+extern void TimerInit    ();
+extern IrqHandler IrqRegister(u32 irq, IrqHandler handler);
+extern void IrqReport    ();
+extern void Yield        ();
+extern void ExceptionHandler(u32 id, u32 err, StackFrame *frame);
+extern void ProfileInit  ();
+extern void ProfileFlush ();
+extern CrashRecord crashLog[CRASH_LOG_SIZE];    // 因异常被终止的任务的崩溃记录
+extern u32         crashCount;                  // 记录过的崩溃总数
+extern u32         strayInts;                   // 没有处理函数的中断次数
+
+// 中断下半部相关的函数
+extern void IrqOffBegin  (CPU *cpu);
+extern void IrqOffEnd    (CPU *cpu);
+extern void IrqStatDump  (u32 row);
+extern void SoftirqRegister(u32 nr, void (*handler)());
+extern void RaiseSoftirq (u32 nr);
+extern void RunSoftirqs  (CPU *cpu);
+extern void TaskletSchedule(Tasklet *tasklet);
+extern void WorkSchedule (Work *work);
+extern void SoftirqInit  ();
+
+// 文件系统相关的函数
+extern void FsInit       ();
+extern FsEntry *FsLookup (char *name);
+
+// 内存操作相关的函数，在主机上运行测试时使用 C 库的实现
+#ifndef HOSTED
+extern void *memcpy      (void *dst, const void *src, u32 n);
+extern void *memmove     (void *dst, const void *src, u32 n);
+extern void *memset      (void *dst, int value, u32 n);
+extern  int memcmp       (const void *a, const void *b, u32 n);
+#else
+#include <string.h>
+#endif
+extern void PageZero     (void *page);
+extern void PageCopy     (void *dst, const void *src);
+extern void MemInit      ();
+extern  u32 MemFeatures  ();
+extern void MemBenchmark ();
+
+// 基准测试套件相关的函数
+extern void BenchReport  (char *name, u32 value, char *unit);
+extern void BenchKernel  ();
+extern void BenchWrite   ();
+extern void BenchBoot    (u64 firstTask);
+extern  u64 benchBootTsc;            // 进入保护模式时的时间戳
+extern void BenchTaskExit(PCB *pcb);
+
+// 页缓存与文件映射相关的函数
+extern void MmInit       ();
+extern void MmIoStart    ();
+extern  int PageCacheRead(FsEntry *entry, u32 offset, void *dst, u32 len);
+extern  int PageCacheWrite(FsEntry *entry, u32 offset, void *src, u32 len, PCB *pcb);
+extern  int PageCacheSync(FsEntry *entry);
+extern  u32 PageCacheFsync(PCB *pcb, FsEntry *entry);
+extern void PageCacheWriteback();
+extern void MmFlushTick  (u32 now);
+extern  u32 Mmap         (PCB *pcb, char *name, u32 length, u32 flags);
+extern  int MmFault      (PCB *pcb, u32 addr, u32 err);
+extern void MmRelease    (PCB *pcb);
+extern  int MmKernelMap  (u32 va, u32 size);
+
+// 设备驱动与系统调用相关的函数
+extern void KeyboardInit ();
+extern  u32 KeyboardRead (PCB *pcb, u32 va, u32 count);
+extern void KeyboardLatency(u64 cycles);
+extern void KeyboardStatDump(u32 row);
+extern  u32 ConsoleWrite (PCB *pcb, u32 va, u32 count);
+extern void FbInit       ();
+extern void FbPutCell    (u32 id, u32 code, u32 cell);
+extern void FbFlush      ();
+extern void SerialInit   ();
+extern void SerialPrint  (char *message);
+extern void SerialPrintDecimal(u32 value);
+extern void SerialPrintHex(u32 value);
+extern  u32 SerialWrite  (PCB *pcb, u32 va, u32 count);
+extern void Syscall      (PCB *pcb);
+extern  u64 GetTicks     ();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+//  console.c         by OrangeYYC
+//  TinyOS 任务的控制台输出
+//
+//  任务通过 write 系统调用向 1 号文件(控制台)写入字符流，一次调用可以写入一整行。
+//  每个任务有自己的光标和颜色，互不影响，也不影响内核的 Print 输出；图形模式(VBE 构建)下每个任务的
+//  控制台画在自己的离屏表面上，由 fb.c 的合成器显示在各自的窗口中。支持的控制序列:
+//    ESC [ 行 ; 列 H     移动光标(从 1 开始计数)
+//    ESC [ 参数... m     设置颜色: 0 恢复默认 1 高亮 5 闪烁 30-37 前景色 40-47 背景色
+//    ESC [ K             清除光标到行尾
+//  以及 \n(换行) \r(回到行首) \b(光标左移)
+
+#include "common.h"
+
+#define CON_DEFAULT_COLOR   F_White
+
+static Console consoles[MAX_TASKS];             // 每个任务的控制台状态
+
+// ANSI 颜色编号(黑 红 绿 黄 蓝 品红 青 白)对应的显存颜色编号
+static u8 ansiColor[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+// 在控制台的第 cell 个字符处显示 code，图形模式下画到任务的离屏表面上
+static void ConsoleCell(Console *con, u32 code, u32 cell) {
+#ifdef VBE
+    if (vbeInfo.base) {
+        FbPutCell(con - consoles, code, cell);
+        return;
+    }
+#endif
+    WriteToVedio(code, cell * 2);
+}
+
+// 在光标处输出字符，光标移到下一个位置，超出屏幕时停在最后一行
+static void ConsolePut(Console *con, u8 ch) {
+    if (con->col >= CONSOLE_COLS) {
+        con->col = 0;
+        con->row++;
+    }
+    if (con->row >= CONSOLE_ROWS)
+        con->row = CONSOLE_ROWS - 1;
+    ConsoleCell(con, ch | con->color, CONSOLE_COLS * con->row + con->col++);
+}
+
+// 执行读取完成的控制序列，cmd 为结尾的字符
+static void ConsoleCommand(Console *con, u8 cmd) {
+    u32 *p = con->params;
+    switch (cmd) {
+    case 'H':
+        con->row = p[0] ? p[0] - 1 : 0;
+        con->col = con->count > 1 && p[1] ? p[1] - 1 : 0;
+        if (con->row >= CONSOLE_ROWS)
+            con->row = CONSOLE_ROWS - 1;
+        if (con->col >= CONSOLE_COLS)
+            con->col = CONSOLE_COLS - 1;
+        break;
+    case 'm':
+        for (u32 i = 0; i < con->count || i == 0; i++) {
+            if (p[i] == 0)
+                con->color = CON_DEFAULT_COLOR;
+            else if (p[i] == 1)
+                con->color |= L_Light;
+            else if (p[i] == 5)
+                con->color |= Flicker;
+            else if (p[i] >= 30 && p[i] <= 37)
+                con->color = (con->color & ~0x0700) | ansiColor[p[i] - 30] << 8;
+            else if (p[i] >= 40 && p[i] <= 47)
+                con->color = (con->color & ~0x7000) | ansiColor[p[i] - 40] << 12;
+        }
+        break;
+    case 'K':
+        for (u32 col = con->col; col < CONSOLE_COLS; col++)
+            ConsoleCell(con, ' ' | con->color, CONSOLE_COLS * con->row + col);
+        break;
+    }
+}
+
+// 处理一个字符
+static void ConsoleChar(Console *con, u8 ch) {
+    switch (con->state) {
+    case CON_ESC:
+        con->state = ch == '[' ? CON_CSI : CON_NORMAL;
+        con->count = 0;
+        for (u32 i = 0; i < CONSOLE_PARAMS; i++)
+            con->params[i] = 0;
+        return;
+    case CON_CSI:
+        if (ch >= '0' && ch <= '9') {
+            if (!con->count)
+                con->count = 1;
+            if (con->count <= CONSOLE_PARAMS)
+                con->params[con->count - 1] = con->params[con->count - 1] * 10 + ch - '0';
+        } else if (ch == ';') {
+            con->count = con->count ? con->count + 1 : 2;
+        } else {
+            if (con->count > CONSOLE_PARAMS)
+                con->count = CONSOLE_PARAMS;
+            ConsoleCommand(con, ch);
+            con->state = CON_NORMAL;
+        }
+        return;
+    }
+    switch (ch) {
+    case '\033':
+        con->state = CON_ESC;
+        break;
+    case '\n':
+        con->col = 0;
+        if (con->row < CONSOLE_ROWS - 1)
+            con->row++;
+        break;
+    case '\r':
+        con->col = 0;
+        break;
+    case '\b':
+        if (con->col)
+            con->col--;
+        break;
+    default:
+        ConsolePut(con, ch);
+    }
+}
+
+// 将任务 pcb 地址 va 处的 count 个字符写到它的控制台，返回写入的字节数
+// 控制台只由所属任务写入，任务同一时刻只在一个处理器上运行，不需要加锁
+u32 ConsoleWrite(PCB *pcb, u32 va, u32 count) {
+    Console *con = &consoles[pcb->pid];
+    u8  data[CONSOLE_CHUNK];
+    if (!con->color)
+        con->color = CON_DEFAULT_COLOR;
+    for (u32 done = 0; done < count; ) {
+        u32 n = count - done < CONSOLE_CHUNK ? count - done : CONSOLE_CHUNK;
+        CopyFromUser(pcb, va + done, data, n);
+        for (u32 i = 0; i < n; i++)
+            ConsoleChar(con, data[i]);
+        done += n;
+    }
+    return count;
+}
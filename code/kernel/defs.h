@@ -15,30 +15,176 @@
 #define IDT_SIZE 		 		256
 // 内核加载的偏移地址
 #define KERNEL_BASE 	 		0x8000
-// 内核程序页目录基地址
-#define PAGE_DIR_BASE    		0x010000
-// 内核程序页表基地址
-#define PAGE_TABLE_BASE  		0x011000
-// 软盘中进程的开始扇区
-#define PROCESS_START_SECTOR 	40
-// 软盘中进程的占用扇区数目
-#define PROCESS_TOTAL_SECTOR 	10
-// 作为装入缓存的物理地址
-#define PROCESS_LOAD_BUFFER  	0x180000
+// 内核在硬盘中占用的扇区数目(从 1 号扇区开始)，内核最大为 0x8000 -> 0x3ffff
+#define KERNEL_SECTORS			448
+// 内核程序页目录指针表基地址(PAE 分页，cr3 指向此处)
+#define PAGE_DIR_BASE    		0x400000
+// 内核程序的 4 个页目录，依次覆盖 4G 线性地址中的每 1G
+#define PAGE_PD_BASE     		0x401000
+// 内核程序页表基地址，需要 4K 页表时从此处依次分配，不超过 FRAME_BASE
+#define PAGE_TABLE_BASE  		0x405000
+// 内核直接映射(线性地址 = 物理地址)的范围上限，之上的内存(包括 4G 以上的内存)只通过页表分给用户进程
+#define LOWMEM_LIMIT			0x40000000
+// 每个处理器临时映射一个物理页的窗口，依次为每个处理器一页
+#define KMAP_BASE				0xff800000
+// 分给用户进程的内存区域(页框池之后的全部可用内存，包括 4G 以上的内存)的最大数量
+#define HIGHMEM_RANGES			8
+// 硬盘中文件系统的开始扇区(超级块所在扇区)
+#define FS_START_SECTOR 		480
+// 文件系统目录哈希表的表项数量，每个扇区 16 项
+#define FS_DIR_ENTRIES 			64
+// 文件名的最大长度(包括结尾的 0)
+#define FS_NAME_LEN 			20
+// 页缓存和私有页使用的物理页框的起始地址与最大数量，位于所有页表共享的内核映射中
+#define FRAME_BASE				0x800000
+#define FRAME_COUNT				2048
+// 页缓存哈希表的桶数量
+#define PAGE_CACHE_BUCKETS		64
+// 页缓存的写回: 脏页超过 DIRTY_EXPIRE 个节拍或脏页数量达到 DIRTY_BACKGROUND 时由工作队列线程写回硬盘，
+// 每 FLUSH_PERIOD 个节拍检查一次脏页的时间
+#define DIRTY_EXPIRE			300
+#define DIRTY_BACKGROUND		64
+#define FLUSH_PERIOD			50
+// 硬盘一条写命令最多写入的扇区数，以及 WRITE MULTIPLE 每次数据传输的最大扇区数
+#define ATA_MAX_SECTORS			256
+#define ATA_MULTIPLE_MAX		16
+// 任务中用于文件映射和匿名内存的虚拟地址范围，使用任务私有的页目录，页表在页错误时分配
+#define MMAP_BASE				0x40000000
+#define MMAP_END				0x80000000
+// 每个任务的文件映射数量
+#define MAX_VMAS				4
 // 用户进程占用物理内存大小
 #define PROCESS_PSIZE			0x10000
 // 用户进程占物理内存的起始位置
 #define PROCESS_PSTART			0x100000
-// 用户进程页目录起始地址
-#define PROCESS_PDE_START		0x20000
-// 用户进程页表起始地址
-#define PROCESS_PTE_START   	0x21000
-// 用户进程页表大小
-#define PROCESS_PTE_SIZE		0x10000
+// 用户进程页表起始地址与每个进程占用的大小，每个进程依次为:
+// 页目录指针表 | 0 -> 1G 的页目录 | 0 -> 2M 的页表 | 文件映射区域 1G -> 2G 的页目录
+#define PROCESS_PAGE_START		0x60000
+#define PROCESS_PAGE_SIZE		0x4000
+#define PROCESS_PD0_OFFSET		0x1000
+#define PROCESS_PT0_OFFSET		0x2000
+#define PROCESS_PD1_OFFSET		0x3000
+// 最大处理器数量
+#define MAX_CPUS				8
+// 应用处理器启动代码的物理地址 (必须 4K 对齐且低于 1M)
+#define AP_TRAMPOLINE			0x6000
+// 应用处理器内核栈的起始地址与每个处理器的栈大小
+#define CPU_STACK_BASE			0x50000
+#define CPU_STACK_SIZE			0x1000
+// 启动处理器的内核栈栈顶
+#define BSP_STACK_TOP			0x7fff
+// 各处理器中断栈的起始地址与大小，嵌套的中断在中断栈上执行上半部
+#define IRQ_STACK_BASE			0x48000
+#define IRQ_STACK_SIZE			0x1000
+// 内核线程栈的起始地址与每个线程的栈大小，按 pid 分配
+#define KTHREAD_STACK_BASE		0x58000
+#define KTHREAD_STACK_SIZE		0x1000
+// 内核线程的优先级
+#define KTHREAD_PRIORITY		500
+// 一次中断返回前最多重复执行软中断的轮数，剩余的留到下一次中断
+#define SOFTIRQ_RESTART			10
+// 键盘输入缓冲区大小，必须为 2 的幂
+#define KBD_BUF_SIZE			64
+// 屏幕的行数与列数
+#define CONSOLE_ROWS			25
+#define CONSOLE_COLS			80
+// 控制台控制序列的最大参数数量
+#define CONSOLE_PARAMS			4
+// 控制台写入时每次从任务复制的字节数
+#define CONSOLE_CHUNK			32
+// 时钟中断频率
+#define TIMER_HZ				100
+// 记录的锁统计信息的最大数量与输出周期(时钟节拍)
+#define LOCK_STAT_MAX			16
+#define LOCK_STAT_PERIOD		1000
+// 任务监视器(TOP 构建)的刷新周期(时钟节拍)与表头所在的行，表头下每个进程占一行
+#define TOP_PERIOD				TIMER_HZ
+#define TOP_ROW					7
+// 空闲的应用处理器使用单次定时器，等待的时间(微秒)
+#define IDLE_DEADLINE_US		100000
+// 开启分页后测量访问速度时扫过的内存大小，每页读取一次
+#define PAGING_SWEEP_SIZE		0x1000000
+// 内存操作基准测试中每种大小复制或填充的总字节数，使用页框池(FRAME_BASE 开始)作为缓冲区
+#define MEM_BENCH_BYTES			0x200000
+// 基准测试套件中页目录切换每次访问的页数，以及读取硬盘的扇区数
+#define BENCH_TOUCH_PAGES		16
+#define BENCH_DISK_SECTORS		256
+// 基准测试套件中写入硬盘的测量: 随机小块写入的块大小和次数，顺序写入的块大小，使用文件 BENCH_WRITE_FILE
+#define BENCH_WRITE_SMALL		512
+#define BENCH_WRITE_COUNT		256
+#define BENCH_WRITE_LARGE		0x10000
+#define BENCH_WRITE_FILE		"scratch"
+// 崩溃记录的数量，任务因异常被终止时保存现场，超过时覆盖最早的记录
+#define CRASH_LOG_SIZE			8
+// 采样分析器的采样频率(使用 PIT)，构建时可通过 -DPROF_HZ 指定，没有本地 APIC 时需要是 TIMER_HZ 的倍数
+#ifndef PROF_HZ
+#define PROF_HZ					1000
+#endif
+// 采样分析器的样本表: 起始地址、表项数量(2 的幂)和最多探测的表项数，以及写到串口的周期(时钟节拍)
+#define PROF_BASE				0x180000
+#define PROF_SLOTS				4096
+#define PROF_PROBE				16
+#define PROF_DUMP_PERIOD		3000
+// 内核代码(Ring0)的样本使用的任务编号
+#define PROF_PID_KERNEL			0xf
+// VBE 图形模式(VBE 构建)期望的分辨率，构建时可通过 -DVBE_WIDTH -DVBE_HEIGHT 指定，
+// 没有完全相同的模式时选择不超过此分辨率的最大的 32 位色模式
+#ifndef VBE_WIDTH
+#define VBE_WIDTH				1920
+#endif
+#ifndef VBE_HEIGHT
+#define VBE_HEIGHT				1200
+#endif
+// 实模式查询 VBE 控制器信息和模式信息使用的缓冲区(引导程序的栈空间，此时已不再使用)
+#define VBE_CTRL_BUF			0x7000
+#define VBE_MODE_BUF			0x7200
+// 帧缓冲映射的线性地址与最大大小
+#define FB_BASE					0xf0000000
+#define FB_MAX_SIZE				0x1000000
+// 离屏表面映射的线性地址与每个表面占用的线性地址范围，依次为每个任务和内核各一个
+#define FB_SURFACE_BASE			0xe0000000
+#define FB_SURFACE_SPAN			0x100000
+// 字模的宽度与高度(BIOS 的 8x16 字模)，每个表面为 CONSOLE_COLS x CONSOLE_ROWS 个字符
+#define FB_GLYPH_W				8
+#define FB_GLYPH_H				16
+#define FB_SURFACE_W			(CONSOLE_COLS * FB_GLYPH_W)
+#define FB_SURFACE_H			(CONSOLE_ROWS * FB_GLYPH_H)
+// 内核输出使用的表面编号，任务的表面编号为 pid
+#define FB_KERNEL				MAX_TASKS
+// 合成器把脏矩形复制到屏幕的周期与统计信息写到串口的周期(时钟节拍)
+#define FB_PERIOD				4
+#define FB_REPORT_PERIOD		1000
 // 硬盘扇区大小
 #define DISK_SECTOR_SIZE 		0x200
+// 默认调度策略 构建时可通过 -DSCHED_POLICY 指定
+#ifndef SCHED_POLICY
+#define SCHED_POLICY			SCHED_PRIORITY
+#endif
+// 轮转调度的时间片长度(时钟节拍)
+#define RR_SLICE				20
+// 多级反馈队列的级数、最高级时间片长度和全体提升周期
+#define MLFQ_LEVELS				3
+#define MLFQ_QUANTUM			10
+#define MLFQ_BOOST				500
+// CFS 调度中虚拟运行时间的缩放系数与最小运行粒度
+#define CFS_SCALE				100000
+#define CFS_MIN_GRAN			4
+// CFS 调度中唤醒任务最多获得的虚拟运行时间补偿
+#define CFS_WAKEUP_CREDIT		4000
+// setpriority 接受的优先级范围，优先数调度作为节拍数，CFS 作为权重
+#define PRIO_MIN				1
+#define PRIO_MAX				1000
+// EDF 调度的接纳控制: 每个处理器上实时任务的利用率(预算/截止时间，按千分之一计)之和的上限，其余留给普通任务
+#define EDF_UTIL_SCALE			1000
+#define EDF_UTIL_LIMIT			900
+// 实时任务统计信息写到串口的周期(时钟节拍)
+#define EDF_REPORT_PERIOD		1000
+// 启动时装入任务的线程作为实时任务运行的周期和每个周期的预算(时钟节拍)
+#define LOADER_PERIOD			2
+#define LOADER_BUDGET			1
 
 /* ========================== 类型定义 ========================== */
+typedef unsigned long long u64;
 typedef unsigned int    u32;
 typedef unsigned short  u16;
 typedef unsigned char    u8;
@@ -72,6 +218,54 @@ typedef struct s_ard {
 	u32		Type;
 } ARD;
 
+// 文件系统超级块 位于 FS_START_SECTOR 扇区，之后依次为目录哈希表和文件数据
+typedef struct s_fsSuper {
+	u32		magic;				// 文件系统标识 FS_MAGIC
+	u32		totalSectors;		// 文件系统占用的扇区数
+	u32		dirStart;			// 目录哈希表的起始扇区
+	u32		dirSectors;			// 目录哈希表占用的扇区数
+	u32		dirEntries;			// 目录哈希表的表项数量
+	u32		fileCount;			// 文件数量
+	u32		dataStart;			// 文件数据的起始扇区
+} FsSuper;
+
+// 文件系统目录项 每个文件占用一段连续的扇区，名称为空的表项未使用
+typedef struct s_fsEntry {
+	char	name[FS_NAME_LEN];	// 文件名
+	u32		start;				// 文件的起始扇区
+	u32		sectors;			// 文件占用的扇区数
+	u32		size;				// 文件大小(字节)
+} FsEntry;
+
+// 任务的控制台状态 每个任务有自己的光标和颜色，支持 ANSI 控制序列的一个子集
+typedef struct s_console {
+	u32		row;				// 光标所在行
+	u32		col;				// 光标所在列
+	u32		color;				// 当前颜色(显存中字符的高 8 位)
+	u32		state;				// 控制序列的解析状态 CON_NORMAL CON_ESC CON_CSI
+	u32		params[CONSOLE_PARAMS];	// 控制序列的参数
+	u32		count;				// 已读取的参数数量
+} Console;
+
+// 物理页框描述符 FRAME_BASE 开始的每个页框一项，页缓存中的页按 (文件, 页号) 链入哈希表
+typedef struct s_pageFrame {
+	u32		file;				// 所属文件的起始扇区，作为文件的标识
+	u32		index;				// 页在文件中的编号
+	u32		dirtied;			// 脏页第一次被写入时的时钟节拍
+	u16		refs;				// 映射此页的页表项数量
+	u16		sectors;			// 缓存页在文件中占用的扇区数，读入和写回时只读写这些扇区
+	u16		next;				// 哈希链或空闲链中的下一个页框，FRAME_NONE 表示结束
+	u16		state;				// FRAME_FREE FRAME_CACHE FRAME_DIRTY FRAME_ANON FRAME_TABLE FRAME_READING FRAME_WRITEBACK
+} PageFrame;
+
+// 任务的一段文件映射 [start, end)
+typedef struct s_vmArea {
+	u32		start;				// 起始虚拟地址，0 表示空闲表项
+	u32		end;				// 结束虚拟地址
+	FsEntry	*file;				// 映射的文件，从文件开头映射，匿名内存为 0
+	u32		flags;				// MAP_SHARED MAP_PRIVATE 或 MAP_ANON
+} VmArea;
+
 // 进程栈帧结构 用于在进程切换的过程中保存寄存器环境
 typedef struct s_stackFrame {
 	u32		gs;				// 任务 gs		   <---- 使用 push gs 指令保存
@@ -93,6 +287,92 @@ typedef struct s_stackFrame {
 	u32		ss;				// 任务 ss(Ring3)  <---- 此处向上的内容由中断硬件机制保存		
 } StackFrame;
 
+// VBE 图形模式的信息 由实模式部分设置模式后填写，base 为 0 时仍为文本模式
+typedef struct s_vbeInfo {
+	u32		base;				// 帧缓冲的物理地址
+	u32		pitch;				// 每行的字节数
+	u16		width;				// 水平分辨率
+	u16		height;				// 垂直分辨率
+	u16		mode;				// VBE 模式号
+	u16		version;			// VBE 版本
+	u32		font;				// BIOS 中 8x16 字模的线性地址
+} VbeInfo;
+
+// VBE 控制器信息 由 0x4f00 号功能填写，只列出使用的字段
+typedef struct s_vbeCtrl {
+	char	signature[4];		// "VESA"，调用前写入 "VBE2" 请求 VBE 2.0 的信息
+	u16		version;			// VBE 版本
+	u16		oem[2];				// 厂商信息的远指针
+	u16		caps[2];			// 控制器能力
+	u16		modeOff;			// 模式号列表的远指针，列表以 0xffff 结束
+	u16		modeSeg;
+	u16		totalMemory;		// 显存大小(64K 为单位)
+} VbeCtrl;
+
+// VBE 模式信息 由 0x4f01 号功能填写，只列出使用的字段
+typedef struct s_vbeMode {
+	u16		attributes;			// 模式属性 VBE_ATTR_*
+	u8		window[14];			// 窗口访问方式的信息
+	u16		pitch;				// 每行的字节数
+	u16		width;				// 水平分辨率
+	u16		height;				// 垂直分辨率
+	u8		charSize[2];		// 字符的宽度与高度
+	u8		planes;				// 位面数
+	u8		bpp;				// 每个像素的位数
+	u8		banks;				// 存储体数
+	u8		memoryModel;		// 内存模型，直接颜色为 VBE_MODEL_DIRECT
+	u8		bankSize;			// 存储体大小
+	u8		imagePages;			// 可容纳的画面数减一
+	u8		reserved;
+	u8		redSize;			// 直接颜色中红、绿、蓝各分量的位数与位置
+	u8		redPos;
+	u8		greenSize;
+	u8		greenPos;
+	u8		blueSize;
+	u8		bluePos;
+	u8		rsvdSize;
+	u8		rsvdPos;
+	u8		directInfo;
+	u16		baseLow;			// 线性帧缓冲的物理地址
+	u16		baseHigh;
+} VbeMode;
+
+// 离屏表面 内核的输出和每个任务的控制台各一个，合成器把脏矩形复制到屏幕上的窗口
+typedef struct s_surface {
+	u32		*pixels;			// FB_SURFACE_W x FB_SURFACE_H 个 32 位像素，没有窗口或未分配时为 0
+	u32		x;					// 窗口在屏幕上的位置
+	u32		y;
+	u32		x0;					// 脏矩形 [x0, x1) x [y0, y1)，x0 >= x1 时为空
+	u32		y0;
+	u32		x1;
+	u32		y1;
+} Surface;
+
+// 采样分析器的样本表项 同一个任务在同一特权级、同一地址上的样本合并计数
+typedef struct s_profSlot {
+	u32			key;				// 任务编号(高 4 位，PROF_PID_KERNEL 为内核)、特权级(2 位)和 eip(低 26 位)
+	u32			count;				// 样本数，0 表示空闲表项
+} ProfSlot;
+
+// 崩溃记录结构 保存因异常被终止的任务的现场
+typedef struct s_crashRecord {
+	u32			pid;				// 任务编号
+	u32			vector;				// 异常编号
+	u32			err;				// 错误码，没有错误码的异常为 0xffffffff
+	u32			cr2;				// 页错误的线性地址，其他异常为 0
+	u64			tick;				// 发生时的时钟节拍
+	StackFrame	regs;				// 异常发生时的寄存器
+} CrashRecord;
+
+// 任务的资源使用统计，由 getrusage 系统调用复制给任务
+typedef struct s_rusage {
+	u32			userTicks;			// 在 Ring3 执行时经过的时钟节拍
+	u32			kernelTicks;		// 在内核中为该任务执行时经过的时钟节拍
+	u32			voluntary;			// 阻塞、让出或结束时的主动切换次数
+	u32			involuntary;		// 时间片用完或被更高级的任务抢占时的被动切换次数
+	u32			faults;				// 页错误次数
+} Rusage;
+
 // 进程控制块结构 用于描述进程
 typedef struct s_pcb {
 	StackFrame 	regs;				// 进程栈帧
@@ -102,8 +382,59 @@ typedef struct s_pcb {
 	u32			tick;				// 进程的等待执行计数
 	u32			priority;			// 进程优先级
 	u32 		pageDirBase;		// 进程页目录的地址
+	u32			state;				// 进程状态
+	u32			policy;				// 进程使用的调度策略
+	u32			slice;				// 轮转和多级反馈队列调度的剩余时间片
+	u32			level;				// 多级反馈队列调度中所处的队列级别
+	u32			vruntime;			// CFS 调度中的虚拟运行时间
+	u32			cpu;				// 任务所在运行队列的处理器编号
+	u64			inputStamp;			// 交给任务的最早一个按键的时间戳，任务恢复执行时统计延迟
+	u32			period;				// 实时任务的周期(节拍)
+	u32			budget;				// 实时任务每个周期的执行预算(节拍)
+	u32			deadline;			// 实时任务的相对截止时间(节拍)
+	u32			release;			// 当前作业的释放时间(节拍)
+	u32			absDeadline;		// 当前作业的绝对截止时间(节拍)
+	u32			edfFlags;			// 当前作业的状态 EDF_*
+	u32			jobs;				// 释放的作业数
+	u32			misses;				// 错过截止时间的作业数
+	u32			jitterMax;			// 作业从释放到开始执行的最长时间(周期)
+	u64			jitterSum;			// 作业从释放到开始执行的时间总和(周期)
+	u64			releaseTsc;			// 当前作业释放时的时间戳
+	Rusage		usage;				// 资源使用统计
 } PCB;
 
+// 调度类结构 每种调度策略实现一组操作，由 choose() 按顺序调用
+typedef struct s_schedClass {
+	char		*name;						// 策略名称
+	void		(*Setup)  (PCB *pcb);		// 任务加入调度时初始化调度参数
+	int			(*Tick)   (PCB *pcb);		// 当前任务消耗一个节拍，返回非 0 表示需要重新选择
+	int			(*Pick)   (u32 cpu);		// 选择处理器 cpu 上下一个执行的任务，没有可执行任务时返回 -1
+	void		(*Wakeup) (PCB *pcb);		// 任务由阻塞变为就绪
+} SchedClass;
+
+// 内存操作的一种实现，memcpy 和 memset 使用，need 为需要的处理器特性 MEM_FEAT_*
+typedef struct s_memVariant {
+	char		*name;						// 实现名称
+	u32			need;						// 需要的处理器特性
+	void		(*Copy)(void *dst, const void *src, u32 n);
+	void		(*Set) (void *dst, u32 value, u32 n);
+} MemVariant;
+
+// 整页操作的一种实现，PageZero 和 PageCopy 使用，地址需要按页对齐
+typedef struct s_pageVariant {
+	char		*name;						// 实现名称
+	u32			need;						// 需要的处理器特性
+	void		(*Zero)(void *page);
+	void		(*Copy)(void *dst, const void *src);
+} PageVariant;
+
+// 合成器复制一行像素的一种实现，地址和字节数需要按 32 字节对齐
+typedef struct s_blitVariant {
+	char		*name;						// 实现名称
+	u32			need;						// 需要的处理器特性
+	void		(*Row)(void *dst, const void *src, u32 n);
+} BlitVariant;
+
 // 任务状态段结构 用于在优先级转换的过程中重置信息
 typedef struct s_tss {
 	u32	backlink;
@@ -135,6 +466,103 @@ typedef struct s_tss {
 	u16	iobase;
 } TSS;
 
+// 处理器结构 每个处理器拥有自己的全局描述符表、任务状态段和运行队列
+typedef struct s_cpu {
+	u32			id;						// 处理器编号，启动处理器为 0
+	u32			apicId;					// 处理器的本地 APIC 编号
+	u32			started;				// 处理器是否已经完成启动
+	u32			readyPid;				// 该处理器上的就绪 pid
+	u32			stackTop;				// 该处理器的内核栈栈顶
+	u32			oneShot;				// 本地定时器是否处于单次模式
+	u32			ticked;					// 上一次调度后经过的时钟节拍数
+	u32			yield;					// 当前任务主动让出处理器，下一次调度时重新选择
+	u32			softirqPending;			// 等待执行的软中断，按编号置位
+	StackFrame	*irqFrame;				// 正在处理的中断打断的代码保存的寄存器，打断空闲的处理器时为 0
+	struct s_tasklet *tasklets;			// 等待执行的小任务链表
+	u64			irqOffStart;			// 本次关中断的时间戳
+	u64			irqOffMax;				// 最长关中断时间(周期)
+	u64			irqCycles;				// 已完成的上半部的累计时间(周期)，用于扣除嵌套中断的时间
+	u32			irqDepthMax;			// 最大中断嵌套深度
+	u64			tickTsc;				// 上一次时钟中断的时间戳，为 0 时不检查错过的节拍
+	u32			lateTicks;				// 迟到的时钟中断次数
+	u32			lostTicks;				// 错过后补上的节拍数
+	TSS			tss;					// 该处理器的任务状态段
+	Descriptor	gdt[GDT_SIZE];			// 该处理器的全局描述符表
+	u8			gdtPtr[6];				// 该处理器的全局描述符表指针
+} CPU;
+
+// 外部中断的上半部处理函数 只响应设备并把耗时的工作推迟到下半部
+// 时钟级以下的处理函数开中断执行，与更高级的上半部共享的数据需要关中断访问
+typedef void (*IrqHandler)(u32 irq);
+
+// 每个中断上半部的统计信息(IRQ_STAT 构建)，时间不含嵌套的中断
+typedef struct s_irq_stat {
+	u32			count;					// 处理次数
+	u32			maxCycles;				// 最长处理时间(周期)
+	u64			cycles;					// 累计处理时间(周期)
+} IrqStat;
+
+// 小任务结构 在软中断中以开中断状态执行，同一个小任务不会重复排队
+typedef struct s_tasklet {
+	struct s_tasklet *next;				// 链表中的下一个小任务
+	void		(*func)(u32 data);		// 执行函数
+	u32			data;					// 执行函数的参数
+	volatile u32 scheduled;				// 是否已经排队
+} Tasklet;
+
+// 工作结构 由工作队列内核线程执行，执行函数可以睡眠
+typedef struct s_work {
+	struct s_work *next;				// 队列中的下一个工作
+	void		(*func)(struct s_work *work);	// 执行函数
+	volatile u32 pending;				// 是否已经排队
+} Work;
+
+// 自旋锁结构 使用排队号保证先到先得
+typedef struct s_spinlock {
+	volatile u32	next;				// 下一个申请者取得的排队号
+	volatile u32	owner;				// 当前持有锁的排队号
+#ifdef LOCK_STAT
+	char			*name;				// 锁的名称
+	u32				acquires;			// 获取次数
+	u32				contended;			// 需要等待的获取次数
+	u64				spinCycles;			// 等待消耗的总周期数
+	u64				maxHold;			// 最长持有时间(周期)
+	u64				acquiredAt;			// 本次获取时的时间戳
+#endif
+} Spinlock;
+
+// 读写自旋锁结构 允许多个读者或一个写者
+typedef struct s_rwlock {
+	volatile u32	count;				// 低位为读者数量，高两位为写者持有和写者等待标记
+} RWLock;
+
+// 顺序锁结构 读者不加锁，通过序号判断读取期间是否有写入
+typedef struct s_seqlock {
+	volatile u32	seq;				// 序号，写入过程中为奇数
+	Spinlock		lock;				// 写者之间互斥
+} SeqLock;
+
+// 等待队列结构 按先进先出的顺序记录阻塞的任务，由使用者的锁保护
+typedef struct s_waitQueue {
+	u32			head;					// 队首位置
+	u32			count;					// 等待的任务数量
+	u8			pids[MAX_TASKS];		// 等待的任务
+} WaitQueue;
+
+// 互斥锁结构 获取失败的任务睡眠，释放时直接交给等待最久的任务
+typedef struct s_mutex {
+	Spinlock	lock;					// 保护互斥锁的状态
+	u32			owner;					// 持有者的 pid，空闲时为 -1
+	WaitQueue	waiters;				// 等待的任务
+} Mutex;
+
+// 信号量结构 计数为 0 时获取失败的任务睡眠，释放时直接交给等待最久的任务
+typedef struct s_semaphore {
+	Spinlock	lock;					// 保护信号量的状态
+	u32			count;					// 可用的资源数量
+	WaitQueue	waiters;				// 等待的任务
+} Semaphore;
+
 /* ========================== 常量定义 ========================== */
 // 全局描述符表中的表项序号
 // 0: 空描述符 DPL0
@@ -213,6 +641,63 @@ typedef struct s_tss {
 #define PAGE_W           2
 #define PAGE_S           0
 #define PAGE_U           4
+#define PAGE_PWT         8
+#define PAGE_PCD         0x10
+#define PAGE_PS          0x80       // 页目录项直接映射 2M 的大页
+#define PAGE_SIZE        0x1000
+#define LARGE_PAGE_SIZE  0x200000
+#define PAGE_ENTRIES     512        // PAE 每个页表和页目录的表项数量
+#define PAGE_ADDR_MASK   0x000ffffffffff000ULL  // 页表项中的物理地址
+
+// 处理器特性
+#define CPUID_PAE        (1 << 6)   // cpuid 1 号功能 edx: 支持 PAE
+#define CPUID_MMX        (1 << 23)  // cpuid 1 号功能 edx: 支持 MMX
+#define CPUID_FXSR       (1 << 24)  // cpuid 1 号功能 edx: 支持 fxsave/fxrstor
+#define CPUID_SSE        (1 << 25)  // cpuid 1 号功能 edx: 支持 SSE
+#define CPUID_SSE2       (1 << 26)  // cpuid 1 号功能 edx: 支持 SSE2
+#define CPUID_PAT        (1 << 16)  // cpuid 1 号功能 edx: 支持页属性表
+#define CPUID_ERMS       (1 << 9)   // cpuid 7 号功能 ebx: 快速的 rep movsb/stosb
+#define CR0_MP           0x2        // cr0: 监视协处理器
+#define CR0_EM           0x4        // cr0: 模拟协处理器，置位时 MMX/SSE 指令产生异常
+#define CR4_PAE          0x20       // cr4: 开启 PAE 分页
+#define CR4_OSFXSR       0x200      // cr4: 操作系统支持 SSE 指令
+
+// 页错误的错误码
+#define PF_PRESENT       1          // 页存在，因权限不足产生错误
+#define PF_WRITE         2          // 写入产生错误
+
+// 物理页框状态
+#define FRAME_FREE       0          // 空闲
+#define FRAME_CACHE      1          // 页缓存中的文件页
+#define FRAME_ANON       2          // 任务私有的页(写时复制得到的副本或匿名内存)
+#define FRAME_TABLE      3          // 任务文件映射区域的页表
+#define FRAME_DIRTY      4          // 页缓存中被写入、还没有写回硬盘的文件页，不会被回收
+#define FRAME_READING    5          // 正在由工作队列线程从硬盘读入的缓存页，内容无效，不会被回收
+#define FRAME_WRITEBACK  6          // 正在写回硬盘的脏页，不会被回收，写入该页的任务等待写回完成
+#define FRAME_NONE       0xffff     // 没有页框
+#define FRAME_WAIT       0xfffe     // 页正在读写硬盘，需要等待
+#define PAGE_WAIT        2          // 页缓存函数的返回值: 页正在读写硬盘，调用的任务已经阻塞，被唤醒后重新执行
+
+// 文件映射方式
+#define MAP_SHARED       1          // 只读共享，直接映射页缓存中的页
+#define MAP_PRIVATE      2          // 私有，写入时复制
+#define MAP_ANON         4          // 匿名内存，第一次访问时分配清零的页，优先使用直接映射之外的内存
+
+// 内存操作的实现需要的处理器特性
+#define MEM_FEAT_ERMS    1          // 快速的 rep movsb/stosb
+#define MEM_FEAT_SSE     2          // SSE 的 movntq 和 sfence
+#define MEM_FEAT_SSE2    4          // SSE2 的 movdqa 和 movntdq
+
+// 页属性表
+#define MSR_PAT          0x277      // 页属性表寄存器，8 项各 8 位，由页表项的 PAT PCD PWT 位选择
+#define PAT_WC           1          // 写合并
+#define PAT_WC_ENTRY     1          // 改为写合并的表项，对应 PAGE_PWT(默认为写直达)
+
+// VBE 相关常量
+#define VBE_OK           0x4f       // 功能调用成功时 ax 的值
+#define VBE_ATTR_NEEDED  0x99       // 需要的模式属性: 支持、彩色、图形、线性帧缓冲
+#define VBE_MODEL_DIRECT 6          // 直接颜色的内存模型
+#define VBE_LFB          0x4000     // 设置模式时使用线性帧缓冲
 
 // 中断控制器相关常量
 #define INT_M_CTL       0x20        // 主中断控制器输入输出端口
@@ -222,6 +707,160 @@ typedef struct s_tss {
 #define INT_VECTOR_IRQ0 0x20        // 主中断处理器中断向量号
 #define INT_VECTOR_IRQ8 0x28        // 从中断处理器中断向量号
 
+// 本地 APIC 相关常量
+#define LAPIC_DEFAULT_BASE  0xfee00000  // 本地 APIC 默认物理地址
+#define LAPIC_ID            0x20        // APIC 编号寄存器
+#define LAPIC_EOI           0xb0        // 中断结束寄存器
+#define LAPIC_SVR           0xf0        // 伪中断向量寄存器
+#define LAPIC_ICRLO         0x300       // 中断命令寄存器低 32 位
+#define LAPIC_ICRHI         0x310       // 中断命令寄存器高 32 位
+#define LAPIC_TIMER         0x320       // 本地定时器向量表项
+#define LAPIC_TICR          0x380       // 定时器初始计数
+#define LAPIC_TCCR          0x390       // 定时器当前计数
+#define LAPIC_TDCR          0x3e0       // 定时器分频配置
+#define LAPIC_ENABLE        0x100       // SVR 中的 APIC 软件使能位
+#define LAPIC_TIMER_PERIODIC 0x20000    // 定时器周期模式
+#define LAPIC_TIMER_MASKED  0x10000     // 定时器中断屏蔽
+#define ICR_INIT            0x500       // INIT 处理器间中断
+#define ICR_STARTUP         0x600       // STARTUP 处理器间中断
+#define ICR_LEVEL           0x8000      // 电平触发
+#define ICR_ASSERT          0x4000      // 有效电平
+#define ICR_BUSY            0x1000      // 发送中
+#define INT_VECTOR_APIC_TIMER 0xd0      // 本地 APIC 定时器中断向量号，优先级高于所有 IO APIC 中断
+#define INT_VECTOR_IOAPIC 0x90          // IO APIC 发送的 ISA 中断向量起始，加上优先级 * 0x10 和中断编号
+#define INT_VECTOR_SPURIOUS 0xff        // 本地 APIC 伪中断向量号
+#define INT_VECTOR_YIELD 0x41           // 内核线程让出处理器的中断向量号
+#define INT_VECTOR_SYSCALL 0x80         // 系统调用的中断向量号
+
+// 中断编号 0 -> 15 为 ISA 中断
+#define IRQ_LAPIC_TIMER 16              // 本地 APIC 定时器
+#define IRQ_COUNT       17              // 有上半部处理函数的中断数量
+#define IRQ_NONE        0xff            // 没有对应设备的中断(让出处理器)
+#define IRQ_SYSCALL     0xfe            // 系统调用
+#define IRQ_EXCEPTION   0xc0            // 任务的异常，加上异常编号(0 至 EXCEPTION_COUNT - 1)
+#define EXCEPTION_COUNT 32
+
+// 中断的优先级，本地 APIC 按向量的高 4 位屏蔽正在处理的中断的同级和更低级中断
+// 时钟级的上半部关中断执行，其余级别开中断执行，可以被更高级的中断打断
+#define IRQ_PRIO_LOW    0               // 级联和协处理器等
+#define IRQ_PRIO_NORMAL 1               // 硬盘等块设备
+#define IRQ_PRIO_HIGH   2               // 键盘和串口等缓冲区很小的字符设备
+#define IRQ_PRIO_CLOCK  3               // 时钟
+// 时钟中断比预期晚到超过周期的 1/TICK_LATE_DIV 时记为迟到，晚到整数个周期时补上错过的节拍
+#define TICK_LATE_DIV   4
+
+// 硬盘(主通道主盘，LBA28 PIO)
+#define ATA_DATA        0x1f0           // 数据端口
+#define ATA_FEATURES    0x1f1           // 特性寄存器
+#define ATA_COUNT       0x1f2           // 扇区数
+#define ATA_LBA_LOW     0x1f3           // LBA 0-7 位
+#define ATA_LBA_MID     0x1f4           // LBA 8-15 位
+#define ATA_LBA_HIGH    0x1f5           // LBA 16-23 位
+#define ATA_DRIVE       0x1f6           // 驱动器选择与 LBA 24-27 位
+#define ATA_COMMAND     0x1f7           // 命令(写)与状态(读)
+#define ATA_LBA         0xe0            // 使用 LBA 模式选择主盘
+#define ATA_SR_ERR      0x01            // 状态: 出错
+#define ATA_SR_DRQ      0x08            // 状态: 数据准备就绪
+#define ATA_SR_BSY      0x80            // 状态: 忙
+#define ATA_CMD_READ    0x20            // READ SECTORS
+#define ATA_CMD_WRITE   0x30            // WRITE SECTORS
+#define ATA_CMD_WRITE_MULTIPLE 0xc5     // WRITE MULTIPLE，每次数据传输多个扇区
+#define ATA_CMD_SET_MULTIPLE   0xc6     // SET MULTIPLE MODE
+#define ATA_CMD_FLUSH   0xe7            // CACHE FLUSH，把硬盘缓存中的数据写到介质
+#define ATA_CMD_IDENTIFY 0xec           // IDENTIFY DEVICE
+
+// 键盘
+#define IRQ_KEYBOARD    1               // 键盘中断
+#define KBD_DATA        0x60            // 键盘数据端口
+#define KBD_STATUS      0x64            // 键盘状态端口
+
+// 系统调用编号，调用号放在 eax 中，参数依次放在 ebx ecx edx esi 中，返回值在 eax 中
+#define SYS_READ        0               // 读取输入 read(fd, buf, count)
+#define SYS_MMAP        1               // 映射文件 mmap(name, length, flags)
+#define SYS_WRITE       2               // 写入输出 write(fd, buf, count)
+#define SYS_EXIT        3               // 结束任务 exit(code)
+#define SYS_YIELD       4               // 让出处理器 yield()
+#define SYS_EDF         5               // 成为实时任务 edf(period, budget, deadline)
+#define SYS_WAIT_PERIOD 6               // 实时任务完成本周期的作业 wait_period()
+#define SYS_SETPRIORITY 7               // 修改任务的优先级 setpriority(pid, priority)
+#define SYS_GETPRIORITY 8               // 读取任务的优先级 getpriority(pid)
+#define SYS_GETRUSAGE   9               // 读取任务的资源使用统计 getrusage(pid, buf)
+#define SYS_PWRITE      10              // 写入文件 pwrite(name, buf, count, offset)
+#define SYS_FSYNC       11              // 把文件写回硬盘 fsync(name)
+#define SYSCALL_COUNT   12
+#define SYSCALL_BLOCKED 0xfffffffe      // 处理函数使任务阻塞，返回值由唤醒任务的一方填写
+#define SYSCALL_INSN_SIZE 2             // int 0x80 指令的长度，重新执行系统调用时 eip 回退的字节数
+#define PID_SELF        0xffffffff      // 作为系统调用的任务编号时表示调用者自己
+#define FD_SERIAL       3               // 写入串口的文件编号，用于输出机器可读的结果
+
+// 串口与 QEMU 的退出设备
+#define SERIAL_PORT     0x3f8           // 第一个串口(COM1)的端口基地址
+#define SERIAL_CHUNK    32              // 写入串口时每次从任务复制的字节数
+#define FILE_CHUNK      256             // 写入文件时每次从任务复制的字节数
+#define DEBUG_EXIT_PORT 0xf4            // QEMU isa-debug-exit 设备的端口，写入 v 时 QEMU 以 (v << 1) | 1 退出
+
+// 控制台控制序列的解析状态
+#define CON_NORMAL      0               // 普通字符
+#define CON_ESC         1               // 读到 ESC
+#define CON_CSI         2               // 读到 ESC [，正在读取参数
+
+// 软中断编号，编号小的先执行
+#define SOFTIRQ_TIMER   0               // 时钟节拍的下半部
+#define SOFTIRQ_TASKLET 1               // 小任务
+#define SOFTIRQ_COUNT   2
+
+// IO APIC 相关常量
+#define IOAPIC_REGSEL       0x00        // 寄存器选择
+#define IOAPIC_WIN          0x10        // 寄存器窗口
+#define IOAPIC_VER          0x01        // 版本寄存器，16-23 位为最大重定向表项编号
+#define IOAPIC_REDTBL       0x10        // 重定向表起始寄存器
+#define IOAPIC_MASKED       0x10000     // 重定向表项屏蔽位
+#define IOAPIC_LEVEL        0x8000      // 电平触发
+#define IOAPIC_LOW          0x2000      // 低电平有效
+#define IRQ_FLAG_LOW        0x3         // ACPI/MP 中断标志: 低电平有效
+#define IRQ_FLAG_LEVEL      0xc         // ACPI/MP 中断标志: 电平触发
+
+// 可编程间隔定时器 8253/8254 相关常量
+#define PIT_FREQ            1193182     // 输入时钟频率
+#define PIT_CH0             0x40        // 0 号通道数据端口
+#define PIT_CH2             0x42        // 2 号通道数据端口
+#define PIT_CMD             0x43        // 命令端口
+#define PIT_GATE            0x61        // 2 号通道门控与输出端口
+
+// 文件系统标识 "TIFS"
+#define FS_MAGIC			0x53464954
+
+// 读写锁计数中的标记
+#define RW_WRITER			0x80000000      // 写者持有
+#define RW_WAITING			0x40000000      // 写者等待，新的读者不再进入
+
+// 标志寄存器中的中断允许位
+#define EFLAGS_IF			0x200
+
+// 进程状态定义
+#define TASK_UNUSED			0
+#define TASK_READY			1
+#define TASK_BLOCKED		2
+#define TASK_EXITED			3       // 任务已经结束或因异常被终止，不再被调度和唤醒
+#define TASK_WAITING		4       // 实时任务的作业已完成或预算耗尽，等待下一个周期
+
+// 调度策略定义
+#define SCHED_EDF			0       // 最早截止时间优先的实时调度
+#define SCHED_PRIORITY		1       // 优先数调度
+#define SCHED_RR			2       // 轮转调度
+#define SCHED_MLFQ			3       // 多级反馈队列调度
+#define SCHED_CFS			4       // 虚拟运行时间公平调度
+#define SCHED_COUNT			5
+// 实时调度需要任务声明周期和预算，不能作为默认策略
+#if SCHED_POLICY == SCHED_EDF
+#error "SCHED_POLICY 0 (EDF) needs a period and budget declared by each task"
+#endif
+
+// 实时任务当前作业的状态
+#define EDF_DONE			1       // 作业已完成
+#define EDF_MISSED			2       // 作业已错过截止时间
+#define EDF_STARTED			4       // 作业已开始执行，已统计释放到执行的延迟
+
 // 异常定义
 #define	INT_VECTOR_DIVIDE		0x0
 #define	INT_VECTOR_DEBUG		0x1
@@ -239,5 +878,8 @@ typedef struct s_tss {
 #define	INT_VECTOR_PROTECTION	0xD
 #define	INT_VECTOR_PAGE_FAULT	0xE
 #define	INT_VECTOR_COPROC_ERR	0x10
+#define	INT_VECTOR_ALIGN		0x11
+#define	INT_VECTOR_MACHINE		0x12
+#define	INT_VECTOR_SIMD			0x13
 
 #endif
\ No newline at end of file
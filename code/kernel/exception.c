@@ -5,7 +5,6 @@
 
 /* ========================== 保护模式下的中断和异常处理函数 ========================== */
 void DefaultInt();                  // 默认中断处理函数入口
-void ClockInt();                    // 时钟中断处理函数入口
 void DivideError();                 // 除法错误处理函数入口
 void SingleStepException();         // 调试异常处理函数入口
 void Nmi();                         // 非屏蔽中断处理函数入口
@@ -22,167 +21,504 @@ void StackException();              // 堆栈段错误处理函数入口
 void GeneralProtection();           // 常规保护错误处理函数入口
 void PageFault();                   // 页错误处理函数入口
 void CoprError();                   // 浮点错误处理函数入口
+void AlignmentCheck();              // 对齐检查处理函数入口
+void MachineCheck();                // 机器检查处理函数入口
+void SimdException();               // SIMD 浮点异常处理函数入口
 
-// 异常处理函数
-// 所有异常会经入口汇总到这里，本函数向用户显示异常信息，发生位置和相应的错误代码
-static void ExceptionHandler(int id,int err,int eip,int cs,int eflags) {
-    char * ErrorMessages[] = {
-        "#DE Divide Error",
-        "#DB RESERVED",
-        "--- NMI Interrupt",
-        "#BP Breakpoint",
-        "#OF Overflow",
-        "#BR BOUND Range Exceeded",
-        "#UD Invalid Opcode (Undefined Opcode)",
-        "#NM Device Not Available (No Math Coprocessor)",
-        "#DF Double Fault",
-        "--- Coprocessor Segment Overrun (reserved)",
-        "#TS Invalid TSS",
-        "#NP Segment Not Present",
-        "#SS Stack-Segment Fault",
-        "#GP General Protection",
-        "#PF Page Fault",
-        "--- (Intel reserved. Do not use.)",
-        "#MF x87 FPU Floating-Point Error (Math Fault)",
-        "#AC Alignment Check",
-        "#MC Machine Check",
-        "#XF SIMD Floating-Point Exception"
-	};
-    Print("Error Detected! ", F_Red | L_Light);  Print(ErrorMessages[id],  F_Red | L_Light);
-    Print("\n    eip: ",      F_Red | L_Light);  PrintNumber(eip, F_White | L_Light);
-    Print("\n     cs: ",      F_Red | L_Light);  PrintNumber( cs, F_White | L_Light);
-    Print("\n   code: ",      F_Red | L_Light);  PrintNumber(err, F_White | L_Light);
+CrashRecord crashLog[CRASH_LOG_SIZE];   // 崩溃记录，循环使用
+u32         crashCount = 0;             // 记录过的崩溃总数
+u32         strayInts  = 0;             // 没有处理函数的中断次数
+static Spinlock crashLock = {};
+
+static char *errorMessages[] = {
+    "#DE Divide Error",
+    "#DB RESERVED",
+    "--- NMI Interrupt",
+    "#BP Breakpoint",
+    "#OF Overflow",
+    "#BR BOUND Range Exceeded",
+    "#UD Invalid Opcode (Undefined Opcode)",
+    "#NM Device Not Available (No Math Coprocessor)",
+    "#DF Double Fault",
+    "--- Coprocessor Segment Overrun (reserved)",
+    "#TS Invalid TSS",
+    "#NP Segment Not Present",
+    "#SS Stack-Segment Fault",
+    "#GP General Protection",
+    "#PF Page Fault",
+    "--- (Intel reserved. Do not use.)",
+    "#MF x87 FPU Floating-Point Error (Math Fault)",
+    "#AC Alignment Check",
+    "#MC Machine Check",
+    "#XF SIMD Floating-Point Exception"
+};
+
+// 读取页错误的线性地址
+static u32 ReadCr2() {
+    u32 addr;
+    __asm__ __volatile__ ("movl %%cr2, %0" : "=r"(addr));
+    return addr;
+}
+
+// 内核的异常处理函数
+// 内核中发生的异常无法恢复，本函数向用户显示异常信息、发生位置、错误代码和寄存器后停机
+// frame 为异常发生时保存的寄存器，Ring0 中发生的异常没有切换堆栈，frame 中的 esp 和 ss 无效
+void ExceptionHandler(u32 id, u32 err, StackFrame *frame) {
+    Print("Error Detected! ", F_Red | L_Light);  Print(id < 20 ? errorMessages[id] : "", F_Red | L_Light);
+    Print("\n    eip: ",      F_Red | L_Light);  PrintNumber(frame->eip, F_White | L_Light);
+    Print("\n     cs: ",      F_Red | L_Light);  PrintNumber(frame->cs,  F_White | L_Light);
+    Print("\n   code: ",      F_Red | L_Light);  PrintNumber(err,        F_White | L_Light);
+    Print("\n    cr2: ",      F_Red | L_Light);  PrintNumber(ReadCr2(),  F_White | L_Light);
+    Print("\n    eax: ",      F_Red | L_Light);  PrintNumber(frame->eax, F_White | L_Light);
+    Print(" ebx: ",           F_Red | L_Light);  PrintNumber(frame->ebx, F_White | L_Light);
+    Print(" ecx: ",           F_Red | L_Light);  PrintNumber(frame->ecx, F_White | L_Light);
+    Print(" edx: ",           F_Red | L_Light);  PrintNumber(frame->edx, F_White | L_Light);
+    Print("\n    esi: ",      F_Red | L_Light);  PrintNumber(frame->esi, F_White | L_Light);
+    Print(" edi: ",           F_Red | L_Light);  PrintNumber(frame->edi, F_White | L_Light);
+    Print(" ebp: ",           F_Red | L_Light);  PrintNumber(frame->ebp, F_White | L_Light);
+    Print(" esp: ",           F_Red | L_Light);  PrintNumber(frame->espKernel, F_White | L_Light);
+    while (1)
+        __asm__ __volatile__ ("cli\nhlt\n");
+}
+
+// 任务的异常处理函数，在中断的公共处理流程中调用，err 为错误码
+// 文件映射的缺页和写时复制由 MmFault 处理；其余 Ring3 任务的异常在崩溃记录中保存现场后结束该任务，
+// 释放任务的文件映射，其他任务继续执行。内核线程(Ring1)的异常、双重错误、NMI 和机器检查仍然停机
+static void TaskFault(PCB *pcb, u32 id, u32 err) {
+    u32 addr = ReadCr2();
+    if (id == INT_VECTOR_PAGE_FAULT && MmFault(pcb, addr, err))
+        return;
+    if ((pcb->regs.cs & SA_RPL3) != SA_RPL3 || id == INT_VECTOR_NMI
+        || id == INT_VECTOR_DOUBLE_FAULT || id == INT_VECTOR_MACHINE)
+        ExceptionHandler(id, err, &pcb->regs);
+    SpinLock(&crashLock);
+    CrashRecord *record = &crashLog[crashCount++ % CRASH_LOG_SIZE];
+    record->pid    = pcb->pid;
+    record->vector = id;
+    record->err    = err;
+    record->cr2    = id == INT_VECTOR_PAGE_FAULT ? addr : 0;
+    record->tick   = GetTicks();
+    record->regs   = pcb->regs;
+    SpinUnlock(&crashLock);
+    Print("[KERNEL] Error: Task ", F_Red | L_Light);
+    PrintDecimal(pcb->pid, F_Red | L_Light);
+    Print(" killed by ", F_Red | L_Light);
+    Print(id < 20 ? errorMessages[id] : "", F_Red | L_Light);
+    Print(" eip ", F_Red | L_Light);
+    PrintNumber(pcb->regs.eip, F_Red | L_Light);
+    if (id == INT_VECTOR_PAGE_FAULT) {
+        Print(" addr ", F_Red | L_Light);
+        PrintNumber(addr, F_Red | L_Light);
+    }
+    Print("\n", F_Red | L_Light);
+    MmRelease(pcb);
+    SchedExit(pcb);
 }
 
 // 异常处理函数的入口定义
+// 没有错误码的异常先压入 0xffffffff 占位，随后压入异常编号，转到公共的入口 exception
+#define EXCEPTION_ENTRY(name, id)   \
+    #name ":\n"                     \
+    "pushl $0xffffffff\n"           \
+    "pushl $" #id "\n"              \
+    "jmp  exception\n"
+#define EXCEPTION_ENTRY_ERR(name, id) \
+    #name ":\n"                     \
+    "pushl $" #id "\n"              \
+    "jmp  exception\n"
+
 asm (
-"DivideError:\n"
-	"push	$0xffffffff\n"
-	"push	$0\n"
-	"jmp	exception\n"
-"SingleStepException:\n"
-	"push	$0xffffffff\n"
-	"push	$1\n"
-	"jmp	exception\n"
-"Nmi:"
-	"push	$0xffffffff\n"
-	"push	$2\n"
-	"jmp	exception\n"
-"BreakpointException:\n"
-	"push	$0xffffffff\n"
-	"push	$3\n"
-	"jmp	exception\n"
-"Overflow:\n"
-	"push	$0xffffffff\n"
-	"push	$4\n"
-	"jmp	exception\n"
-"BoundsCheck:"
-	"push	$0xffffffff\n"
-	"push	$5\n"
-	"jmp	exception\n"
-"InvalOpcode:"
-	"push	$0xffffffff\n"
-	"push	$6\n"
-	"jmp	exception\n"
-"CoprNotAvailable:\n"
-	"push	$0xffffffff\n"
-	"push	$7\n"
-	"jmp	exception\n"
-"DoubleFault:\n"
-	"push	$8\n"
-	"jmp	exception\n"
-"CoprsegOverrun:\n"
-	"push	$0xffffffff\n"
-	"push	$9\n"
-	"jmp	exception\n"
-"InvalTss:\n"
-	"push	$10\n"
-	"jmp	exception\n"
-"SegmentNotPresent:\n"
-	"push	$11\n"
-	"jmp	exception\n"
-"StackException:\n"
-	"push	$12\n"
-	"jmp	exception\n"
-"GeneralProtection:\n"
-	"push	$13\n"
-	"jmp	exception\n"
-"PageFault:\n"
-	"push	$14\n"
-	"jmp	exception\n"
-"CoprError:\n"
-	"push	$0xffffffff\n"
-	"push	$16\n"
-	"jmp	exception\n"
+    EXCEPTION_ENTRY(DivideError, 0)
+    EXCEPTION_ENTRY(SingleStepException, 1)
+    EXCEPTION_ENTRY(Nmi, 2)
+    EXCEPTION_ENTRY(BreakpointException, 3)
+    EXCEPTION_ENTRY(Overflow, 4)
+    EXCEPTION_ENTRY(BoundsCheck, 5)
+    EXCEPTION_ENTRY(InvalOpcode, 6)
+    EXCEPTION_ENTRY(CoprNotAvailable, 7)
+    EXCEPTION_ENTRY_ERR(DoubleFault, 8)
+    EXCEPTION_ENTRY(CoprsegOverrun, 9)
+    EXCEPTION_ENTRY_ERR(InvalTss, 10)
+    EXCEPTION_ENTRY_ERR(SegmentNotPresent, 11)
+    EXCEPTION_ENTRY_ERR(StackException, 12)
+    EXCEPTION_ENTRY_ERR(GeneralProtection, 13)
+    EXCEPTION_ENTRY_ERR(PageFault, 14)
+    EXCEPTION_ENTRY(CoprError, 16)
+    EXCEPTION_ENTRY_ERR(AlignmentCheck, 17)
+    EXCEPTION_ENTRY(MachineCheck, 18)
+    EXCEPTION_ENTRY(SimdException, 19)
+
+// 异常的公共入口，此时栈顶依次为异常编号和错误码，正好占据栈帧中 ecx 和 eax 的位置，
+// 与 ecx eax 交换后保存其余寄存器，得到与中断相同的栈帧，此时 ecx 为异常编号，eax 为错误码
+// 任务(Ring1/3)的异常转到中断的公共处理流程，ebx 为 IRQ_EXCEPTION 加异常编号，ecx 为错误码；
+// Ring0 的异常是内核的错误，以栈帧调用 ExceptionHandler 后停机
+// 被打断的代码(例如反向复制的 memmove)可能设置了方向标志，进入 C 代码前清除，iret 时从栈帧恢复
 "exception:\n"
-	"call	ExceptionHandler\n"
-	"addl	$0x8, %esp\n"
-	"hlt\n"
+    "xchgl %ecx, (%esp)\n"
+    "xchgl %eax, 4(%esp)\n"
+    "pushl %edx\n"
+    "pushl %ebx\n"
+    "pushl %esp\n"
+    "pushl %ebp\n"
+    "pushl %esi\n"
+    "pushl %edi\n"
+    "push %ds\n"
+    "push %es\n"
+    "push %fs\n"
+    "push %gs\n"
+    "cld\n"
+    "testl $3, 52(%esp)\n"     // 被打断代码的 cs
+    "jz   1f\n"
+    "leal 0xc0(%ecx), %ebx\n"  // IRQ_EXCEPTION
+    "movl %eax, %ecx\n"
+    "jmp  IrqCommon\n"
+    "1:\n"
+    "movw %ss, %dx\n"
+    "movw %dx, %ds\n"
+    "movw %dx, %es\n"
+    "movl %esp, %edx\n"
+    "pushl %edx\n"
+    "pushl %eax\n"
+    "pushl %ecx\n"
+    "call ExceptionHandler\n"
 );
 
-/* ========================== 8259A外部中断处理函数 ========================== */
+/* ========================== 外部中断处理函数 ========================== */
 static int flag    =  1;    // 时钟中断处理函数的计数标记，奇数次为1，偶数次为0
-static int reEnter = -1;    // 时钟中断处理函数的重入标记，在处理函数中为0，不在为-1
+int reEnter[256];           // 按 APIC 编号索引的中断重入计数，不在中断处理中为 -1，在中断处理的外层为 0
+
+static IrqHandler irqHandlers[IRQ_COUNT];  // 各中断的上半部处理函数
+static u32        tickCycles = 0;          // 一个时钟节拍的时间戳计数器周期数，没有校准时为 0
+#ifdef IRQ_STAT
+static IrqStat    irqStats[MAX_CPUS][IRQ_COUNT];   // 各处理器上每个中断的上半部统计
+#endif
+
+// 各中断的优先级，有 IO APIC 时决定中断向量；只有 8259A 时由芯片按 0 1 8 -> 15 3 -> 7 的固定顺序决定
+static u8 irqPriority[IRQ_COUNT] = {
+    IRQ_PRIO_CLOCK,  IRQ_PRIO_HIGH,   IRQ_PRIO_LOW,    IRQ_PRIO_HIGH,     // PIT 键盘 级联 COM2
+    IRQ_PRIO_HIGH,   IRQ_PRIO_NORMAL, IRQ_PRIO_NORMAL, IRQ_PRIO_LOW,      // COM1 LPT2 软驱 LPT1
+    IRQ_PRIO_CLOCK,  IRQ_PRIO_NORMAL, IRQ_PRIO_NORMAL, IRQ_PRIO_NORMAL,   // RTC
+    IRQ_PRIO_HIGH,   IRQ_PRIO_LOW,    IRQ_PRIO_NORMAL, IRQ_PRIO_NORMAL,   // 鼠标 协处理器 硬盘
+    IRQ_PRIO_CLOCK,                                                       // 本地 APIC 定时器
+};
 
-void DefaultInt();          // 除时钟中断外的其余处理函数
-void ClockInt();            // 时钟中断处理函数入口
+void DefaultInt();          // 除外部中断外的其余处理函数
+void SpuriousInt();         // 本地 APIC 伪中断处理函数入口
+void YieldInt();            // 内核线程让出处理器的中断入口
+void SyscallInt();          // 系统调用的中断入口
+void Irq0(), Irq1(), Irq2(), Irq3(), Irq4(), Irq5(), Irq6(), Irq7();
+void Irq8(), Irq9(), Irq10(), Irq11(), Irq12(), Irq13(), Irq14(), Irq15();
+void ApicTimerInt();        // 本地 APIC 定时器中断处理函数入口
 
-extern void restart();      // 导入重启进程的函数
-extern void choose();       // 导入进程调度函数
+// 各 ISA 中断的入口
+static void (*irqEntry[16])() = {
+    Irq0, Irq1, Irq2,  Irq3,  Irq4,  Irq5,  Irq6,  Irq7,
+    Irq8, Irq9, Irq10, Irq11, Irq12, Irq13, Irq14, Irq15,
+};
 
-// 时钟中断处理函数
-static void ClockIntHandler() {
-    // 设置重入标记
-    reEnter = -1;
+// 登记中断 irq 的上半部处理函数，返回原来的处理函数
+IrqHandler IrqRegister(u32 irq, IrqHandler handler) {
+    IrqHandler old = irqHandlers[irq];
+    irqHandlers[irq] = handler;
+    return old;
+}
+
+// IO APIC 发送 ISA 中断 irq 使用的向量，本地 APIC 只在向量高 4 位更大时允许中断打断正在处理的中断
+static u32 IrqVector(u32 irq) {
+    return INT_VECTOR_IOAPIC + irqPriority[irq] * 0x10 + irq;
+}
+
+#ifdef IRQ_STAT
+// 统计中断 irq 的一次上半部，start 为开始的时间戳，hidden 为开始时已完成的上半部的累计时间
+// 期间完成的嵌套中断的时间从本次处理时间中扣除
+static void IrqAccount(CPU *cpu, u32 irq, u64 start, u64 hidden) {
+    u64 spent = ReadTsc() - start;
+    u32 own   = (u32)(spent - (cpu->irqCycles - hidden));
+    cpu->irqCycles = hidden + spent;
+    IrqStat *stat = &irqStats[cpu->id][irq];
+    stat->count++;
+    stat->cycles += own;
+    if (own > stat->maxCycles)
+        stat->maxCycles = own;
+}
+#endif
+
+// 中断的上半部，调用处理函数并响应中断
+// 时钟级以下的处理函数开中断执行，中断控制器在响应之前不会送来同级和更低级的中断
+static void IrqTopHalf(u32 irq) {
+    if (irq >= IRQ_COUNT)
+        return;
+    CPU *cpu = ThisCpu();
+#ifdef IRQ_STAT
+    u64 start = ReadTsc(), hidden = cpu->irqCycles;
+#endif
+    if (irqHandlers[irq] && irqPriority[irq] < IRQ_PRIO_CLOCK) {
+        IrqOffEnd(cpu);
+        __asm__ __volatile__ ("sti" ::: "memory");
+        irqHandlers[irq](irq);
+        __asm__ __volatile__ ("cli" ::: "memory");
+        IrqOffBegin(cpu);
+    } else if (irqHandlers[irq]) {
+        irqHandlers[irq](irq);
+    }
+    IrqEoi(irq);
+#ifdef IRQ_STAT
+    IrqAccount(cpu, irq, start, hidden);
+#endif
+}
+
+// 嵌套中断的处理函数，frame 为被打断的内核代码保存的寄存器
+// 下半部或开中断的上半部执行时到来的中断只执行上半部，随后返回被打断的代码
+void IrqNested(u32 irq, StackFrame *frame) {
+    CPU *cpu = ThisCpu();
+#ifdef IRQ_STAT
+    if (reEnter[cpu->apicId] > cpu->irqDepthMax)
+        cpu->irqDepthMax = reEnter[cpu->apicId];
+#endif
+    StackFrame *outer = cpu->irqFrame;
+    cpu->irqFrame = frame;
+    IrqTopHalf(irq);
+    cpu->irqFrame = outer;
+}
+
+// 中断处理函数，err 为任务异常的错误码
+// 执行上半部后开中断执行下半部，最后重新调度，不会返回
+void IrqDispatch(u32 irq, u32 err) {
+    CPU *cpu = ThisCpu();
+    IrqOffBegin(cpu);
+    // 外层中断打断的是任务(寄存器保存在进程表中)或空闲的处理器
+    cpu->irqFrame = cpu->readyPid != -1 ? &process[cpu->readyPid].regs : 0;
+    if (irq == IRQ_SYSCALL)
+        Syscall(&process[cpu->readyPid]);
+    else if (irq >= IRQ_EXCEPTION && irq < IRQ_EXCEPTION + EXCEPTION_COUNT)
+        TaskFault(&process[cpu->readyPid], irq - IRQ_EXCEPTION, err);
+    else
+        IrqTopHalf(irq);
+    RunSoftirqs(cpu);
+    // 调度进程，按上一次调度以来经过的时钟节拍数消耗当前任务的时间片
+    SpinLock(&schedLock);
+    choose(cpu->ticked);
+    cpu->ticked = 0;
+    reEnter[cpu->apicId] = -1;
+    restart();
+}
+
+// 内核线程让出处理器，线程被唤醒后从此处返回
+void Yield() {
+    __asm__ __volatile__ ("int %0" :: "i"(INT_VECTOR_YIELD) : "memory");
+}
+
+// 返回上一次时钟中断以来经过的节拍数
+// 关中断过久时定时器只保留一次待处理的中断，晚到整数个周期时把错过的节拍补上，保持时间基准和时间片准确
+static u32 TimerElapsed(CPU *cpu) {
+    u64 now  = ReadTsc();
+    u64 last = cpu->tickTsc;
+    cpu->tickTsc = now;
+    if (!tickCycles || !last || cpu->oneShot)
+        return 1;
+    u64 elapsed = now - last;
+    if (elapsed < tickCycles + tickCycles / TICK_LATE_DIV)
+        return 1;
+    cpu->lateTicks++;
+    u32 n = Div64(elapsed + tickCycles / 2, tickCycles);
+    if (n <= 1)
+        return 1;
+    cpu->lostTicks += n - 1;
+    return n;
+}
+
+// 时钟中断的上半部，启动处理器负责计数并释放实时任务的作业
+// 经过的节拍记到当前任务上: 打断的是 Ring3 代码时为用户态时间，否则为内核为该任务执行的时间
+static void TimerTopHalf(u32 irq) {
+    CPU *cpu = ThisCpu();
+    u32 n = TimerElapsed(cpu);
+    cpu->ticked += n;
+    if (cpu->readyPid != -1) {
+        Rusage *usage = &process[cpu->readyPid].usage;
+        if (cpu->irqFrame && (cpu->irqFrame->cs & SA_RPL3) == SA_RPL3)
+            usage->userTicks += n;
+        else
+            usage->kernelTicks += n;
+    }
+    if (cpu->id == 0) {
+        WriteSeqLock(&tickLock);
+        ticks += n;
+        WriteSeqUnlock(&tickLock);
+        SchedRelease((u32)ticks);
+        RaiseSoftirq(SOFTIRQ_TIMER);
+    }
+}
+
+// 时钟中断的下半部
+static void TimerSoftirq() {
     // 显示时钟中断标记，与主逻辑无关,用于确认时钟正常工作
     flag = 1 - flag;
     if (flag)
         PrintAtPos("TIMER", F_Cyan | B_Cyan | L_Light, 0, 75);
     else
         PrintAtPos("TIMER", F_Brown | B_Brown | L_Light, 0, 75);
-    // 调度进程
-    choose();
-    restart();
+    if ((u32)GetTicks() % EDF_REPORT_PERIOD == 0)
+        EdfReport();
+    MmFlushTick((u32)GetTicks());
+#ifdef VBE
+    if ((u32)GetTicks() % FB_PERIOD == 0)
+        FbFlush();
+#endif
+#ifdef PROFILE
+    if ((u32)GetTicks() % PROF_DUMP_PERIOD == 0)
+        ProfileFlush();
+#endif
+#ifdef IRQ_STAT
+    if ((u32)GetTicks() % LOCK_STAT_PERIOD == 0) {
+        IrqStatDump(23);
+        KeyboardStatDump(24);
+        IrqReport();
+    }
+#endif
+#ifdef LOCK_STAT
+    if ((u32)GetTicks() % LOCK_STAT_PERIOD == 0)
+        LockStatDump(18);
+#endif
+#ifdef TOP
+    if ((u32)GetTicks() % TOP_PERIOD == 0)
+        TopDump();
+#endif
+}
+
+// 读取时钟中断计数，64 位的计数无法一次读出，使用顺序锁保证读到一致的值
+u64 GetTicks() {
+    u64 value;
+    u32 seq;
+    do {
+        seq   = ReadSeqBegin(&tickLock);
+        value = ticks;
+    } while (ReadSeqRetry(&tickLock, seq));
+    return value;
 }
 
+#ifdef IRQ_STAT
+// 将中断统计写到串口，时间为微秒，由时钟中断的下半部每 LOCK_STAT_PERIOD 个节拍调用:
+//     IRQ cpu 处理器编号 depth_max 最大嵌套深度 late 迟到的时钟中断数 lost 补上的节拍数
+//     IRQ irq 中断编号 cpu 处理器编号 count 次数 avg_us 平均时间 max_us 最长时间
+void IrqReport() {
+    u32 perUs = tscPerMs / 1000;
+    for (u32 i = 0; i < cpuCount; i++) {
+        SerialPrint("IRQ cpu ");        SerialPrintDecimal(i);
+        SerialPrint(" depth_max ");     SerialPrintDecimal(cpus[i].irqDepthMax);
+        SerialPrint(" late ");          SerialPrintDecimal(cpus[i].lateTicks);
+        SerialPrint(" lost ");          SerialPrintDecimal(cpus[i].lostTicks);
+        SerialPrint("\n");
+        for (u32 irq = 0; irq < IRQ_COUNT; irq++) {
+            IrqStat *stat = &irqStats[i][irq];
+            if (!stat->count)
+                continue;
+            SerialPrint("IRQ irq ");    SerialPrintDecimal(irq);
+            SerialPrint(" cpu ");       SerialPrintDecimal(i);
+            SerialPrint(" count ");     SerialPrintDecimal(stat->count);
+            SerialPrint(" avg_us ");    SerialPrintDecimal(perUs ? Div64(stat->cycles, stat->count) / perUs : 0);
+            SerialPrint(" max_us ");    SerialPrintDecimal(perUs ? stat->maxCycles / perUs : 0);
+            SerialPrint("\n");
+        }
+    }
+}
+#endif
+
 // 外部中断处理函数的入口定义
+// 每个入口保存寄存器后把中断编号放入 ebx，转到公共的处理流程
+#define IRQ_ENTRY(name, irq)    \
+    #name ":\n"                 \
+    "cli\n"                     \
+    "pushal\n"                  \
+    "push %ds\n"                \
+    "push %es\n"                \
+    "push %fs\n"                \
+    "push %gs\n"                \
+    "movl $" #irq ", %ebx\n"    \
+    "jmp  IrqCommon\n"
+
 asm (
-"ClockInt:\n"
-    "cli\n"                     // 保存寄存器的值
-    "pushal\n"
-    "push %ds\n"
-    "push %es\n"
-    "push %fs\n"
-    "push %gs\n"
+    IRQ_ENTRY(Irq0,  0)
+    IRQ_ENTRY(Irq1,  1)
+    IRQ_ENTRY(Irq2,  2)
+    IRQ_ENTRY(Irq3,  3)
+    IRQ_ENTRY(Irq4,  4)
+    IRQ_ENTRY(Irq5,  5)
+    IRQ_ENTRY(Irq6,  6)
+    IRQ_ENTRY(Irq7,  7)
+    IRQ_ENTRY(Irq8,  8)
+    IRQ_ENTRY(Irq9,  9)
+    IRQ_ENTRY(Irq10, 10)
+    IRQ_ENTRY(Irq11, 11)
+    IRQ_ENTRY(Irq12, 12)
+    IRQ_ENTRY(Irq13, 13)
+    IRQ_ENTRY(Irq14, 14)
+    IRQ_ENTRY(Irq15, 15)
+    IRQ_ENTRY(ApicTimerInt, 16)     // IRQ_LAPIC_TIMER
+    IRQ_ENTRY(YieldInt, 0xff)       // IRQ_NONE
+    IRQ_ENTRY(SyscallInt, 0xfe)     // IRQ_SYSCALL
 
+"IrqCommon:\n"
+    "cld\n"                     // C 代码要求方向标志为 0，被打断代码的标志由 iret 恢复
     "movw %ss, %dx\n"           // 修改选择子
     "movw %dx, %ds\n"
     "movw %dx, %es\n"
 
-    "movb $0x20, %al\n"         // 响应下一个中断
-	"outb %al, $0x20\n"
+    "movl lapicBase, %eax\n"    // 取得当前处理器的 APIC 编号
+    "testl %eax, %eax\n"
+    "jz   1f\n"
+    "movl 0x20(%eax), %eax\n"
+    "shrl $24, %eax\n"
+    "1:\n"
 
-    "incl reEnter\n"            // 判断中断是否是重入
-    "cmpl $0, reEnter\n"
+    "incl reEnter(,%eax,4)\n"   // 判断中断是否是重入
+    "cmpl $0, reEnter(,%eax,4)\n"
     "jne  ReEnter\n"
 
     // 正常的中断处理
-    "movl $0x7fff, %esp\n"      // 切换到内核栈空间
-    "call ClockIntHandler\n"    // 调用中断处理函数，函数完成中断返回
-	
-    // 重入中断时的处理
+    "movl kernelStack(,%eax,4), %esp\n"    // 切换到本处理器的内核栈空间
+    "pushl %ecx\n"             // 任务异常的错误码
+    "pushl %ebx\n"
+    "call IrqDispatch\n"        // 调用中断处理函数，函数完成中断返回
+
+    // 重入中断时的处理，栈顶的寄存器作为参数 frame，第一层嵌套切换到本处理器的中断栈，
+    // 更深的嵌套已经在中断栈上，执行上半部后回到被打断代码的栈返回
     "ReEnter:\n"
-    "decl reEnter\n"
+    "movl %esp, %edx\n"
+    "cmpl $1, reEnter(,%eax,4)\n"
+    "jne  2f\n"
+    "movl irqStack(,%eax,4), %esp\n"
+    "2:\n"
+    "pushl %edx\n"             // 被打断代码的栈顶
+    "pushl %eax\n"
+    "pushl %edx\n"
+    "pushl %ebx\n"
+    "call IrqNested\n"
+    "addl $8, %esp\n"
+    "popl %eax\n"
+    "popl %esp\n"
+    "decl reEnter(,%eax,4)\n"
     "pop %gs\n"                 // 还原寄存器的值
     "pop %fs\n"
     "pop %es\n"
     "pop %ds\n"
     "popal\n"
-    "sti\n"
     "iretl\n"                   // 返回
 
+"SpuriousInt:\n"
+    "iretl\n"
+
+// 没有处理函数的中断计数后返回；有本地 APIC 时写中断结束寄存器(LAPIC_EOI)，
+// 否则本地 APIC 或 IO APIC 送来的中断在服务寄存器中的位不会清除，同级和更低优先级的中断不再送达
 "DefaultInt:\n"
-    "hlt\n"
+    "pushl %eax\n"
+    "movl lapicBase, %eax\n"
+    "testl %eax, %eax\n"
+    "jz   1f\n"
+    "movl $0, 0xb0(%eax)\n"
+    "1:\n"
+    "popl %eax\n"
+    "incl strayInts\n"
+    "iretl\n"
 );
 
 /* ========================== 设置 8259A ========================== */
@@ -202,10 +538,88 @@ static void Init8259A() {
     OutByte(INT_M_CTLMASK, 0x1);
     OutByte(INT_S_CTLMASK, 0x1);
     // 写入 OCW 选择屏蔽中断
-    OutByte(INT_M_CTLMASK, 0xfe);       // 此处只打开了时钟中断
+    OutByte(INT_M_CTLMASK, 0xff);       // 此处屏蔽全部中断，由 IrqEnable 按需打开
     OutByte(INT_S_CTLMASK, 0xff);
 }
 
+/* ========================== 外部中断的路由 ========================== */
+// 打开 ISA 中断 irq，有 IO APIC 时发送给 cpu 号处理器，否则通过 8259A 发送给启动处理器
+void IrqEnable(u32 irq, u32 cpu) {
+    if (ioapicBase) {
+        IoapicRoute(irq, IrqVector(irq), cpus[cpu].apicId);
+    } else if (irq < 8) {
+        OutByte(INT_M_CTLMASK, InByte(INT_M_CTLMASK) & ~(1 << irq));
+    } else {
+        OutByte(INT_M_CTLMASK, InByte(INT_M_CTLMASK) & ~(1 << 2));
+        OutByte(INT_S_CTLMASK, InByte(INT_S_CTLMASK) & ~(1 << (irq - 8)));
+    }
+}
+
+// 屏蔽 ISA 中断 irq
+void IrqDisable(u32 irq) {
+    if (ioapicBase)
+        IoapicMask(irq);
+    else if (irq < 8)
+        OutByte(INT_M_CTLMASK, InByte(INT_M_CTLMASK) | (1 << irq));
+    else
+        OutByte(INT_S_CTLMASK, InByte(INT_S_CTLMASK) | (1 << (irq - 8)));
+}
+
+// 响应中断 irq，本地定时器和有 IO APIC 时写本地 APIC 的 EOI 寄存器，否则写 8259A
+void IrqEoi(u32 irq) {
+    if (irq == IRQ_LAPIC_TIMER || ioapicBase) {
+        LapicEoi();
+        return;
+    }
+    if (irq >= 8)
+        OutByte(INT_S_CTL, 0x20);
+    OutByte(INT_M_CTL, 0x20);
+}
+
+/* ========================== 时钟设置 ========================== */
+// 设置 PIT 0 号通道为频率 hz 的周期模式
+void PitInit(u32 hz) {
+    u32 divisor = PIT_FREQ / hz;
+    OutByte(PIT_CMD, 0x34);
+    OutByte(PIT_CH0, divisor & 0xff);
+    OutByte(PIT_CH0, (divisor >> 8) & 0xff);
+}
+
+// 使用 PIT 2 号通道等待 ms 毫秒(不超过 54 毫秒)，不需要中断
+void PitWaitMs(u32 ms) {
+    u32 count = PIT_FREQ / 1000 * ms;
+    // 打开 2 号通道的门控，关闭扬声器
+    OutByte(PIT_GATE, (InByte(PIT_GATE) & ~0x02) | 0x01);
+    // 2 号通道设置为计数结束时输出高电平的模式
+    OutByte(PIT_CMD, 0xb0);
+    OutByte(PIT_CH2, count & 0xff);
+    OutByte(PIT_CH2, (count >> 8) & 0xff);
+    // 重新触发门控开始计数，等待输出变为高电平
+    u8 gate = InByte(PIT_GATE) & ~0x01;
+    OutByte(PIT_GATE, gate);
+    OutByte(PIT_GATE, gate | 0x01);
+    while (!(InByte(PIT_GATE) & 0x20)) ;
+}
+
+// 时钟初始化函数
+// 有本地 APIC 时校准本地定时器，作为所有处理器的时钟，否则使用 8259A 上的 PIT 作为时钟
+void TimerInit() {
+    if (lapicBase) {
+        LapicCalibrate();
+        LapicTimerPeriodic(TIMER_HZ);
+        tickCycles = Div64((u64)tscPerMs * 1000, TIMER_HZ);
+        Print("[KERNEL] Local APIC Timer ", F_Cyan | L_Light);
+        PrintDecimal(lapicTicksPerMs, F_White | L_Light);
+        Print(" Ticks/ms, TSC ", F_White);
+        PrintDecimal(tscPerMs, F_White | L_Light);
+        Print(" Cycles/ms\n", F_White);
+    } else {
+        PitInit(TIMER_HZ);
+        IrqEnable(0, 0);
+        Print("[KERNEL] 8259A PIT Timer\n", F_Cyan | L_Light);
+    }
+}
+
 /* ========================== 中断设置函数 ========================== */
 extern u8   idtPtr[6];             // 中断向量表指针
 extern Gate idt[IDT_SIZE];         // 中断向量表格
@@ -213,8 +627,17 @@ extern Gate idt[IDT_SIZE];         // 中断向量表格
 // 设置中断向量表的函数
 void SetupIdt() {
     Print("[KERNEL] Setup IDT\n", F_Cyan | L_Light);
-    // 初始化 8259A 芯片
+    // 初始化 8259A 芯片，有 IO APIC 时 8259A 保持屏蔽，外部中断由 IO APIC 发送
     Init8259A();
+    if (ioapicBase)
+        IoapicInit();
+    for (int i = 0; i < 256; i++)
+        reEnter[i] = -1;
+    SpinInit(&crashLock, "crash");
+    // 登记时钟中断的上半部和下半部
+    IrqRegister(0, TimerTopHalf);
+    IrqRegister(IRQ_LAPIC_TIMER, TimerTopHalf);
+    SoftirqRegister(SOFTIRQ_TIMER, TimerSoftirq);
 
     // 初始化 idt 所有中断统一用 DefaultInt
     for (int i = 0; i < IDT_SIZE; i++) 
@@ -253,10 +676,31 @@ void SetupIdt() {
                 (u32)PageFault, 0,             DA_386IGate);
     SetIdtEntry(&idt[INT_VECTOR_COPROC_ERR],   SELECTOR_FLAT_C, 
                 (u32)CoprError, 0,             DA_386IGate);
+    SetIdtEntry(&idt[INT_VECTOR_ALIGN],        SELECTOR_FLAT_C, 
+                (u32)AlignmentCheck, 0,        DA_386IGate);
+    SetIdtEntry(&idt[INT_VECTOR_MACHINE],      SELECTOR_FLAT_C, 
+                (u32)MachineCheck, 0,          DA_386IGate);
+    SetIdtEntry(&idt[INT_VECTOR_SIMD],         SELECTOR_FLAT_C, 
+                (u32)SimdException, 0,         DA_386IGate);
 
-    // 设置时钟中断的中断向量
-    SetIdtEntry(&idt[0x20],                    SELECTOR_FLAT_C, 
-                (u32)ClockInt, 0,              DA_386IGate);
+    // 设置外部中断的中断向量
+    // 8259A 使用固定的向量，IO APIC 按优先级使用另一组向量
+    for (int i = 0; i < 16; i++) {
+        SetIdtEntry(&idt[INT_VECTOR_IRQ0 + i], SELECTOR_FLAT_C,
+                    (u32)irqEntry[i], 0,       DA_386IGate);
+        SetIdtEntry(&idt[IrqVector(i)],        SELECTOR_FLAT_C,
+                    (u32)irqEntry[i], 0,       DA_386IGate);
+    }
+    SetIdtEntry(&idt[INT_VECTOR_APIC_TIMER],   SELECTOR_FLAT_C, 
+                (u32)ApicTimerInt, 0,          DA_386IGate);
+    // 内核线程在 Ring1 中使用的让出处理器的中断
+    SetIdtEntry(&idt[INT_VECTOR_YIELD],        SELECTOR_FLAT_C, 
+                (u32)YieldInt, 0,              DA_386IGate | DA_DPL1);
+    // 用户任务使用的系统调用中断
+    SetIdtEntry(&idt[INT_VECTOR_SYSCALL],      SELECTOR_FLAT_C, 
+                (u32)SyscallInt, 0,            DA_386IGate | DA_DPL3);
+    SetIdtEntry(&idt[INT_VECTOR_SPURIOUS],     SELECTOR_FLAT_C, 
+                (u32)SpuriousInt, 0,           DA_386IGate);
     
     // 加载 idt
     u16* pIdtLimit = (u16*)(&idtPtr[0]);
@@ -0,0 +1,269 @@
+//  fb.c         by OrangeYYC
+//  TinyOS 帧缓冲控制台与合成器
+//
+//  使用 make VBE=1 构建时启用。实模式部分(kernel16.c)设置 VBE 线性帧缓冲的 32 位色图形模式，
+//  内核的输出和每个任务的控制台各有一个离屏表面: CONSOLE_COLS x CONSOLE_ROWS 个字符，按 BIOS 的 8x16 字模
+//  画成 32 位像素。写入字符时只画到表面上并扩大表面的脏矩形，合成器每 FB_PERIOD 个节拍由工作队列线程执行一次，
+//  把各表面的脏矩形复制到屏幕上对应的窗口，没有变化的部分不复制。
+//  屏幕按表面的大小划分为网格并居中，内核的表面在第一个窗口，pid 为 n 的任务在第 n + 1 个窗口，放不下的任务不显示。
+//  帧缓冲在处理器支持 PAT 时映射为写合并(WC)，否则不使用缓存；复制一行像素按处理器特性使用 rep movsd 或
+//  SSE2 的 movntdq，SSE 寄存器只在关中断状态下使用。合成的帧数和复制速度每 FB_REPORT_PERIOD 个节拍写到串口:
+//      FB frames 帧数 kbytes 复制的千字节数 us_per_frame 每帧的微秒数 mbps 复制速度(MB/s)
+
+#include "common.h"
+
+#ifdef VBE
+static Surface   surfaces[FB_KERNEL + 1];       // 每个任务和内核的离屏表面
+static u16       earlyCells[CONSOLE_ROWS * CONSOLE_COLS];   // 内核表面分配之前的输出
+static u8       *font       = 0;                // 8x16 字模，每个字符 16 字节
+static Spinlock  fbLock     = {};               // 保护各表面的脏矩形
+static Work      fbWork     = {};               // 合成一帧的工作
+static u32       fbReady    = 0;                // 表面和帧缓冲是否已经映射
+static u32       fbFrames   = 0;                // 统计周期内复制过像素的帧数
+static u64       fbBytes    = 0;                // 统计周期内复制的字节数
+static u64       fbCycles   = 0;                // 统计周期内合成使用的周期数
+static u64       fbReportTick = 0;              // 上一次输出统计信息的节拍
+
+// 显存颜色编号对应的 RGB 颜色(VGA 的默认调色板)
+static u32 palette[16] = {
+    0x000000, 0x0000aa, 0x00aa00, 0x00aaaa, 0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+    0x555555, 0x5555ff, 0x55ff55, 0x55ffff, 0xff5555, 0xff55ff, 0xffff55, 0xffffff,
+};
+
+/* ========================== 复制一行像素 ========================== */
+// 使用 rep movsd 按 4 字节复制
+static void BlitMovsd(void *dst, const void *src, u32 n) {
+    u32 d0, d1, d2;
+    __asm__ __volatile__ (
+        "rep movsl\n"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n >> 2), "1"(dst), "2"(src)
+        : "memory"
+    );
+}
+
+// 使用 SSE2 的 movntdq 复制，每次循环 32 字节，写入不经过缓存，在写合并的帧缓冲上合并为整行的总线写入
+static void BlitMovntdq(void *dst, const void *src, u32 n) {
+    u32 count = n / 32;
+    __asm__ __volatile__ (
+        "1:\n"
+        "movdqa  (%1), %%xmm0\n"
+        "movdqa  16(%1), %%xmm1\n"
+        "movntdq %%xmm0, (%0)\n"
+        "movntdq %%xmm1, 16(%0)\n"
+        "addl    $32, %0\n"
+        "addl    $32, %1\n"
+        "decl    %2\n"
+        "jnz     1b\n"
+        "sfence\n"
+        : "+r"(dst), "+r"(src), "+r"(count)
+        :: "memory"
+    );
+}
+
+// 按优先顺序排列，FbInit 选择处理器支持的最后一项
+static BlitVariant blitVariants[] = {
+    { "rep movsd",  0,              BlitMovsd   },
+    { "movntdq",    MEM_FEAT_SSE2,  BlitMovntdq },
+};
+#define BLIT_VARIANTS   (sizeof(blitVariants) / sizeof(BlitVariant))
+
+static BlitVariant *blitOps = &blitVariants[0];
+
+// 复制一行像素，使用 SSE 寄存器的实现需要关中断
+static void BlitRow(void *dst, const void *src, u32 n) {
+    u32 flags = IrqSave();
+    blitOps->Row(dst, src, n);
+    IrqRestore(flags);
+}
+
+/* ========================== 离屏表面 ========================== */
+// 把字符 code(显存格式: 低 8 位为字符，高 8 位为颜色)画到表面的 (x, y) 处
+static void DrawGlyph(Surface *sf, u32 code, u32 x, u32 y) {
+    u8  *glyph = font + (code & 0xff) * FB_GLYPH_H;
+    u32  fg    = palette[(code >> 8) & 0xf];
+    u32  bg    = palette[(code >> 12) & 0x7];
+    u32 *p     = sf->pixels + y * FB_SURFACE_W + x;
+    for (u32 row = 0; row < FB_GLYPH_H; row++, p += FB_SURFACE_W) {
+        u8 bits = glyph[row];
+        for (u32 col = 0; col < FB_GLYPH_W; col++)
+            p[col] = bits & (0x80 >> col) ? fg : bg;
+    }
+}
+
+// 将表面中 [x0, x1) x [y0, y1) 的区域并入脏矩形
+static void Damage(Surface *sf, u32 x0, u32 y0, u32 x1, u32 y1) {
+    u32 flags = SpinLockIrqSave(&fbLock);
+    if (sf->x0 >= sf->x1) {
+        sf->x0 = x0;  sf->y0 = y0;
+        sf->x1 = x1;  sf->y1 = y1;
+    } else {
+        if (x0 < sf->x0) sf->x0 = x0;
+        if (y0 < sf->y0) sf->y0 = y0;
+        if (x1 > sf->x1) sf->x1 = x1;
+        if (y1 > sf->y1) sf->y1 = y1;
+    }
+    SpinUnlockIrqRestore(&fbLock, flags);
+}
+
+// 在表面 id(任务的 pid 或 FB_KERNEL)的第 cell 个字符处显示 code
+// 内核的表面分配之前先记录在 earlyCells 中，分配后一次画出；没有窗口的任务的输出被丢弃
+void FbPutCell(u32 id, u32 code, u32 cell) {
+    if (cell >= CONSOLE_ROWS * CONSOLE_COLS)
+        return;
+    Surface *sf = &surfaces[id];
+    if (!sf->pixels) {
+        if (id == FB_KERNEL)
+            earlyCells[cell] = code;
+        return;
+    }
+    u32 x = cell % CONSOLE_COLS * FB_GLYPH_W;
+    u32 y = cell / CONSOLE_COLS * FB_GLYPH_H;
+    DrawGlyph(sf, code, x, y);
+    Damage(sf, x, y, x + FB_GLYPH_W, y + FB_GLYPH_H);
+}
+
+/* ========================== 合成器 ========================== */
+// 把统计信息写到串口并清零，复制速度为字节数除以微秒数(MB/s)
+static void FbReport() {
+    u32 us   = tscPerMs ? Div64(fbCycles * 1000, tscPerMs) : 0;
+    u32 mbps = us ? Div64(fbBytes, us) : 0;
+    SerialPrint("FB frames ");          SerialPrintDecimal(fbFrames);
+    SerialPrint(" kbytes ");            SerialPrintDecimal((u32)(fbBytes >> 10));
+    SerialPrint(" us_per_frame ");      SerialPrintDecimal(fbFrames ? us / fbFrames : 0);
+    SerialPrint(" mbps ");              SerialPrintDecimal(mbps);
+    SerialPrint("\n");
+    fbFrames = 0;
+    fbBytes  = fbCycles = 0;
+}
+
+// 合成一帧: 依次取下每个表面的脏矩形，复制到屏幕上的窗口，在工作队列线程中执行
+static void FbCompose(Work *work) {
+    u64 start = ReadTsc();
+    u32 bytes = 0;
+    for (u32 id = 0; id <= FB_KERNEL; id++) {
+        Surface *sf = &surfaces[id];
+        if (!sf->pixels)
+            continue;
+        u32 flags = SpinLockIrqSave(&fbLock);
+        u32 x0 = sf->x0, y0 = sf->y0, x1 = sf->x1, y1 = sf->y1;
+        sf->x0 = sf->x1 = 0;
+        SpinUnlockIrqRestore(&fbLock, flags);
+        if (x0 >= x1)
+            continue;
+        u8  *dst = (u8 *)FB_BASE + (sf->y + y0) * vbeInfo.pitch + (sf->x + x0) * 4;
+        u32 *src = sf->pixels + y0 * FB_SURFACE_W + x0;
+        u32  n   = (x1 - x0) * 4;
+        for (u32 y = y0; y < y1; y++) {
+            BlitRow(dst, src, n);
+            dst += vbeInfo.pitch;
+            src += FB_SURFACE_W;
+        }
+        bytes += n * (y1 - y0);
+    }
+    if (bytes) {
+        fbFrames++;
+        fbBytes  += bytes;
+        fbCycles += ReadTsc() - start;
+    }
+    if (GetTicks() - fbReportTick >= FB_REPORT_PERIOD) {
+        fbReportTick = GetTicks();
+        FbReport();
+    }
+}
+
+// 请求合成一帧，由时钟中断的下半部每 FB_PERIOD 个节拍调用
+void FbFlush() {
+    if (fbReady)
+        WorkSchedule(&fbWork);
+}
+
+/* ========================== 初始化 ========================== */
+// 处理器支持 PAT 时把 PAT_WC_ENTRY 号表项改为写合并，返回帧缓冲的页表项使用的缓存属性
+// 修改前后写回并作废缓存，kernelPat 使应用处理器启动时使用相同的设置
+static u32 SetupPat() {
+    u32 regs[4];
+    Cpuid(1, regs);
+    if (!(regs[3] & CPUID_PAT))
+        return PAGE_PWT | PAGE_PCD;
+    u64 pat = ReadMsr(MSR_PAT);
+    pat = (pat & ~(0xffull << (PAT_WC_ENTRY * 8))) | (u64)PAT_WC << (PAT_WC_ENTRY * 8);
+    u32 flags = IrqSave();
+    __asm__ __volatile__ ("wbinvd" ::: "memory");
+    WriteMsr(MSR_PAT, pat);
+    __asm__ __volatile__ ("wbinvd" ::: "memory");
+    IrqRestore(flags);
+    kernelPat = pat;
+    return PAGE_PWT;
+}
+
+// 帧缓冲初始化函数，在页缓存初始化之后、启动应用处理器之前调用
+// 映射帧缓冲，为内核和每个放得下的任务分配离屏表面，画出之前的内核输出，
+// 然后合成一次全屏并显示所用的时间，之后由时钟中断定期合成
+void FbInit() {
+    if (!vbeInfo.base)
+        return;
+    SpinInit(&fbLock, "fb");
+    fbWork.func = FbCompose;
+    font = (u8 *)vbeInfo.font;
+    // 映射帧缓冲
+    u32 cache = SetupPat();
+    u32 size  = vbeInfo.pitch * vbeInfo.height;
+    for (u32 off = 0; off < size; off += PAGE_SIZE)
+        *KernelPte(FB_BASE + off) = (vbeInfo.base + off) | PAGE_P | PAGE_W | cache;
+    for (u32 y = 0; y < vbeInfo.height; y++)
+        memset((u8 *)FB_BASE + y * vbeInfo.pitch, 0, vbeInfo.width * 4);
+    // 选择复制的实现，SSE2 的实现要求每行的起始地址按 16 字节对齐
+    for (u32 i = 0; i < BLIT_VARIANTS; i++)
+        if ((blitVariants[i].need & MemFeatures()) == blitVariants[i].need && (!blitVariants[i].need || vbeInfo.pitch % 16 == 0))
+            blitOps = &blitVariants[i];
+    // 按网格为内核和任务分配表面
+    u32 cols    = vbeInfo.width / FB_SURFACE_W;
+    u32 rows    = vbeInfo.height / FB_SURFACE_H;
+    u32 left    = (vbeInfo.width - cols * FB_SURFACE_W) / 2 & ~(FB_GLYPH_W - 1);
+    u32 top     = (vbeInfo.height - rows * FB_SURFACE_H) / 2;
+    u32 windows = 0;
+    for (u32 slot = 0; slot < cols * rows && slot <= taskCount; slot++) {
+        u32 id = slot ? slot - 1 : FB_KERNEL;
+        Surface *sf = &surfaces[id];
+        u32 va = FB_SURFACE_BASE + id * FB_SURFACE_SPAN;
+        if (!MmKernelMap(va, FB_SURFACE_W * FB_SURFACE_H * 4)) {
+            SerialPrint("FB: out of memory for surfaces\n");
+            break;
+        }
+        sf->x = left + slot % cols * FB_SURFACE_W;
+        sf->y = top + slot / cols * FB_SURFACE_H;
+        sf->pixels = (u32 *)va;
+        windows++;
+    }
+    // 画出内核表面分配之前的输出，所有表面整体作为脏矩形
+    if (surfaces[FB_KERNEL].pixels)
+        for (u32 cell = 0; cell < CONSOLE_ROWS * CONSOLE_COLS; cell++)
+            if (earlyCells[cell])
+                DrawGlyph(&surfaces[FB_KERNEL], earlyCells[cell],
+                          cell % CONSOLE_COLS * FB_GLYPH_W, cell / CONSOLE_COLS * FB_GLYPH_H);
+    for (u32 id = 0; id <= FB_KERNEL; id++)
+        if (surfaces[id].pixels)
+            Damage(&surfaces[id], 0, 0, FB_SURFACE_W, FB_SURFACE_H);
+    fbReportTick = GetTicks();
+    FbCompose(0);
+    u32 us   = tscPerMs ? Div64(fbCycles * 1000, tscPerMs) : 0;
+    u32 mbps = us ? Div64(fbBytes, us) : 0;
+    fbFrames = 0;
+    fbBytes  = fbCycles = 0;
+    fbReady  = 1;
+    Print("[KERNEL] Framebuffer: ", F_Cyan | L_Light);
+    PrintDecimal(vbeInfo.width, F_White | L_Light);
+    Print("x", F_White);
+    PrintDecimal(vbeInfo.height, F_White | L_Light);
+    Print(cache == PAGE_PWT ? " WC, " : " UC, ", F_White);
+    PrintDecimal(windows, F_White | L_Light);
+    Print(" windows, blit ", F_White);
+    Print(blitOps->name, F_White | L_Light);
+    Print(", full redraw ", F_White);
+    PrintDecimal(us, F_White | L_Light);
+    Print("us ", F_White);
+    PrintDecimal(mbps, F_White | L_Light);
+    Print("MB/s\n", F_White);
+}
+#endif
@@ -0,0 +1,67 @@
+//  fs.c         by OrangeYYC
+//  TinyOS 文件系统 TIFS
+//
+//  硬盘布局(从 FS_START_SECTOR 开始): 超级块(1 扇区) | 目录哈希表 | 文件数据
+//  每个文件占用一段连续的扇区，可以用一次连续读取装入；目录是按文件名哈希、
+//  线性探测的哈希表，查找文件只需计算一次哈希。镜像由 code/tools/mkfs.c 在构建时生成
+//  文件的位置和大小在生成镜像时确定，不能创建文件或改变大小；文件内容按页经过页缓存(mm.c)读取，
+//  pwrite 在文件范围内覆盖写入页缓存，脏页由后台写回或 fsync 写到文件所在的扇区
+
+#include "common.h"
+
+static FsSuper fsSuper;                         // 缓存的超级块
+static FsEntry fsDir[FS_DIR_ENTRIES];           // 缓存的目录哈希表
+static int     fsReady = 0;                     // 文件系统是否有效
+static u8      fsSector[DISK_SECTOR_SIZE];      // 读取超级块的缓冲区
+
+// 文件名哈希函数 (FNV-1a)，与 mkfs 中的实现一致
+static u32 FsHash(char *name) {
+    u32 hash = 2166136261u;
+    for (char *c = name; *c; c++)
+        hash = (hash ^ (u8)*c) * 16777619u;
+    return hash;
+}
+
+// 比较文件名
+static int FsNameEqual(char *a, char *b) {
+    for (int i = 0; i < FS_NAME_LEN; i++) {
+        if (a[i] != b[i])
+            return 0;
+        if (!a[i])
+            return 1;
+    }
+    return 1;
+}
+
+// 文件系统初始化函数，读取并缓存超级块和目录哈希表
+void FsInit() {
+    ReadDisk(FS_START_SECTOR, (u32)fsSector);
+    fsSuper = *(FsSuper *)fsSector;
+    if (fsSuper.magic != FS_MAGIC || fsSuper.dirEntries != FS_DIR_ENTRIES
+        || fsSuper.dirSectors * DISK_SECTOR_SIZE != sizeof(fsDir)) {
+        Print("[KERNEL] Error: No file system found!\n", F_Red | L_Light);
+        return;
+    }
+    ReadDiskExtent(fsSuper.dirStart, fsSuper.dirSectors, (u32)fsDir);
+    fsReady = 1;
+    Print("[KERNEL] File System: ", F_Cyan | L_Light);
+    PrintDecimal(fsSuper.fileCount, F_White | L_Light);
+    Print(" Files, ", F_White);
+    PrintDecimal(fsSuper.totalSectors, F_White | L_Light);
+    Print(" Sectors\n", F_White);
+}
+
+// 按文件名查找文件，找不到时返回 0
+FsEntry *FsLookup(char *name) {
+    if (!fsReady)
+        return 0;
+    u32 slot = FsHash(name) % FS_DIR_ENTRIES;
+    for (u32 i = 0; i < FS_DIR_ENTRIES; i++) {
+        FsEntry *entry = &fsDir[(slot + i) % FS_DIR_ENTRIES];
+        if (!entry->name[0])
+            return 0;
+        if (FsNameEqual(entry->name, name))
+            return entry;
+    }
+    return 0;
+}
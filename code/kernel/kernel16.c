@@ -9,12 +9,12 @@
     0x007c00 -> 0x007e00  TinyOS 引导程序代码段和数据段
     0x007e00 -> 0x090000  空闲空间(计划分给内核)
         0x007e00 -> 0x007fff 内核程序的栈空间
-        0x008000 -> 0x00Bfff 内核程序的代码与数据
-        0x00C000 -> 0x09efff 内核暂时保留不用
+        0x008000 -> 0x03ffff 内核程序的代码与数据(实模式使用的部分位于 64K 以内)
+        0x040000 -> 0x09efff 内核暂时保留不用
     0x100000 -> 0x1FFFFF  空间空间(计划划分给用户)
 运行模式: 16 位实模式
 段寄存器: CS = DS = ES = SS = 0
-功能：设置全局描述符表，并跳入保护模式
+功能：检查内存，设置图形模式(VBE 构建)和全局描述符表，并跳入保护模式
 */
 
 /* ========================== 初始化代码段 ========================== */
@@ -31,6 +31,9 @@ asm (
 #include "defs.h"
  
 static void CheckMemory();
+#ifdef VBE
+static void SetVideoMode();
+#endif
 static void SetGdt();
 static void SwitchProtectMode();
 
@@ -38,6 +41,10 @@ static void SwitchProtectMode();
 static void Kernel16Main() {
     // 首先检查可用内存
     CheckMemory();
+#ifdef VBE
+    // 设置 VBE 图形模式
+    SetVideoMode();
+#endif
     // 设置全局描述符表
     SetGdt();
     // 进入保护模式
@@ -64,6 +71,101 @@ static void CheckMemory() {
     }
 }
 
+#ifdef VBE
+/* ========================== 设置图形模式 ========================== */
+extern VbeInfo vbeInfo;         // 图形模式的信息
+
+// 读取实模式地址 seg:off 处的 16 位数，用于访问 64K 之外的 VBE 模式号列表
+static u16 FarRead16(u16 seg, u16 off) {
+    u16 value;
+    __asm__ __volatile__ (
+        "movw   %w1, %%fs\n"
+        "movw   %%fs:(%k2), %0\n"
+        : "=r"(value)
+        : "r"(seg), "r"((u32)off)
+    );
+    return value;
+}
+
+// 设置图形模式函数
+// 在 VBE 的模式号列表中选择分辨率为 VBE_WIDTH x VBE_HEIGHT 的 32 位色线性帧缓冲模式，没有时选择不超过
+// 此分辨率、至少能放下一个表面的最大的模式，设置成功后填写 vbeInfo；没有可用的模式时保持文本模式
+// 设置模式前记录 BIOS 中 8x16 字模的地址，保护模式下用它把字符画到表面上
+static void SetVideoMode() {
+    VbeCtrl *ctrl = (VbeCtrl *)VBE_CTRL_BUF;
+    VbeMode *info = (VbeMode *)VBE_MODE_BUF;
+    u32 ax, best = 0, bestArea = 0, base = 0, pitch = 0, width = 0, height = 0;
+    ctrl->signature[0] = 'V';
+    ctrl->signature[1] = 'B';
+    ctrl->signature[2] = 'E';
+    ctrl->signature[3] = '2';
+    __asm__ __volatile__ (
+        "int    $0x10\n"
+        : "=a"(ax)
+        : "a"((u32)0x4f00), "D"((u32)ctrl)
+        : "memory"
+    );
+    if ((ax & 0xffff) != VBE_OK)
+        return;
+    for (u16 off = ctrl->modeOff; ; off += 2) {
+        u16 mode = FarRead16(ctrl->modeSeg, off);
+        if (mode == 0xffff)
+            break;
+        __asm__ __volatile__ (
+            "int    $0x10\n"
+            : "=a"(ax)
+            : "a"((u32)0x4f01), "c"((u32)mode), "D"((u32)info)
+            : "memory"
+        );
+        if ((ax & 0xffff) != VBE_OK || (info->attributes & VBE_ATTR_NEEDED) != VBE_ATTR_NEEDED)
+            continue;
+        if (info->bpp != 32 || info->memoryModel != VBE_MODEL_DIRECT || info->redPos != 16 || info->bluePos != 0)
+            continue;
+        if (info->width > VBE_WIDTH || info->height > VBE_HEIGHT ||
+            info->width < FB_SURFACE_W || info->height < FB_SURFACE_H)
+            continue;
+        if ((u32)info->pitch * info->height > FB_MAX_SIZE || (u32)info->width * info->height <= bestArea)
+            continue;
+        best     = mode;
+        bestArea = (u32)info->width * info->height;
+        base     = (u32)info->baseHigh << 16 | info->baseLow;
+        pitch    = info->pitch;
+        width    = info->width;
+        height   = info->height;
+    }
+    if (!best || !base)
+        return;
+    // 功能 0x1130: es:bp 返回字模的地址，bh = 6 为 8x16 字模
+    u32 fontSeg, fontOff;
+    __asm__ __volatile__ (
+        "pushl  %%ebp\n"
+        "pushw  %%es\n"
+        "int    $0x10\n"
+        "movw   %%es, %%ax\n"
+        "movl   %%ebp, %%edx\n"
+        "popw   %%es\n"
+        "popl   %%ebp\n"
+        : "=a"(fontSeg), "=d"(fontOff)
+        : "a"((u32)0x1130), "b"((u32)0x0600)
+        : "ecx"
+    );
+    __asm__ __volatile__ (
+        "int    $0x10\n"
+        : "=a"(ax)
+        : "a"((u32)0x4f02), "b"(best | VBE_LFB)
+    );
+    if ((ax & 0xffff) != VBE_OK)
+        return;
+    vbeInfo.base    = base;
+    vbeInfo.pitch   = pitch;
+    vbeInfo.width   = width;
+    vbeInfo.height  = height;
+    vbeInfo.mode    = best;
+    vbeInfo.version = ctrl->version;
+    vbeInfo.font    = (fontSeg & 0xffff) * 16 + (fontOff & 0xffff);
+}
+#endif
+
 /* ========================== 设置全局描述符表 ========================== */
 extern u8          gdtPtr[6];      // 0-15: 限界，16-47: 基地址
 extern Descriptor  gdt[GDT_SIZE];  // 全局描述符表
@@ -108,7 +210,7 @@ static void SwitchProtectMode() {
         "movl   %%cr0, %%eax\n"     // 修改控制寄存器
         "orl    $0x1, %%eax\n"
         "movl   %%eax, %%cr0\n"
-        "ljmp   $0x8, $%1\n"        // 长跳转进入保护模式
+        "ljmpl  $0x8, $%1\n"        // 长跳转进入保护模式
         :: "m"(gdtPtr), "m"(Kernel32Main)
     );
 }
\ No newline at end of file
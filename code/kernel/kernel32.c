@@ -2,74 +2,190 @@
 //  TinyOS 保护模式 32 位内核程序部分
 
 /* TinyOS 内核 —— 保护模式执行程序
-内存空间: 0x200000 4M 内存空间
+内存空间: 至少 8M 内存空间，8M 以上的内存用作页缓存；1G 以上和 4G 以上的内存不直接映射，分给用户进程
     0x000000 -> 0x000400  BIOS 加载的中断向量表
     0x000400 -> 0x000500  BIOS 参数的相关区域
     0x000500 -> 0x007c00  TinyOS 引导程序的栈空间
+        0x006000 -> 0x006fff 应用处理器的启动代码
     0x007c00 -> 0x007e00  TinyOS 引导程序代码段和数据段
-    0x007e00 -> 0x090000 空闲空间(计划分给内核)
-        0x007e00 -> 0x007fff 内核程序的栈空间
-        0x008000 -> 0x00Bfff 内核程序的代码与数据(IDT GDT TSS 均在这个部分)
-        0x00C000 -> 0x09efff 页目录和页表的区域
-            0x0010000 -> 0x001ffff 内核程序的页表 
-                0x010000 -> 0x0100ff 内核程序的页目录表
-                0x011000 -> 0x018fff 内核程序的页表
-            0x0020000 -> 0x002ffff 1号任务的页表
+    0x007e00 -> 0x09efff  空闲空间(计划分给内核)
+        0x007e00 -> 0x007fff 启动处理器的内核栈空间
+        0x008000 -> 0x03ffff 内核程序的代码与数据(IDT GDT TSS 均在这个部分)
+        0x048000 -> 0x04ffff 各处理器的中断栈空间
+        0x050000 -> 0x057fff 应用处理器的内核栈空间
+        0x058000 -> 0x05ffff 内核线程的栈空间
+        0x060000 -> 0x07ffff 用户进程的页目录指针表、页目录和私有页表
+            0x060000 -> 0x063fff 1号任务的页目录指针表、页目录和页表
             ...
-            0x0090000 -> 0x009e000 8号任务的页表 
-        0x00C000
+            0x07c000 -> 0x07ffff 8号任务的页目录指针表、页目录和页表
     0x100000 -> 0x1FFFFF  空间空间(计划划分给用户)
         0x100000 -> 0x10ffff 用户进程 1
         0x110000 -> 0x11ffff 用户进程 2
         ...
         0x170000 -> 0x17ffff 用户进程 8
-        0x180000 -> 0x18ffff 加载时的备用存储空间
+        0x180000 -> 0x187fff 采样分析器的样本表(PROFILE 构建)
+    0x400000 -> 0x7fffff  内核程序的页目录指针表、页目录和页表
+        0x400000 -> 0x400fff 内核程序的页目录指针表
+        0x401000 -> 0x404fff 内核程序的 4 个页目录
+        0x405000 -> 0x7fffff 内核程序的页表
+    0x800000 -> 0xffffff  页缓存、用户进程私有页和文件映射区域页表使用的物理页框
+线性地址空间:
+    0x00000000 -> 0x3fffffff  直接映射的内存(任务的 0x100000 -> 0x10ffff 映射到各自的物理内存)
+    0x40000000 -> 0x7fffffff  用户进程的文件映射和匿名内存区域，按页映射到页缓存或高端内存
+    0xe0000000 -> 0xe08fffff  帧缓冲合成器的离屏表面，每个任务和内核各 1M (VBE 构建)
+    0xf0000000 -> 0xf0ffffff  VBE 线性帧缓冲 (VBE 构建)
+    0xfec00000 -> 0xffffffff  APIC 的寄存器和每个处理器的临时映射窗口
 
 运行模式: 32 位保护模式
 段寄存器: CS = DS = ES = SS = 0
-功能：开启分页管理 设置中断向量表
+功能：开启分页管理 设置中断向量表 启动应用处理器
 */
 
 #include "common.h"
 
 /* ========================== 显示系统内存 ========================== */
+// 输出 64 位的十六进制数
+static void PrintNumber64(u64 value, int color) {
+    PrintNumber((u32)(value >> 32), color);
+    PrintNumber((u32)value, color);
+}
+
 // 显示系统内存函数
+// 内存描述符使用 64 位的地址和长度，RAMSize 为直接映射的内存大小(不超过 LOWMEM_LIMIT)，
+// 其余的可用内存由 mm.c 作为高端内存分给用户进程
 static void CheckMemory() {
     Print("[KERNEL] Testing System Memory\n", F_Cyan | L_Light);
-    Print("           Offset      Size       State\n", F_White);
+    Print("                   Offset              Size       State\n", F_White);
+    u64 usable = 0;
     for (int i = 0; i < MemoryEntryCount; i++) {
-        PrintNumber(ARDs[i].BaseAddrLow, F_White);
+        u64 base   = (u64)ARDs[i].BaseAddrHigh << 32 | ARDs[i].BaseAddrLow;
+        u64 length = (u64)ARDs[i].LengthHigh << 32 | ARDs[i].LengthLow;
+        PrintNumber64(base, F_White);
         Print("-", F_White);
-        PrintNumber(ARDs[i].BaseAddrLow + ARDs[i].LengthLow - 1, F_White);
+        PrintNumber64(base + length - 1, F_White);
         Print("  ", F_White);
-        PrintNumber(ARDs[i].LengthLow, F_White);
+        PrintNumber64(length, F_White);
         if (ARDs[i].Type == 1)
             Print("    Free", F_Green | L_Light);
         else
             Print("    Reserved", F_White);
         Print("\n", F_White);
-        if (ARDs[i].BaseAddrLow + ARDs[i].LengthLow > RAMSize)
-            RAMSize = ARDs[i].BaseAddrLow + ARDs[i].LengthLow;
+        if (ARDs[i].Type == 1)
+            usable += length;
+        if (base < LOWMEM_LIMIT) {
+            u64 end = base + length < LOWMEM_LIMIT ? base + length : LOWMEM_LIMIT;
+            if (end > RAMSize)
+                RAMSize = end;
+        }
     }
     Print("RAM Size: ", F_White);
-    PrintNumber(RAMSize, F_White | L_Light);
-    Print("\n", F_White);
+    PrintDecimal((u32)(usable >> 20), F_White | L_Light);
+    Print("M usable, ", F_White);
+    PrintDecimal(RAMSize >> 20, F_White | L_Light);
+    Print("M direct mapped\n", F_White);
 }
 
 /* ========================== 启动分页机制 ========================== */
+// 内核使用 PAE 分页: 页目录指针表的 4 项依次指向 PAGE_PD_BASE 处连续的 4 个页目录，
+// 因此线性地址 addr 的页目录项是 PAGE_PD_BASE 开始的第 addr >> 21 项
+static u32 kernelTableNext = PAGE_TABLE_BASE;   // 下一个分配的内核页表
+
+// 分配一个清空的内核页表
+static u64 *KernelTableAlloc() {
+    if (kernelTableNext >= FRAME_BASE) {
+        Print("[KERNEL] Error: Out of kernel page tables!", F_Red | L_Light);
+        while (1) ;
+    }
+    u64 *table = (u64 *)kernelTableNext;
+    kernelTableNext += PAGE_SIZE;
+    PageZero(table);
+    return table;
+}
+
+// 返回内核页表中线性地址 addr 的页表项，所在的页目录项还没有页表时分配页表
+// addr 不能位于大页映射的范围内
+u64 *KernelPte(u32 addr) {
+    u64 *PDE = (u64 *)PAGE_PD_BASE + (addr >> 21);
+    if (!(*PDE & PAGE_P))
+        *PDE = (u32)KernelTableAlloc() | PAGE_P | PAGE_W;
+    return (u64 *)((u32)*PDE & ~(PAGE_SIZE - 1)) + ((addr >> 12) & (PAGE_ENTRIES - 1));
+}
+
+// 在内核页表中映射一个页，用于访问内存之外的设备寄存器，映射的页禁用缓存
+void MapKernelPage(u32 addr) {
+    if (!addr)
+        return;
+    // 已经由大页映射时不需要再映射
+    if (((u64 *)PAGE_PD_BASE)[addr >> 21] & PAGE_PS)
+        return;
+    *KernelPte(addr) = (addr & ~(PAGE_SIZE - 1)) | PAGE_P | PAGE_W | PAGE_PWT | PAGE_PCD;
+    __asm__ __volatile__ (
+        "invlpg (%0)\n"
+        ::"r"(addr) : "memory"
+    );
+}
+
+// 测量开启分页后按页扫过内存的速度，返回第二遍扫描平均每页的周期数
+// 第一遍扫描装入缓存，第二遍的时间主要反映 TLB 的命中情况，处理器没有可用的 TLB 统计时以此比较
+static u32 PagingSweep() {
+    u32 size  = RAMSize < PAGING_SWEEP_SIZE ? RAMSize : PAGING_SWEEP_SIZE;
+    u64 start = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        start = ReadTsc();
+        for (u32 addr = 0; addr < size; addr += PAGE_SIZE)
+            (void)*(volatile u32 *)addr;
+    }
+    return (u32)(ReadTsc() - start) / (size / PAGE_SIZE);
+}
+
 // 启动分页机制主函数
+// 使用 PAE 分页，页表项为 64 位，可以映射 4G 以上的物理内存。直接映射的内存使用 2M 的大页，
+// 页目录项直接指向物理内存，只在需要更细的粒度处使用 4K 页表: 第一个 2M(其中有显存、BIOS 等不同类型的区域)、
+// 内存末尾不满 2M 的部分、APIC 的寄存器和每个处理器的临时映射窗口。直接映射的内存只能在 Ring0 -> Ring2 访问
 static void SetupPaging() {
     Print("[KERNEL] Starting Memory Paging\n", F_Cyan | L_Light);
-    // 计算需要的页目录的个数
-    u32 PDECount = RAMSize / 0x400000 + (RAMSize % 0x400000 > 0 ? 1 : 0);
-    u32 *PDE     = (u32*) PAGE_DIR_BASE;
-    u32 *PTE     = (u32*) PAGE_TABLE_BASE;
+    u64 start = ReadTsc();
+    u32 regs[4];
+    Cpuid(1, regs);
+    if (!(regs[3] & CPUID_PAE)) {
+        Print("[KERNEL] Error: PAE paging is not supported!", F_Red | L_Light);
+        while (1) ;
+    }
+    kernelCr4 |= CR4_PAE;
+    // 计算需要的页目录项的个数，以及可以使用大页的页目录项范围
+    u32 PDECount   = RAMSize / LARGE_PAGE_SIZE + (RAMSize % LARGE_PAGE_SIZE > 0 ? 1 : 0);
+    u32 largeCount = RAMSize / LARGE_PAGE_SIZE;
+#ifdef NO_PSE
+    largeCount = 0;
+#endif
+    u64 *PDPT = (u64*) PAGE_DIR_BASE;
+    u64 *PDE  = (u64*) PAGE_PD_BASE;
+    for (u32 i = 0; i < 4; i++)
+        PDPT[i] = (PAGE_PD_BASE + i * PAGE_SIZE) | PAGE_P;
+    for (u32 i = 0; i < 4 * PAGE_ENTRIES; i++)
+        PDE[i] = 0;
     // 设置 线性地址 = 虚拟地址 的页表
-    for (u32 i = 0; i < PDECount; i++)
-        PDE[i] = (PAGE_TABLE_BASE + (i<<12)) | PAGE_P | PAGE_U | PAGE_W;
-    for (u32 i = 0; i < PDECount * 1024; i++)
-        PTE[i] = (i<<12) | PAGE_P | PAGE_U | PAGE_W;
-    // 设置 cr3 寄存器为页表基地址，设置 cr0 寄存器开启分页机制
+    for (u32 i = 0; i < PDECount; i++) {
+        if (i > 0 && i < largeCount) {
+            PDE[i] = (i<<21) | PAGE_P | PAGE_W | PAGE_PS;
+        } else {
+            u64 *PTE = KernelTableAlloc();
+            for (u32 j = 0; j < PAGE_ENTRIES; j++)
+                PTE[j] = ((i<<21) + (j<<12)) | PAGE_P | PAGE_W;
+            PDE[i] = (u32)PTE | PAGE_P | PAGE_W;
+        }
+    }
+    // 映射 APIC 的寄存器，为临时映射窗口分配页表
+    MapKernelPage(lapicBase);
+    MapKernelPage(ioapicBase);
+    KernelPte(KMAP_BASE);
+    // 设置 cr4 寄存器开启 PAE，设置 cr3 寄存器为页目录指针表基地址，设置 cr0 寄存器开启分页机制
+    __asm__ __volatile__ (
+        "movl %%cr4, %%eax\n"
+        "orl  %0, %%eax\n"
+        "movl %%eax, %%cr4\n"
+        ::"r"(kernelCr4) : "eax"
+    );
     __asm__ __volatile__ (
         "movl %%eax, %%cr3\n"
         "movl %%cr0, %%eax\n"
@@ -77,28 +193,42 @@ static void SetupPaging() {
         "movl %%eax, %%cr0\n"
         ::"a"(PAGE_DIR_BASE)
     );
+    // 显示建立页表的时间和按页访问内存的速度
+    u32 setup = (u32)(ReadTsc() - start);
+    Print("[KERNEL] Paging: PAE, ", F_Cyan | L_Light);
+    Print(largeCount ? "2M pages" : "4K pages", F_White | L_Light);
+    Print(", setup ", F_White);
+    PrintDecimal(setup >> 10, F_White | L_Light);
+    Print("K cycles, sweep ", F_White);
+    PrintDecimal(PagingSweep(), F_White | L_Light);
+    Print(" cycles/page\n", F_White);
 }
 
-/* ========================== 装载TSS函数 ========================== */
-static void SetupTSS() {
+/* ========================== 装载GDT和TSS函数 ========================== */
+// 设置处理器的全局描述符表和任务状态段
+// 每个处理器复制一份全局描述符表，其中的 TSS 描述符指向该处理器自己的任务状态段
+void SetupCpu(CPU *cpu) {
+    TSS *tss = &cpu->tss;
     // TSS 所有的元素设置为 0
-    for (int i = 0; i < sizeof(TSS); i++)
-        ((char *)(&tss))[i] = 0;
-    tss.ss0 = SELECTOR_FLAT_RW;     // Ring0 段寄存器为 flatRW
-    tss.iobase = sizeof(TSS);
-    SetDesEntry(&gdt[INDEX_TSS], (u32)&tss, sizeof(TSS) - 1, DA_386TSS);
+    memset(tss, 0, sizeof(TSS));
+    tss->ss0 = SELECTOR_FLAT_RW;    // Ring0 段寄存器为 flatRW
+    tss->iobase = sizeof(TSS);
+    // 复制全局描述符表并加载
+    for (int i = 0; i < GDT_SIZE; i++)
+        cpu->gdt[i] = gdt[i];
+    SetDesEntry(&cpu->gdt[INDEX_TSS], (u32)tss, sizeof(TSS) - 1, DA_386TSS);
+    *(u16*)(&cpu->gdtPtr[0]) = GDT_SIZE * sizeof(Descriptor) - 1;
+    *(u32*)(&cpu->gdtPtr[2]) = (u32)cpu->gdt;
     __asm__ __volatile__ (
-        "ltr %%ax"
-        :: "a"(SELECTOR_TSS)
+        "lgdt %0\n"
+        "ltr  %%ax\n"
+        :: "m"(cpu->gdtPtr), "a"(SELECTOR_TSS)
     );
 }
 
 /* ========================== 内核主函数 ========================== */
 // 导入重要功能
 extern void SetupIdt();
-extern void SetupProcess();
-extern void restart();
-extern void choose();
 
 // 内核主功能函数
 void Kernel32Main() {
@@ -114,20 +244,76 @@ void Kernel32Main() {
         "movl   $0x7fff, %%esp\n"
         ::: "eax"
     );
+#ifdef BENCH_SUITE
+    benchBootTsc = ReadTsc();
+#endif
     // 显示当前模式信息
     Print("[KERNEL] In Protect Mode Now\n", F_Brown | L_Light);
     // 检查系统内存
     CheckMemory(); 
+    // 初始化内核使用的锁
+    SpinInit(&schedLock, "sched");
+    SpinInit(&tickLock.lock, "ticks");
+    // 查找处理器和 APIC
+    MpInit();
     // 开启分页机制                     
     SetupPaging();
-    // 初始化 8259A 并建立中断向量表
+    // 按处理器特性选择内存操作的实现
+    MemInit();
+    SmpInit();
+    // 初始化中断控制器并建立中断向量表
     SetupIdt();
-    // 设置 TSS
-    SetupTSS();
-    // 初始化进程表
+    // 初始化串口，用于输出机器可读的信息
+    SerialInit();
+    // 初始化本地 APIC 和时钟
+    LapicInit();
+    TimerInit();
+#ifdef PROFILE
+    // 启动采样分析器
+    ProfileInit();
+#endif
+#ifdef SCHED_BENCH
+    // 运行调度策略基准测试
+    SchedBenchmark();
+#endif
+#ifdef MEM_BENCH
+    // 运行内存操作基准测试
+    MemBenchmark();
+#endif
+#ifdef BENCH_SUITE
+    // 运行基准测试套件的内核部分
+    BenchKernel();
+#endif
+    // 初始化页框池、页缓存和高端内存
+    MmInit();
+#ifdef VBE
+    // 映射帧缓冲并分配离屏表面，之后的输出由合成器显示在图形模式的屏幕上
+    FbInit();
+#endif
+    // 读取硬盘的信息，设置写命令的多扇区模式，读取文件系统的超级块和目录
+    DiskInit();
+    FsInit();
+#ifdef BENCH_SUITE
+    // 测量经过页缓存写入文件并写回硬盘的速度
+    BenchWrite();
+#endif
+    // 装入第一个任务，创建在任务运行时装入其余任务的内核线程
     SetupProcess();
+    // 初始化中断的下半部，创建工作队列内核线程，此后页缓存的读盘由工作队列线程执行
+    SoftirqInit();
+    MmIoStart();
+    // 打开键盘中断
+    KeyboardInit();
+    // 设置启动处理器的 GDT 和 TSS，启动应用处理器
+    SetupCpu(ThisCpu());
+    SmpBoot();
+#ifdef SMP_BENCH
+    // 运行多处理器扩展性基准测试
+    SmpBenchmark();
+#endif
     Print("[KERNEL] All Done! Start to do tasks ...\n", F_Brown | L_Light);
     // 选择并执行任务
-    choose();
+    SpinLock(&schedLock);
+    choose(0);
     restart();
 }
\ No newline at end of file
@@ -0,0 +1,143 @@
+//  keyboard.c         by OrangeYYC
+//  TinyOS 键盘驱动程序
+//
+//  键盘中断的上半部把扫描码转换为字符放入环形缓冲区，缓冲区只有中断处理一个生产者，不需要加锁；
+//  读取缓冲区的任务之间使用 kbdLock 互斥。键盘的上半部开中断执行，只把字符放入缓冲区并调度小任务，
+//  有任务在等待输入时，小任务关中断把字符交给等待最久的任务并唤醒它(复制到任务内存时会临时切换 cr3)，
+//  任务恢复执行时统计从按键中断到任务恢复执行的延迟
+
+#include "common.h"
+
+#define Barrier()   __asm__ __volatile__ ("" ::: "memory")
+
+/* ========================== 扫描码转换 ========================== */
+// 第一套扫描码 0x00 -> 0x39 对应的字符，不产生字符的键为 0
+static char keymap[]      = "\0\033" "1234567890-=\b\t" "qwertyuiop[]\n\0" "asdfghjkl;'`\0\\" "zxcvbnm,./\0*\0 ";
+static char keymapShift[] = "\0\033" "!@#$%^&*()_+\b\t" "QWERTYUIOP{}\n\0" "ASDFGHJKL:\"~\0|" "ZXCVBNM<>?\0*\0 ";
+static u32  shift = 0;                          // 按下的 Shift 键数量
+
+// 将扫描码转换为字符，不产生字符时返回 0
+static u8 Decode(u8 code) {
+    switch (code) {
+    case 0x2a: case 0x36:                       // Shift 按下
+        shift++;
+        return 0;
+    case 0xaa: case 0xb6:                       // Shift 松开
+        if (shift)
+            shift--;
+        return 0;
+    }
+    if (code >= sizeof(keymap) - 1)             // 松开、扩展键和其余的键
+        return 0;
+    return shift ? keymapShift[code] : keymap[code];
+}
+
+/* ========================== 输入缓冲区 ========================== */
+static u8           keyBuf[KBD_BUF_SIZE];       // 字符
+static u64          keyStamp[KBD_BUF_SIZE];     // 按键中断的时间戳
+static volatile u32 keyHead = 0;                // 生产者位置，只由中断处理修改
+static volatile u32 keyTail = 0;                // 消费者位置，持有 kbdLock 时修改
+
+static Spinlock     kbdLock    = {};            // 读取者之间的互斥，只在关中断状态下获取
+static WaitQueue    kbdWaiters = {};            // 等待输入的任务
+static u32          readAddr[MAX_TASKS];        // 等待的任务的缓冲区地址
+static u32          readCount[MAX_TASKS];       // 等待的任务请求的字节数
+static Tasklet      kbdTasklet = {};            // 把输入交给等待的任务
+
+static u32          keyLatencyCount = 0;        // 统计的按键数量
+static u64          keyLatencySum   = 0;        // 延迟总和(周期)
+static u64          keyLatencyMax   = 0;        // 最长延迟(周期)
+
+// 从缓冲区取出最多 count 个字符复制到任务 pcb 的地址 va，返回字符数，调用时需持有 kbdLock
+static u32 Deliver(PCB *pcb, u32 va, u32 count) {
+    u8  data[KBD_BUF_SIZE];
+    u32 n = 0;
+    while (n < count && n < KBD_BUF_SIZE && keyTail != keyHead) {
+        u32 slot = keyTail & (KBD_BUF_SIZE - 1);
+        data[n++] = keyBuf[slot];
+        if (!pcb->inputStamp)
+            pcb->inputStamp = keyStamp[slot];
+        Barrier();
+        keyTail++;
+    }
+    if (n)
+        CopyToUser(pcb, va, data, n);
+    return n;
+}
+
+/* ========================== 中断处理与读取 ========================== */
+// 有任务等待时完成它的读取并唤醒，在小任务中执行
+static void KeyboardDeliver(u32 data) {
+    u32 flags = SpinLockIrqSave(&kbdLock);
+    if (kbdWaiters.count && keyTail != keyHead) {
+        u32 pid = kbdWaiters.pids[kbdWaiters.head];
+        process[pid].regs.eax = Deliver(&process[pid], readAddr[pid], readCount[pid]);
+        WaitQueueWakeOne(&kbdWaiters);
+    }
+    SpinUnlockIrqRestore(&kbdLock, flags);
+}
+
+// 键盘中断的上半部，开中断执行，不访问任务内存，也不获取 kbdLock
+static void KeyboardTopHalf(u32 irq) {
+    u64 stamp = ReadTsc();
+    u8  ch    = Decode(InByte(KBD_DATA));
+    if (!ch)
+        return;
+    // 放入缓冲区，缓冲区满时丢弃
+    if (keyHead - keyTail < KBD_BUF_SIZE) {
+        u32 slot = keyHead & (KBD_BUF_SIZE - 1);
+        keyBuf[slot]   = ch;
+        keyStamp[slot] = stamp;
+        Barrier();
+        keyHead++;
+    }
+    TaskletSchedule(&kbdTasklet);
+}
+
+// 任务 pcb 读取最多 count 个字符到地址 va，返回读取的字符数
+// 缓冲区为空时任务阻塞，返回 SYSCALL_BLOCKED，有输入时由键盘的小任务完成读取
+u32 KeyboardRead(PCB *pcb, u32 va, u32 count) {
+    if (!count)
+        return 0;
+    SpinLock(&kbdLock);
+    u32 n = Deliver(pcb, va, count);
+    if (!n) {
+        readAddr[pcb->pid]  = va;
+        readCount[pcb->pid] = count;
+        WaitQueueSleep(&kbdWaiters, pcb);
+        n = SYSCALL_BLOCKED;
+    }
+    SpinUnlock(&kbdLock);
+    return n;
+}
+
+// 记录一次从按键中断到任务恢复执行的延迟
+void KeyboardLatency(u64 cycles) {
+    keyLatencyCount++;
+    keyLatencySum += cycles;
+    if (cycles > keyLatencyMax)
+        keyLatencyMax = cycles;
+}
+
+// 输出按键延迟的统计信息(微秒)，在屏幕第 row 行
+void KeyboardStatDump(u32 row) {
+    u32 perUs = tscPerMs / 1000;
+    if (!keyLatencyCount || !perUs)
+        return;
+    u32 avg = Div64(keyLatencySum, keyLatencyCount);
+    SetCursor(row, 0);
+    Print("[KBD] keys ", F_Cyan | L_Light);  PrintDecimal(keyLatencyCount, F_White | L_Light);
+    Print(" avg us ",    F_White);           PrintDecimal(avg / perUs, F_White | L_Light);
+    Print(" max us ",    F_White);           PrintDecimal(Div64(keyLatencyMax, perUs), F_White | L_Light);
+    Print("    \n",      F_White);
+}
+
+// 键盘初始化函数，清空键盘控制器中的数据并打开键盘中断
+void KeyboardInit() {
+    SpinInit(&kbdLock, "kbd");
+    kbdTasklet.func = KeyboardDeliver;
+    while (InByte(KBD_STATUS) & 0x1)
+        InByte(KBD_DATA);
+    IrqRegister(IRQ_KEYBOARD, KeyboardTopHalf);
+    IrqEnable(IRQ_KEYBOARD, 0);
+}
@@ -0,0 +1,384 @@
+//  memory.c         by OrangeYYC
+//  TinyOS 内存操作函数
+//
+//  提供 memcpy memmove memset memcmp 以及整页清零 PageZero、整页复制 PageCopy。
+//  每种操作有几种实现，MemInit 按 cpuid 报告的处理器特性选择最合适的一种:
+//    memcpy/memset  逐字节循环 | rep movsd/stosd | rep movsb/stosb (ERMS)
+//    整页操作       rep movsd/stosd | movntq (SSE) | movntdq (SSE2)
+//  整页操作的 movntq/movntdq 是不经过缓存的写入，清零或复制一整页时不会把缓存中的其他数据挤出去。
+//  内核不保存任务的浮点和 SSE 状态，因此使用 MMX/SSE 寄存器的实现只在关中断状态下执行，用完立即恢复
+//  (emms)，任务本身不使用这些寄存器
+
+#include "common.h"
+
+/* ========================== 通用实现 ========================== */
+// 逐字节复制
+static void CopyByte(void *dst, const void *src, u32 n) {
+    u8 *d = (u8 *)dst;
+    const u8 *s = (const u8 *)src;
+    for (u32 i = 0; i < n; i++)
+        d[i] = s[i];
+}
+
+// 逐字节填充
+static void SetByte(void *dst, u32 value, u32 n) {
+    u8 *d = (u8 *)dst;
+    for (u32 i = 0; i < n; i++)
+        d[i] = (u8)value;
+}
+
+// 按 4 字节复制，剩余不足 4 字节的部分逐字节复制
+static void CopyMovsd(void *dst, const void *src, u32 n) {
+    u32 d0, d1, d2;
+    __asm__ __volatile__ (
+        "rep movsl\n"
+        "movl   %6, %%ecx\n"
+        "rep movsb\n"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n >> 2), "1"(dst), "2"(src), "r"(n & 3)
+        : "memory"
+    );
+}
+
+// 按 4 字节填充，剩余不足 4 字节的部分逐字节填充
+static void SetStosd(void *dst, u32 value, u32 n) {
+    u32 d0, d1;
+    __asm__ __volatile__ (
+        "rep stosl\n"
+        "movl   %5, %%ecx\n"
+        "rep stosb\n"
+        : "=&c"(d0), "=&D"(d1)
+        : "0"(n >> 2), "1"(dst), "a"((value & 0xff) * 0x01010101), "r"(n & 3)
+        : "memory"
+    );
+}
+
+// 支持 ERMS 的处理器上 rep movsb 按缓存行复制，不需要处理对齐和剩余部分
+static void CopyMovsb(void *dst, const void *src, u32 n) {
+    u32 d0, d1, d2;
+    __asm__ __volatile__ (
+        "rep movsb\n"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n), "1"(dst), "2"(src)
+        : "memory"
+    );
+}
+
+// 支持 ERMS 的处理器上使用 rep stosb 填充
+static void SetStosb(void *dst, u32 value, u32 n) {
+    u32 d0, d1;
+    __asm__ __volatile__ (
+        "rep stosb\n"
+        : "=&c"(d0), "=&D"(d1)
+        : "0"(n), "1"(dst), "a"(value)
+        : "memory"
+    );
+}
+
+/* ========================== 整页实现 ========================== */
+// 使用 rep stosd 清零一页
+static void ZeroStosd(void *page) {
+    SetStosd(page, 0, PAGE_SIZE);
+}
+
+// 使用 rep movsd 复制一页
+static void PageMovsd(void *dst, const void *src) {
+    CopyMovsd(dst, src, PAGE_SIZE);
+}
+
+// 使用 MMX 寄存器和 movntq 清零一页，每次循环写入 64 字节
+static void ZeroMovntq(void *page) {
+    u32 count = PAGE_SIZE / 64;
+    __asm__ __volatile__ (
+        "pxor   %%mm0, %%mm0\n"
+        "1:\n"
+        "movntq %%mm0, (%0)\n"
+        "movntq %%mm0, 8(%0)\n"
+        "movntq %%mm0, 16(%0)\n"
+        "movntq %%mm0, 24(%0)\n"
+        "movntq %%mm0, 32(%0)\n"
+        "movntq %%mm0, 40(%0)\n"
+        "movntq %%mm0, 48(%0)\n"
+        "movntq %%mm0, 56(%0)\n"
+        "addl   $64, %0\n"
+        "decl   %1\n"
+        "jnz    1b\n"
+        "sfence\n"                  // 不经过缓存的写入在此之后才对其他处理器可见
+        "emms\n"
+        : "+r"(page), "+r"(count)
+        :: "memory"
+    );
+}
+
+// 使用 MMX 寄存器和 movntq 复制一页
+static void PageMovntq(void *dst, const void *src) {
+    u32 count = PAGE_SIZE / 64;
+    __asm__ __volatile__ (
+        "1:\n"
+        "movq   (%1), %%mm0\n"
+        "movq   8(%1), %%mm1\n"
+        "movq   16(%1), %%mm2\n"
+        "movq   24(%1), %%mm3\n"
+        "movq   32(%1), %%mm4\n"
+        "movq   40(%1), %%mm5\n"
+        "movq   48(%1), %%mm6\n"
+        "movq   56(%1), %%mm7\n"
+        "movntq %%mm0, (%0)\n"
+        "movntq %%mm1, 8(%0)\n"
+        "movntq %%mm2, 16(%0)\n"
+        "movntq %%mm3, 24(%0)\n"
+        "movntq %%mm4, 32(%0)\n"
+        "movntq %%mm5, 40(%0)\n"
+        "movntq %%mm6, 48(%0)\n"
+        "movntq %%mm7, 56(%0)\n"
+        "addl   $64, %0\n"
+        "addl   $64, %1\n"
+        "decl   %2\n"
+        "jnz    1b\n"
+        "sfence\n"
+        "emms\n"
+        : "+r"(dst), "+r"(src), "+r"(count)
+        :: "memory"
+    );
+}
+
+// 使用 SSE2 寄存器和 movntdq 清零一页，地址需要按 16 字节对齐
+static void ZeroMovntdq(void *page) {
+    u32 count = PAGE_SIZE / 64;
+    __asm__ __volatile__ (
+        "pxor    %%xmm0, %%xmm0\n"
+        "1:\n"
+        "movntdq %%xmm0, (%0)\n"
+        "movntdq %%xmm0, 16(%0)\n"
+        "movntdq %%xmm0, 32(%0)\n"
+        "movntdq %%xmm0, 48(%0)\n"
+        "addl    $64, %0\n"
+        "decl    %1\n"
+        "jnz     1b\n"
+        "sfence\n"
+        : "+r"(page), "+r"(count)
+        :: "memory"
+    );
+}
+
+// 使用 SSE2 寄存器和 movntdq 复制一页
+static void PageMovntdq(void *dst, const void *src) {
+    u32 count = PAGE_SIZE / 64;
+    __asm__ __volatile__ (
+        "1:\n"
+        "movdqa  (%1), %%xmm0\n"
+        "movdqa  16(%1), %%xmm1\n"
+        "movdqa  32(%1), %%xmm2\n"
+        "movdqa  48(%1), %%xmm3\n"
+        "movntdq %%xmm0, (%0)\n"
+        "movntdq %%xmm1, 16(%0)\n"
+        "movntdq %%xmm2, 32(%0)\n"
+        "movntdq %%xmm3, 48(%0)\n"
+        "addl    $64, %0\n"
+        "addl    $64, %1\n"
+        "decl    %2\n"
+        "jnz     1b\n"
+        "sfence\n"
+        : "+r"(dst), "+r"(src), "+r"(count)
+        :: "memory"
+    );
+}
+
+/* ========================== 实现的选择 ========================== */
+// 按优先顺序排列，MemInit 选择处理器支持的最后一项
+static MemVariant memVariants[] = {
+    { "byte",       0,              CopyByte,  SetByte  },
+    { "rep movsd",  0,              CopyMovsd, SetStosd },
+    { "rep movsb",  MEM_FEAT_ERMS,  CopyMovsb, SetStosb },
+};
+static PageVariant pageVariants[] = {
+    { "rep movsd",  0,              ZeroStosd,   PageMovsd   },
+    { "movntq",     MEM_FEAT_SSE,   ZeroMovntq,  PageMovntq  },
+    { "movntdq",    MEM_FEAT_SSE2,  ZeroMovntdq, PageMovntdq },
+};
+#define MEM_VARIANTS    (sizeof(memVariants) / sizeof(MemVariant))
+#define PAGE_VARIANTS   (sizeof(pageVariants) / sizeof(PageVariant))
+
+// 在 MemInit 之前(建立内核页表时)使用所有处理器都支持的实现
+static MemVariant  *memOps   = &memVariants[1];
+static PageVariant *pageOps  = &pageVariants[0];
+static u32          memFeats = 0;               // 处理器支持的特性 MEM_FEAT_*
+
+/* ========================== 内存操作函数 ========================== */
+// 复制 n 字节，区域不能重叠
+void *memcpy(void *dst, const void *src, u32 n) {
+    memOps->Copy(dst, src, n);
+    return dst;
+}
+
+// 复制 n 字节，区域可以重叠；目标在源之后且重叠时从末尾向前复制
+void *memmove(void *dst, const void *src, u32 n) {
+    if ((u32)dst <= (u32)src || (u32)dst >= (u32)src + n)
+        return memcpy(dst, src, n);
+    u32 d0, d1, d2;
+    __asm__ __volatile__ (
+        "std\n"
+        "rep movsb\n"
+        "cld\n"
+        : "=&c"(d0), "=&D"(d1), "=&S"(d2)
+        : "0"(n), "1"((u8 *)dst + n - 1), "2"((const u8 *)src + n - 1)
+        : "memory"
+    );
+    return dst;
+}
+
+// 将 n 字节设置为 value
+void *memset(void *dst, int value, u32 n) {
+    memOps->Set(dst, (u8)value, n);
+    return dst;
+}
+
+// 比较 n 字节，返回第一个不同的字节之差，全部相同时返回 0
+int memcmp(const void *a, const void *b, u32 n) {
+    const u8 *p = (const u8 *)a, *q = (const u8 *)b;
+    for (u32 i = 0; i < n; i++)
+        if (p[i] != q[i])
+            return p[i] - q[i];
+    return 0;
+}
+
+// 清零一页，page 需要按页对齐
+void PageZero(void *page) {
+    u32 flags = IrqSave();
+    pageOps->Zero(page);
+    IrqRestore(flags);
+}
+
+// 复制一页，dst 和 src 需要按页对齐
+void PageCopy(void *dst, const void *src) {
+    u32 flags = IrqSave();
+    pageOps->Copy(dst, src);
+    IrqRestore(flags);
+}
+
+// 返回处理器支持的特性 MEM_FEAT_*，在 MemInit 之后有效
+u32 MemFeatures() {
+    return memFeats;
+}
+
+/* ========================== 初始化 ========================== */
+// 内存操作初始化函数，检查处理器特性并选择实现，在开启分页之后、启动应用处理器之前调用
+// 使用 SSE 指令需要设置 cr4.OSFXSR，写入 kernelCr4 使应用处理器启动时使用相同的设置
+void MemInit() {
+    u32 regs[4], maxLeaf;
+    Cpuid(0, regs);
+    maxLeaf = regs[0];
+    Cpuid(1, regs);
+    if ((regs[3] & CPUID_FXSR) && (regs[3] & CPUID_SSE))
+        memFeats |= MEM_FEAT_SSE;
+    if ((memFeats & MEM_FEAT_SSE) && (regs[3] & CPUID_SSE2))
+        memFeats |= MEM_FEAT_SSE2;
+    if (maxLeaf >= 7) {
+        Cpuid(7, regs);
+        if (regs[1] & CPUID_ERMS)
+            memFeats |= MEM_FEAT_ERMS;
+    }
+    if (memFeats & MEM_FEAT_SSE) {
+        kernelCr4 |= CR4_OSFXSR;
+        __asm__ __volatile__ (
+            "movl   %%cr0, %%eax\n"
+            "andl   %0, %%eax\n"
+            "orl    %1, %%eax\n"
+            "movl   %%eax, %%cr0\n"
+            "movl   %%cr4, %%eax\n"
+            "orl    %2, %%eax\n"
+            "movl   %%eax, %%cr4\n"
+            :: "i"(~CR0_EM), "i"(CR0_MP), "i"(CR4_OSFXSR) : "eax"
+        );
+    }
+    for (u32 i = 0; i < MEM_VARIANTS; i++)
+        if ((memVariants[i].need & memFeats) == memVariants[i].need)
+            memOps = &memVariants[i];
+    for (u32 i = 0; i < PAGE_VARIANTS; i++)
+        if ((pageVariants[i].need & memFeats) == pageVariants[i].need)
+            pageOps = &pageVariants[i];
+    Print("[KERNEL] Memory Primitives: memcpy ", F_Cyan | L_Light);
+    Print(memOps->name, F_White | L_Light);
+    Print(", page ", F_White);
+    Print(pageOps->name, F_White | L_Light);
+    Print("\n", F_White);
+}
+
+/* ========================== 基准测试 ========================== */
+#ifdef MEM_BENCH
+static u32   benchSizes[] = { 64, PAGE_SIZE, 0x100000 };
+static char *benchNames[] = { " 64B ", "  4K ", "  1M " };
+#define BENCH_SIZES     (sizeof(benchSizes) / sizeof(u32))
+
+// 输出 cycles 个周期处理 bytes 字节的速度 (GB/s，保留两位小数)
+static void PrintRate(u32 bytes, u32 cycles) {
+    // 每毫秒处理的字节数除以 10000 为百分之一 GB/s
+    u32 rate = Div64((u64)bytes * tscPerMs, cycles) / 10000;
+    PrintDecimal(rate / 100, F_White | L_Light);
+    Print(rate % 100 < 10 ? ".0" : ".", F_White | L_Light);
+    PrintDecimal(rate % 100, F_White | L_Light);
+}
+
+// 输出实现名称，不足 12 个字符时补齐空格，当前使用的实现标记 *
+static void PrintVariant(char *kind, char *name, int used) {
+    Print("[MEM] ", F_Cyan | L_Light);
+    Print(kind, F_White);
+    Print(name, used ? F_Green | L_Light : F_White | L_Light);
+    u32 len = 0;
+    while (name[len])
+        len++;
+    Print(used ? "*" : " ", F_Green | L_Light);
+    for (; len < 11; len++)
+        Print(" ", F_White);
+}
+
+// 内存操作基准测试函数，在时钟校准之后、页框池使用之前调用
+// 依次测量每种 memcpy/memset 实现处理不同大小的块以及每种整页实现的速度，以页框池为缓冲区
+void MemBenchmark() {
+    if (!tscPerMs)
+        return;
+    u8 *src = (u8 *)FRAME_BASE;
+    u8 *dst = (u8 *)FRAME_BASE + MEM_BENCH_BYTES;
+    Print("[KERNEL] Memory Benchmark (GB/s)\n", F_Cyan | L_Light);
+    for (u32 v = 0; v < MEM_VARIANTS; v++) {
+        MemVariant *m = &memVariants[v];
+        if ((m->need & memFeats) != m->need)
+            continue;
+        for (u32 op = 0; op < 2; op++) {
+            PrintVariant(op ? "memset " : "memcpy ", m->name, m == memOps);
+            for (u32 s = 0; s < BENCH_SIZES; s++) {
+                u32 count = MEM_BENCH_BYTES / benchSizes[s];
+                u64 start = ReadTsc();
+                for (u32 i = 0; i < count; i++)
+                    if (op)
+                        m->Set(dst, i, benchSizes[s]);
+                    else
+                        m->Copy(dst, src, benchSizes[s]);
+                u32 cycles = (u32)(ReadTsc() - start);
+                Print(benchNames[s], F_White);
+                PrintRate(MEM_BENCH_BYTES, cycles);
+            }
+            Print("\n", F_White);
+        }
+    }
+    for (u32 v = 0; v < PAGE_VARIANTS; v++) {
+        PageVariant *p = &pageVariants[v];
+        if ((p->need & memFeats) != p->need)
+            continue;
+        PrintVariant("page   ", p->name, p == pageOps);
+        u32 flags = IrqSave();
+        u64 start = ReadTsc();
+        for (u32 off = 0; off < MEM_BENCH_BYTES; off += PAGE_SIZE)
+            p->Zero(dst + off);
+        u32 zero = (u32)(ReadTsc() - start);
+        start = ReadTsc();
+        for (u32 off = 0; off < MEM_BENCH_BYTES; off += PAGE_SIZE)
+            p->Copy(dst + off, src + off);
+        u32 copy = (u32)(ReadTsc() - start);
+        IrqRestore(flags);
+        Print(" zero ", F_White);  PrintRate(MEM_BENCH_BYTES, zero);
+        Print(" copy ", F_White);  PrintRate(MEM_BENCH_BYTES, copy);
+        Print("\n", F_White);
+    }
+}
+#endif
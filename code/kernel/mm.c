@@ -0,0 +1,580 @@
+//  mm.c         by OrangeYYC
+//  TinyOS 页缓存与文件映射
+//
+//  FRAME_BASE 开始的物理页框由本模块管理，用作页缓存和任务的私有页。页缓存以 (文件, 页号) 为键，
+//  同一个文件页在内存中只有一份: 多个任务映射同一个文件时共享同一个物理页，重复装入同一个文件
+//  也不再读硬盘。mmap 只登记映射的地址范围，页在第一次访问产生页错误时才装入;
+//  共享映射只读，私有映射在第一次写入时复制出任务自己的页
+//  写入文件时页缓存作为写回缓存: 写入的页成为脏页，不会被回收，由工作队列线程按脏页的时间或数量写回，
+//  写回时按扇区排序，硬盘上相邻的脏页合并为一条写命令；PageCacheSync 写回并让硬盘把缓存写到介质
+//  页框池之后的全部可用内存(包括直接映射之外和 4G 以上的内存)作为高端内存，用于任务的匿名内存和
+//  私有副本，内核通过每个处理器的临时映射窗口访问；高端内存用完时使用页框池中的页框
+//  所有数据由 mmLock 保护。任务开始运行后，读入页、写回和 fsync 都由工作队列线程在开中断、不持有 mmLock 时读写硬盘:
+//  读入中的页处于 FRAME_READING 状态，写回中的页处于 FRAME_WRITEBACK 状态，需要这些页的任务阻塞在 ioWaiters 中，
+//  完成后被唤醒并重新执行缺页的指令或系统调用；fsync 的任务阻塞到工作队列线程完成写回。
+//  启动过程中(以及主机测试中)没有其他线程，调用者直接读写硬盘。工作队列只有一个线程，硬盘的读写不会并发
+
+#include "common.h"
+
+#define FrameAddr(i)    (FRAME_BASE + (i) * PAGE_SIZE)
+#define FrameIndex(a)   (((a) - FRAME_BASE) / PAGE_SIZE)
+#define PAGE_SECTORS    (PAGE_SIZE / DISK_SECTOR_SIZE)
+
+static PageFrame frames[FRAME_COUNT];           // 页框描述符
+static u16       buckets[PAGE_CACHE_BUCKETS];   // 页缓存哈希表
+static u16       freeList   = FRAME_NONE;       // 空闲页框链表
+static u32       frameCount = 0;                // 内存中实际存在的页框数量
+static u32       clockHand  = 0;                // 回收缓存页时的扫描位置
+static u32       dirtyPages = 0;                // 脏页数量
+static u16       flushList[FRAME_COUNT];        // 写回时按扇区排序的脏页
+static Spinlock  mmLock     = {};
+static u32       ioAsync    = 0;                // 是否由工作队列线程读写硬盘
+static WaitQueue ioWaiters  = {};               // 等待页读入、写回完成的任务
+static u32       flushAll   = 0;                // 下一次后台写回写回所有脏页(写入时没有可用的页框)
+static FsEntry  *syncFile[MAX_TASKS];           // 每个任务等待 fsync 的文件
+
+static u64       highStart[HIGHMEM_RANGES];     // 高端内存区域中下一个未分配的页框
+static u64       highEnd[HIGHMEM_RANGES];       // 高端内存区域的结束地址
+static u32       highCount  = 0;                // 高端内存区域数量
+static u32       highPages  = 0;                // 高端内存的页数
+static u64       highFree   = 0;                // 任务结束时释放的高端内存页，链表指针保存在页的开头
+
+static VmArea    vmAreas[MAX_TASKS][MAX_VMAS];  // 每个任务的文件映射
+static u32       mmapNext[MAX_TASKS];           // 每个任务下一个映射的起始地址
+
+/* ========================== 物理页框 ========================== */
+// 页缓存哈希函数
+static u32 Bucket(u32 file, u32 index) {
+    return (file * 31 + index) % PAGE_CACHE_BUCKETS;
+}
+
+// 将缓存页 i 从哈希表中取下
+static void CacheUnlink(u32 i) {
+    u16 *link = &buckets[Bucket(frames[i].file, frames[i].index)];
+    while (*link != i)
+        link = &frames[*link].next;
+    *link = frames[i].next;
+}
+
+// 分配一个状态为 state 的页框，返回页框编号
+// 没有空闲页框时按时钟顺序回收一个没有被映射的缓存页，全部被映射时返回 FRAME_NONE
+static u32 FrameAlloc(u32 state) {
+    u32 i = freeList;
+    if (i != FRAME_NONE)
+        freeList = frames[i].next;
+    else {
+        for (u32 n = 0; n < frameCount && i == FRAME_NONE; n++) {
+            if (frames[clockHand].state == FRAME_CACHE && !frames[clockHand].refs) {
+                i = clockHand;
+                CacheUnlink(i);
+            }
+            clockHand = (clockHand + 1) % frameCount;
+        }
+        if (i == FRAME_NONE)
+            return FRAME_NONE;
+    }
+    frames[i].state = state;
+    frames[i].refs  = 0;
+    frames[i].next  = FRAME_NONE;
+    return i;
+}
+
+// 减少页框 i 的引用计数，私有页和页表不再被使用时释放，缓存页留在页缓存中
+static void FramePut(u32 i) {
+    if (--frames[i].refs || (frames[i].state != FRAME_ANON && frames[i].state != FRAME_TABLE))
+        return;
+    frames[i].state = FRAME_FREE;
+    frames[i].next  = freeList;
+    freeList = i;
+}
+
+/* ========================== 高端内存 ========================== */
+// 将物理地址 phys 所在的页映射到当前处理器的临时映射窗口，返回窗口的线性地址
+// 窗口在下一次映射前有效，需要在关中断状态下使用
+static u8 *KMap(u64 phys) {
+    u32 va = KMAP_BASE + ThisCpu()->id * PAGE_SIZE;
+    *KernelPte(va) = (phys & PAGE_ADDR_MASK) | PAGE_P | PAGE_W;
+    __asm__ __volatile__ ("invlpg (%0)" :: "r"(va) : "memory");
+    return (u8 *)va;
+}
+
+// 为任务分配一个私有页，返回物理地址，优先使用高端内存，都用完时返回 0
+// 先使用任务结束时释放的高端内存页，再按区域顺序分配
+static u64 UserFrameAlloc() {
+    if (highFree) {
+        u64 frame = highFree;
+        highFree  = *(u64 *)KMap(frame);
+        return frame;
+    }
+    for (u32 r = 0; r < highCount; r++)
+        if (highStart[r] < highEnd[r]) {
+            u64 frame = highStart[r];
+            highStart[r] += PAGE_SIZE;
+            return frame;
+        }
+    u32 i = FrameAlloc(FRAME_ANON);
+    if (i == FRAME_NONE)
+        return 0;
+    frames[i].refs = 1;
+    return FrameAddr(i);
+}
+
+// 释放任务的私有页 frame: 页框池中的页减少引用计数，高端内存的页放入 highFree 链表
+static void UserFramePut(u64 frame) {
+    if (frame >= FRAME_BASE && frame < FrameAddr(frameCount)) {
+        FramePut(FrameIndex((u32)frame));
+        return;
+    }
+    *(u64 *)KMap(frame) = highFree;
+    highFree = frame;
+}
+
+// 记录区域 [start, end) 中的高端内存
+static void HighAdd(u64 start, u64 end) {
+    start = (start + PAGE_SIZE - 1) & PAGE_ADDR_MASK;
+    end   = end & PAGE_ADDR_MASK;
+    if (start >= end || highCount == HIGHMEM_RANGES)
+        return;
+    highStart[highCount] = start;
+    highEnd[highCount]   = end;
+    highCount++;
+    highPages += (u32)((end - start) >> 12);
+}
+
+// 在内核线性地址 va 开始映射 size 字节新分配的清零内存，返回是否成功
+// 用于只在内核中访问的大块内存(帧缓冲合成器的离屏表面)，物理页不要求连续，优先使用高端内存，已映射的页不回收
+int MmKernelMap(u32 va, u32 size) {
+    u32 flags = SpinLockIrqSave(&mmLock);
+    u32 off;
+    for (off = 0; off < size; off += PAGE_SIZE) {
+        u64 frame = UserFrameAlloc();
+        if (!frame)
+            break;
+        *KernelPte(va + off) = frame | PAGE_P | PAGE_W;
+        __asm__ __volatile__ ("invlpg (%0)" :: "r"(va + off) : "memory");
+        PageZero((void *)(va + off));
+    }
+    SpinUnlockIrqRestore(&mmLock, flags);
+    return off >= size;
+}
+
+/* ========================== 页缓存 ========================== */
+// 从硬盘读入缓存页 i 在文件中的扇区，页中超出文件的部分填 0
+static void CacheRead(u32 i) {
+    u32 count = frames[i].sectors;
+    ReadDiskExtent(frames[i].file + frames[i].index * PAGE_SECTORS, count, FrameAddr(i));
+    memset((u8 *)FrameAddr(i) + count * DISK_SECTOR_SIZE, 0, PAGE_SIZE - count * DISK_SECTOR_SIZE);
+}
+
+// 在工作队列线程中读入所有 FRAME_READING 状态的页，读硬盘时开中断且不持有 mmLock，每读完一页唤醒等待的任务
+// 读入中的页不会被回收或释放，读入期间新出现的页会再次安排本工作
+static void FillWork(Work *work) {
+    u32 flags = SpinLockIrqSave(&mmLock);
+    for (u32 i = 0; i < frameCount; i++) {
+        if (frames[i].state != FRAME_READING)
+            continue;
+        SpinUnlockIrqRestore(&mmLock, flags);
+        CacheRead(i);
+        flags = SpinLockIrqSave(&mmLock);
+        frames[i].state = FRAME_CACHE;
+        WaitQueueWakeAll(&ioWaiters);
+    }
+    SpinUnlockIrqRestore(&mmLock, flags);
+}
+static Work fillWork = { 0, FillWork, 0 };
+
+// 取得文件 entry 第 index 页所在的页框并增加引用计数，调用时需持有 mmLock
+// 不在页缓存中时从硬盘读入: 启动过程中直接读入，任务运行后交给工作队列线程并返回 FRAME_WAIT，
+// 页正在读入时也返回 FRAME_WAIT；fill 为 0 时调用者将覆盖整页，不读硬盘；没有可用的页框时返回 FRAME_NONE
+static u32 CacheGet(FsEntry *entry, u32 index, int fill) {
+    u32 i = buckets[Bucket(entry->start, index)];
+    while (i != FRAME_NONE && (frames[i].file != entry->start || frames[i].index != index))
+        i = frames[i].next;
+    if (i != FRAME_NONE && frames[i].state == FRAME_READING)
+        return FRAME_WAIT;
+    if (i == FRAME_NONE) {
+        i = FrameAlloc(fill ? FRAME_READING : FRAME_CACHE);
+        if (i == FRAME_NONE)
+            return FRAME_NONE;
+        u32 first = index * PAGE_SECTORS;
+        u16 *bucket = &buckets[Bucket(entry->start, index)];
+        frames[i].file    = entry->start;
+        frames[i].index   = index;
+        frames[i].sectors = first >= entry->sectors ? 0 :
+                            entry->sectors - first < PAGE_SECTORS ? entry->sectors - first : PAGE_SECTORS;
+        frames[i].next    = *bucket;
+        *bucket = i;
+        if (fill && ioAsync) {
+            WorkSchedule(&fillWork);
+            return FRAME_WAIT;
+        }
+        if (fill) {
+            CacheRead(i);
+            frames[i].state = FRAME_CACHE;
+        }
+    }
+    frames[i].refs++;
+    return i;
+}
+
+// 经过页缓存从文件 entry 的 offset 处读取 len 字节到内核地址 dst，超出文件或没有可用的页框时返回 0
+// 页需要读入时调用者(装入线程等内核线程)阻塞，读入完成后继续
+int PageCacheRead(FsEntry *entry, u32 offset, void *dst, u32 len) {
+    if (offset > entry->size || len > entry->size - offset)
+        return 0;
+    u32 flags = SpinLockIrqSave(&mmLock);
+    u8 *d = (u8 *)dst;
+    while (len) {
+        u32 i = CacheGet(entry, offset / PAGE_SIZE, 1);
+        if (i == FRAME_WAIT) {
+            WaitQueueSleep(&ioWaiters, &process[ThisCpu()->readyPid]);
+            SpinUnlockIrqRestore(&mmLock, flags);
+            Yield();
+            flags = SpinLockIrqSave(&mmLock);
+            continue;
+        }
+        if (i == FRAME_NONE)
+            break;
+        u32 skip = offset % PAGE_SIZE;
+        u32 n    = len < PAGE_SIZE - skip ? len : PAGE_SIZE - skip;
+        u8 *s    = (u8 *)FrameAddr(i) + skip;
+        memcpy(d, s, n);
+        FramePut(i);
+        d += n;  offset += n;  len -= n;
+    }
+    SpinUnlockIrqRestore(&mmLock, flags);
+    return len == 0;
+}
+
+/* ========================== 写回 ========================== */
+// 脏页 i 在硬盘上的起始扇区
+static u32 FrameSector(u32 i) {
+    return frames[i].file + frames[i].index * PAGE_SECTORS;
+}
+
+// 写回文件 file(为 0 时为所有文件)中在 now 之前至少 age 个节拍变脏的页，调用时不能持有 mmLock
+// 持有 mmLock 时把这些页按扇区排序并改为 FRAME_WRITEBACK，随后释放 mmLock、开中断写硬盘，写回期间这些页不会被回收，
+// 写入这些页的任务等待写回完成；硬盘上相邻的页(包括相邻文件的页)合并为一条写命令，不满一页的页结束合并
+// 写入成功的页成为普通的缓存页，失败时返回 0，失败和没有写入的页恢复为脏页；每条命令完成后唤醒等待的任务
+// 只由工作队列线程(启动过程中和主机测试中为调用者)执行，同一时间只有一次写回使用 flushList
+static int CacheWriteBack(u32 file, u32 now, u32 age) {
+    u32 flags = SpinLockIrqSave(&mmLock);
+    u32 n = 0;
+    for (u32 i = 0; i < frameCount; i++) {
+        if (frames[i].state != FRAME_DIRTY || (file && frames[i].file != file) || now - frames[i].dirtied < age)
+            continue;
+        frames[i].state = FRAME_WRITEBACK;
+        dirtyPages--;
+        u32 k = n++;
+        for (; k > 0 && FrameSector(flushList[k - 1]) > FrameSector(i); k--)
+            flushList[k] = flushList[k - 1];
+        flushList[k] = i;
+    }
+    SpinUnlockIrqRestore(&mmLock, flags);
+    int ok = 1;
+    for (u32 k = 0; k < n; ) {
+        u32 sector = FrameSector(flushList[k]), count = 0, m = 0;
+        u32 pages[ATA_MAX_SECTORS / PAGE_SECTORS];
+        while (k + m < n && m < ATA_MAX_SECTORS / PAGE_SECTORS && FrameSector(flushList[k + m]) == sector + count) {
+            u32 i = flushList[k + m];
+            pages[m++] = FrameAddr(i);
+            count += frames[i].sectors;
+            if (frames[i].sectors < PAGE_SECTORS)
+                break;
+        }
+        ok = WriteDiskPages(sector, count, pages);
+        flags = SpinLockIrqSave(&mmLock);
+        for (; ok && m > 0; m--, k++)
+            frames[flushList[k]].state = FRAME_CACHE;
+        for (; !ok && k < n; k++) {
+            frames[flushList[k]].state = FRAME_DIRTY;
+            dirtyPages++;
+        }
+        WaitQueueWakeAll(&ioWaiters);
+        SpinUnlockIrqRestore(&mmLock, flags);
+    }
+    return ok;
+}
+
+// 把文件 entry(为 0 时为所有文件)的脏页写回硬盘，并让硬盘把缓存中的数据写到介质，成功时返回 1
+// 开中断读写硬盘，由工作队列线程(启动过程中和主机测试中为调用者)执行
+int PageCacheSync(FsEntry *entry) {
+    return CacheWriteBack(entry ? entry->start : 0, 0, 0) && FlushDisk();
+}
+
+// 后台写回: 脏页数量达到 DIRTY_BACKGROUND 或写入时没有可用的页框时写回所有脏页，
+// 否则只写回变脏超过 DIRTY_EXPIRE 个节拍的页；不让硬盘写出缓存，需要保证数据写到介质时使用 PageCacheSync
+void PageCacheWriteback() {
+    if (dirtyPages >= DIRTY_BACKGROUND || flushAll) {
+        flushAll = 0;
+        CacheWriteBack(0, 0, 0);
+    } else if (dirtyPages) {
+        CacheWriteBack(0, (u32)GetTicks(), DIRTY_EXPIRE);
+    }
+}
+
+// 在工作队列线程中执行后台写回
+static void FlushWork(Work *work) {
+    PageCacheWriteback();
+}
+static Work flushWork = { 0, FlushWork, 0 };
+
+// 在工作队列线程中完成任务的 fsync: 依次写回请求的文件，把结果写到任务的 eax 后唤醒任务
+static void SyncWork(Work *work) {
+    for (u32 pid = 0; pid < MAX_TASKS; pid++) {
+        u32 flags = SpinLockIrqSave(&mmLock);
+        FsEntry *entry = syncFile[pid];
+        syncFile[pid] = 0;
+        SpinUnlockIrqRestore(&mmLock, flags);
+        if (!entry)
+            continue;
+        process[pid].regs.eax = PageCacheSync(entry) ? 0 : -1;
+        SchedWakeup(&process[pid]);
+    }
+}
+static Work syncWork = { 0, SyncWork, 0 };
+
+// 任务 pcb 把文件 entry 写回硬盘，任务运行后交给工作队列线程并使任务阻塞，返回 SYSCALL_BLOCKED，
+// 完成后由工作队列线程填写返回值(成功为 0，失败为 -1)并唤醒任务；没有工作队列线程时直接写回
+u32 PageCacheFsync(PCB *pcb, FsEntry *entry) {
+    if (!ioAsync)
+        return PageCacheSync(entry) ? 0 : -1;
+    u32 flags = SpinLockIrqSave(&mmLock);
+    syncFile[pcb->pid] = entry;
+    SchedSleep(pcb);
+    WorkSchedule(&syncWork);
+    SpinUnlockIrqRestore(&mmLock, flags);
+    return SYSCALL_BLOCKED;
+}
+
+// 经过页缓存把内核地址 src 的 len 字节写到文件 entry 的 offset 处，成功时返回 1，超出文件或没有可用的页框时返回 0
+// 写入的页成为脏页，之后写回硬盘；只覆盖页的一部分时先读入整页，没有可用的页框时先写回所有脏页
+// 页需要读入、正在写回或需要等待写回腾出页框时任务 pcb 阻塞并返回 PAGE_WAIT，已经写入的部分保留，任务被唤醒后重新写入
+int PageCacheWrite(FsEntry *entry, u32 offset, void *src, u32 len, PCB *pcb) {
+    if (offset > entry->size || len > entry->size - offset)
+        return 0;
+    u32 flags = SpinLockIrqSave(&mmLock);
+    u8 *s = (u8 *)src;
+    while (len) {
+        u32 index = offset / PAGE_SIZE;
+        u32 skip  = offset % PAGE_SIZE;
+        u32 n     = len < PAGE_SIZE - skip ? len : PAGE_SIZE - skip;
+        u32 i     = CacheGet(entry, index, n < PAGE_SIZE);
+        if (i == FRAME_NONE && dirtyPages && ioAsync) {
+            flushAll = 1;
+            WorkSchedule(&flushWork);
+            i = FRAME_WAIT;
+        } else if (i == FRAME_NONE && dirtyPages) {
+            SpinUnlockIrqRestore(&mmLock, flags);
+            int ok = CacheWriteBack(0, 0, 0);
+            flags = SpinLockIrqSave(&mmLock);
+            if (ok)
+                i = CacheGet(entry, index, n < PAGE_SIZE);
+        }
+        if (i < FRAME_WAIT && frames[i].state == FRAME_WRITEBACK) {
+            FramePut(i);
+            i = FRAME_WAIT;
+        }
+        if (i == FRAME_WAIT) {
+            WaitQueueSleep(&ioWaiters, pcb);
+            SpinUnlockIrqRestore(&mmLock, flags);
+            return PAGE_WAIT;
+        }
+        if (i == FRAME_NONE)
+            break;
+        memcpy((u8 *)FrameAddr(i) + skip, s, n);
+        if (frames[i].state != FRAME_DIRTY) {
+            frames[i].state   = FRAME_DIRTY;
+            frames[i].dirtied = (u32)GetTicks();
+            dirtyPages++;
+        }
+        FramePut(i);
+        s += n;  offset += n;  len -= n;
+    }
+    SpinUnlockIrqRestore(&mmLock, flags);
+    return len == 0;
+}
+
+#ifndef HOSTED
+// 检查是否需要后台写回，由时钟中断的下半部每个节拍调用，now 为当前的时钟节拍
+// 脏页数量达到 DIRTY_BACKGROUND 时立即写回，否则每 FLUSH_PERIOD 个节拍检查一次脏页的时间
+void MmFlushTick(u32 now) {
+    if (dirtyPages >= DIRTY_BACKGROUND || (dirtyPages && now % FLUSH_PERIOD == 0))
+        WorkSchedule(&flushWork);
+}
+#endif
+
+/* ========================== 文件映射 ========================== */
+// 为任务 pcb 建立文件 name 的映射，返回映射的起始虚拟地址，失败时返回 -1
+// 从文件开头映射 length 字节，length 为 0 或超过文件大小时映射整个文件；此时不装入任何页
+// flags 为 MAP_ANON 时建立 length 字节的匿名内存，不使用 name
+u32 Mmap(PCB *pcb, char *name, u32 length, u32 flags) {
+    FsEntry *entry = 0;
+    if (pcb->pageDirBase == PAGE_DIR_BASE)
+        return -1;
+    if (flags == MAP_ANON) {
+        if (!length || length > MMAP_END - MMAP_BASE)
+            return -1;
+    } else {
+        entry = FsLookup(name);
+        if (!entry || !entry->size || (flags != MAP_SHARED && flags != MAP_PRIVATE))
+            return -1;
+        if (!length || length > entry->size)
+            length = entry->size;
+    }
+    u32 size  = (length + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    u32 start = -1;
+    u32 irq   = SpinLockIrqSave(&mmLock);
+    for (u32 i = 0; i < MAX_VMAS; i++) {
+        VmArea *vma = &vmAreas[pcb->pid][i];
+        if (vma->start || size > MMAP_END - mmapNext[pcb->pid])
+            continue;
+        start = mmapNext[pcb->pid];
+        vma->start  = start;
+        vma->end    = start + size;
+        vma->file   = entry;
+        vma->flags  = flags;
+        mmapNext[pcb->pid] += size;
+        break;
+    }
+    SpinUnlockIrqRestore(&mmLock, irq);
+    return start;
+}
+
+// 返回任务 pcb 文件映射区域中地址 addr 的页表项，页表不存在时从页框池分配，失败时返回 0
+static u64 *UserPte(PCB *pcb, u32 addr) {
+    u64 *PDE = (u64 *)(PROCESS_PAGE_START + pcb->pid * PROCESS_PAGE_SIZE + PROCESS_PD1_OFFSET)
+             + ((addr >> 21) & (PAGE_ENTRIES - 1));
+    if (!(*PDE & PAGE_P)) {
+        u32 i = FrameAlloc(FRAME_TABLE);
+        if (i == FRAME_NONE)
+            return 0;
+        frames[i].refs = 1;
+        PageZero((void *)FrameAddr(i));
+        *PDE = FrameAddr(i) | PAGE_P | PAGE_U | PAGE_W;
+    }
+    return (u64 *)((u32)*PDE & ~(PAGE_SIZE - 1)) + ((addr >> 12) & (PAGE_ENTRIES - 1));
+}
+
+// 处理任务 pcb 在地址 addr 的页错误，err 为处理器给出的错误码，在关中断状态下调用
+// 缺页时映射页缓存中的页(只读)或分配清零的匿名页，写入私有映射时复制出任务自己的页；
+// 文件页需要从硬盘读入时任务阻塞，读入完成后被唤醒，重新执行缺页的指令
+// 地址不在映射中、写入共享映射或没有可用的页框时返回 0
+int MmFault(PCB *pcb, u32 addr, u32 err) {
+    pcb->usage.faults++;
+    if (pcb->pageDirBase == PAGE_DIR_BASE)
+        return 0;
+    SpinLock(&mmLock);
+    VmArea *vma = 0;
+    for (u32 i = 0; i < MAX_VMAS; i++)
+        if (addr >= vmAreas[pcb->pid][i].start && addr < vmAreas[pcb->pid][i].end)
+            vma = &vmAreas[pcb->pid][i];
+    int ok = 0;
+    if (!vma || ((err & PF_WRITE) && vma->flags == MAP_SHARED))
+        goto out;
+    u32  page = addr & ~(PAGE_SIZE - 1);
+    u64 *pte  = UserPte(pcb, page);
+    if (!pte)
+        goto out;
+    // 匿名内存缺页，分配清零的页
+    if (!vma->file && !(*pte & PAGE_P)) {
+        u64 frame = UserFrameAlloc();
+        if (!frame)
+            goto out;
+        PageZero(KMap(frame));
+        *pte = frame | PAGE_P | PAGE_U | PAGE_W;
+    }
+    // 文件映射缺页，映射页缓存中的页
+    if (!(*pte & PAGE_P)) {
+        u32 i = CacheGet(vma->file, (page - vma->start) / PAGE_SIZE, 1);
+        if (i == FRAME_WAIT) {
+            WaitQueueSleep(&ioWaiters, pcb);
+            ok = 1;
+            goto out;
+        }
+        if (i == FRAME_NONE)
+            goto out;
+        *pte = FrameAddr(i) | PAGE_P | PAGE_U;
+    }
+    // 写入私有映射，复制出任务自己的页并解除对缓存页的引用
+    if ((err & PF_WRITE) && !(*pte & PAGE_W)) {
+        u64 frame = UserFrameAlloc();
+        if (!frame)
+            goto out;
+        u32 src = (u32)*pte & ~(PAGE_SIZE - 1);
+        PageCopy(KMap(frame), (void *)src);
+        FramePut(FrameIndex(src));
+        *pte = frame | PAGE_P | PAGE_U | PAGE_W;
+    }
+    __asm__ __volatile__ ("invlpg (%0)" :: "r"(page) : "memory");
+    ok = 1;
+out:
+    SpinUnlock(&mmLock);
+    return ok;
+}
+
+// 释放任务 pcb 的文件映射，在任务结束(exit 或因异常被结束)时调用，任务不会再回到 Ring3
+// 遍历映射区域的页表: 映射的缓存页减少引用计数，匿名页和私有副本释放，页表归还页框池；
+// 清除页表项、映射和下一个映射的地址，同一编号的任务重新装入后从空的映射区域开始
+void MmRelease(PCB *pcb) {
+    if (pcb->pageDirBase == PAGE_DIR_BASE)
+        return;
+    u64 *PD1   = (u64 *)(PROCESS_PAGE_START + pcb->pid * PROCESS_PAGE_SIZE + PROCESS_PD1_OFFSET);
+    u32  flags = SpinLockIrqSave(&mmLock);
+    for (u32 d = 0; d < PAGE_ENTRIES; d++) {
+        if (!(PD1[d] & PAGE_P))
+            continue;
+        u64 *PT = (u64 *)((u32)PD1[d] & ~(PAGE_SIZE - 1));
+        for (u32 t = 0; t < PAGE_ENTRIES; t++) {
+            if (PT[t] & PAGE_P)
+                UserFramePut(PT[t] & PAGE_ADDR_MASK);
+            PT[t] = 0;
+        }
+        FramePut(FrameIndex((u32)PT));
+        PD1[d] = 0;
+    }
+    memset(vmAreas[pcb->pid], 0, sizeof(vmAreas[pcb->pid]));
+    mmapNext[pcb->pid] = MMAP_BASE;
+    SpinUnlockIrqRestore(&mmLock, flags);
+}
+
+/* ========================== 初始化 ========================== */
+// 此后页缓存的读盘交给工作队列线程，在创建工作队列线程之后、任务开始运行之前调用
+void MmIoStart() {
+    ioAsync = 1;
+}
+
+// 页缓存初始化函数，将内存中存在的页框加入空闲链表，记录页框池之后的可用内存，在开启分页之后调用
+void MmInit() {
+    SpinInit(&mmLock, "mm");
+    ioAsync  = 0;
+    flushAll = 0;
+    highFree = 0;
+    ioWaiters.head = ioWaiters.count = 0;
+    memset(syncFile, 0, sizeof(syncFile));
+    frameCount = RAMSize > FRAME_BASE ? (RAMSize - FRAME_BASE) / PAGE_SIZE : 0;
+    if (frameCount > FRAME_COUNT)
+        frameCount = FRAME_COUNT;
+    for (u32 i = 0; i < PAGE_CACHE_BUCKETS; i++)
+        buckets[i] = FRAME_NONE;
+    for (u32 i = frameCount; i-- > 0; ) {
+        frames[i].state = FRAME_FREE;
+        frames[i].next  = freeList;
+        freeList = i;
+    }
+    for (u32 i = 0; i < MAX_TASKS; i++)
+        mmapNext[i] = MMAP_BASE;
+    // 页框池之后的可用内存作为高端内存
+    u64 poolEnd = FRAME_BASE + frameCount * PAGE_SIZE;
+    for (u32 i = 0; i < MemoryEntryCount; i++) {
+        u64 base = (u64)ARDs[i].BaseAddrHigh << 32 | ARDs[i].BaseAddrLow;
+        u64 end  = base + ((u64)ARDs[i].LengthHigh << 32 | ARDs[i].LengthLow);
+        if (ARDs[i].Type == 1 && end > poolEnd)
+            HighAdd(base > poolEnd ? base : poolEnd, end);
+    }
+    Print("[KERNEL] Page Cache: ", F_Cyan | L_Light);
+    PrintDecimal(frameCount, F_White | L_Light);
+    Print(" Frames, High Memory: ", F_White);
+    PrintDecimal(highPages >> 8, F_White | L_Light);
+    Print("M\n", F_White);
+}
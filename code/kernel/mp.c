@@ -0,0 +1,148 @@
+//  mp.c         by OrangeYYC
+//  TinyOS 解析 ACPI 和 MP 配置表，获取处理器、APIC 与 ISA 中断连接的信息
+
+#include "common.h"
+
+/* ========================== 表的查找与校验 ========================== */
+// 计算 len 字节的校验和，结构完整时结果为 0
+static u8 Checksum(u8 *addr, u32 len) {
+    u8 sum = 0;
+    for (u32 i = 0; i < len; i++)
+        sum += addr[i];
+    return sum;
+}
+
+// 比较 len 字节的签名
+static int MatchSignature(u8 *addr, char *sig, u32 len) {
+    for (u32 i = 0; i < len; i++)
+        if (addr[i] != (u8)sig[i])
+            return 0;
+    return 1;
+}
+
+// 在 [base, base + len) 中按 16 字节对齐查找签名为 sig 且校验和正确的结构
+static u8 *SearchTable(u32 base, u32 len, char *sig, u32 sigLen, u32 sumLen) {
+    for (u32 addr = base; addr + sumLen <= base + len; addr += 16)
+        if (MatchSignature((u8 *)addr, sig, sigLen) && Checksum((u8 *)addr, sumLen) == 0)
+            return (u8 *)addr;
+    return 0;
+}
+
+// 依次在扩展 BIOS 数据区的第一个 1K、基本内存的最后 1K 和 BIOS ROM 中查找
+static u8 *SearchBiosAreas(char *sig, u32 sigLen, u32 sumLen) {
+    u32 ebda = (*(u16 *)0x40e) << 4;
+    u32 base = ((*(u16 *)0x413) << 10) - 0x400;
+    u8 *p;
+    if (ebda && (p = SearchTable(ebda, 0x400, sig, sigLen, sumLen)))
+        return p;
+    if ((p = SearchTable(base, 0x400, sig, sigLen, sumLen)))
+        return p;
+    return SearchTable(0xe0000, 0x20000, sig, sigLen, sumLen);
+}
+
+// 记录一个处理器
+static void AddCpu(u32 apicId) {
+    if (cpuCount >= MAX_CPUS)
+        return;
+    cpus[cpuCount].id     = cpuCount;
+    cpus[cpuCount].apicId = apicId;
+    cpuCount++;
+}
+
+/* ========================== ACPI MADT 解析 ========================== */
+// 通过 RSDP -> RSDT -> MADT 获取本地 APIC 地址、处理器和 IO APIC 信息
+static int ParseAcpi() {
+    u8 *rsdp = SearchBiosAreas("RSD PTR ", 8, 20);
+    if (!rsdp)
+        return 0;
+    u8 *rsdt = (u8 *)*(u32 *)(rsdp + 16);
+    if (!MatchSignature(rsdt, "RSDT", 4))
+        return 0;
+    u32 entries = (*(u32 *)(rsdt + 4) - 36) / 4;
+    for (u32 i = 0; i < entries; i++) {
+        u8 *madt = (u8 *)((u32 *)(rsdt + 36))[i];
+        if (!MatchSignature(madt, "APIC", 4))
+            continue;
+        u32 length = *(u32 *)(madt + 4);
+        lapicBase  = *(u32 *)(madt + 36);
+        // 依次处理 MADT 中的表项
+        for (u8 *e = madt + 44; e < madt + length; e += e[1]) {
+            if (e[1] == 0)
+                break;
+            if (e[0] == 0 && (*(u32 *)(e + 4) & 1))        // 已启用的本地 APIC
+                AddCpu(e[3]);
+            else if (e[0] == 1 && !ioapicBase) {            // IO APIC
+                ioapicId   = e[2];
+                ioapicBase = *(u32 *)(e + 4);
+            } else if (e[0] == 2 && e[3] < 16) {            // ISA 中断重定向
+                irqGsi[e[3]]   = *(u32 *)(e + 4);
+                irqFlags[e[3]] = *(u16 *)(e + 8);
+            }
+        }
+        return cpuCount > 0;
+    }
+    return 0;
+}
+
+/* ========================== MP 配置表解析 ========================== */
+// 通过 MP 浮动指针结构找到配置表，获取处理器和 IO APIC 信息
+static int ParseMp() {
+    u8 *mpf = SearchBiosAreas("_MP_", 4, 16);
+    if (!mpf || *(u32 *)(mpf + 4) == 0)             // 没有配置表时使用默认配置，此处不支持
+        return 0;
+    u8 *conf = (u8 *)*(u32 *)(mpf + 4);
+    if (!MatchSignature(conf, "PCMP", 4) || Checksum(conf, *(u16 *)(conf + 4)) != 0)
+        return 0;
+    lapicBase = *(u32 *)(conf + 36);
+    u32 count = *(u16 *)(conf + 34);
+    u32 isaBus = -1;
+    u8 *e     = conf + 44;
+    for (u32 i = 0; i < count; i++) {
+        if (e[0] == 0) {                            // 处理器表项 20 字节
+            if (e[3] & 1)
+                AddCpu(e[1]);
+            e += 20;
+        } else {                                    // 其他表项 8 字节
+            if (e[0] == 1 && MatchSignature(e + 2, "ISA", 3))   // ISA 总线
+                isaBus = e[1];
+            else if (e[0] == 2 && (e[3] & 1) && !ioapicBase) {  // IO APIC
+                ioapicId   = e[1];
+                ioapicBase = *(u32 *)(e + 4);
+            } else if (e[0] == 3 && e[1] == 0 && e[4] == isaBus && e[5] < 16) {  // ISA 中断连接
+                irqGsi[e[5]]   = e[7];
+                irqFlags[e[5]] = *(u16 *)(e + 2);
+            }
+            e += 8;
+        }
+    }
+    return cpuCount > 0;
+}
+
+/* ========================== 多处理器信息初始化 ========================== */
+// 多处理器信息初始化函数，需要在开启分页之前调用
+// 优先使用 ACPI，找不到时使用 MP 配置表，都找不到时按单处理器运行
+void MpInit() {
+    Print("[KERNEL] Detecting Processors\n", F_Cyan | L_Light);
+    // ISA 中断默认直接连接到 IO APIC 的同号输入，边沿触发，高电平有效
+    for (int i = 0; i < 16; i++) {
+        irqGsi[i]   = i;
+        irqFlags[i] = 0;
+    }
+    cpuCount = 0;
+    if (!ParseAcpi()) {
+        cpuCount = 0;
+        ioapicBase = 0;
+        if (!ParseMp()) {
+            cpuCount  = 1;
+            lapicBase = 0;
+            ioapicBase = 0;
+        }
+    }
+    Print("CPUs: ", F_White);
+    PrintDecimal(cpuCount, F_White | L_Light);
+    Print("  Local APIC: ", F_White);
+    PrintNumber(lapicBase, F_White | L_Light);
+    Print("  IO APIC: ", F_White);
+    PrintNumber(ioapicBase, F_White | L_Light);
+    Print("\n", F_White);
+}
\ No newline at end of file
@@ -5,49 +5,228 @@
 #include "elf.h"
 
 /* ========================== 任务的基本信息 ========================== */
+u32 procCount = 0;                                      // 进程表中已使用的表项数量(任务与内核线程)
+#ifdef BENCH_SUITE
+// 基准测试套件: 驱动任务 bench1 和陪同切换的 bench2，使用轮转调度使让出处理器时切换到对方
+const int taskCount = 2;
+u32 priority[MAX_TASKS] = { 100, 100 };
+u32 schedPolicy[MAX_TASKS] = { SCHED_RR, SCHED_RR };
+char *taskName[MAX_TASKS] = { "bench1", "bench2" };
+#else
 const int taskCount = 4;                                // 要加载的任务数量
 u32 priority[MAX_TASKS] = { 800, 500, 250, 100 };       // 每个任务的优先级别
+u32 schedPolicy[MAX_TASKS] = {                          // 每个任务的调度策略
+    SCHED_POLICY, SCHED_POLICY, SCHED_POLICY, SCHED_POLICY
+};
+char *taskName[MAX_TASKS] = {                           // 每个任务在文件系统中的文件名
+    "task1", "task2", "task3", "task4"
+};
+#endif
 
 /* ========================== 进程初始化设置函数 ========================== */
-// 装入进程的函数
-static void ReadProcessToMemory(const int pid) {
-    // 将进程 elf 文件从硬盘读取到缓冲区
-    u32 startSector = pid * PROCESS_TOTAL_SECTOR + PROCESS_START_SECTOR;
-    u32 tempAddr    = PROCESS_LOAD_BUFFER;
-    for (int i = 0; i < PROCESS_TOTAL_SECTOR; i++)
-        ReadDisk(startSector + i, tempAddr + i * DISK_SECTOR_SIZE);
-    // 解析 elf 文件头并找到需要装入的段 (此处默认任务的第一个段为待装入段)
-    Elf32_Ehdr *header  = (Elf32_Ehdr *)PROCESS_LOAD_BUFFER;
-    Elf32_Phdr *pHeader = (Elf32_Phdr *)(PROCESS_LOAD_BUFFER + header->e_phoff);
-    u32 size  = pHeader->p_memsz;                           // 进程大小
-    u32 vaddr = pid * PROCESS_PSIZE + PROCESS_PSTART;       // 进程待装入的物理地址
-    u32 faddr = pHeader->p_offset + PROCESS_LOAD_BUFFER;    // 待装入段的文件偏移
-    // 复制文件到对应位置
-    u8 *f = (u8 *)faddr;
-    u8 *v = (u8 *)vaddr;
-    for (int i = 0; i < size; i++)
-        v[i] = f[i];
+// 装入进程的函数，成功时返回 0，失败时返回错误信息
+// 经过页缓存读取 elf 文件，再次装入同一个程序时不需要读硬盘；按页分段复制，
+// 在装入线程中执行时每页之间恢复中断，已经装入的任务可以继续运行
+char *ReadProcessToMemory(const int pid) {
+    Elf32_Ehdr header;
+    Elf32_Phdr pHeader;
+    // 在文件系统中按名称查找任务，解析 elf 文件头并找到需要装入的段 (此处默认任务的第一个段为待装入段)
+    FsEntry *entry = FsLookup(taskName[pid]);
+    if (!entry)
+        return " not found!";
+    if (!PageCacheRead(entry, 0, &header, sizeof(header)) || memcmp(header.e_ident, ELFMAG, SELFMAG)
+        || !header.e_phnum || !PageCacheRead(entry, header.e_phoff, &pHeader, sizeof(pHeader)))
+        return " is not a valid elf file!";
+    u32 size = pHeader.p_memsz;                             // 进程大小
+    if (size > PROCESS_PSIZE || pHeader.p_filesz > size)
+        return " does not fit in its memory window!";
+    // 复制文件中的部分到进程待装入的物理地址，其余部分填 0
+    u8 *v = (u8 *)(pid * PROCESS_PSIZE + PROCESS_PSTART);
+    for (u32 done = 0, n; done < pHeader.p_filesz; done += n) {
+        u32 offset = pHeader.p_offset + done;
+        n = PAGE_SIZE - offset % PAGE_SIZE;
+        if (n > pHeader.p_filesz - done)
+            n = pHeader.p_filesz - done;
+        if (!PageCacheRead(entry, offset, v + done, n))
+            return " is not a valid elf file!";
+    }
+    memset(v + pHeader.p_filesz, 0, size - pHeader.p_filesz);
+    return 0;
 }
 
 // 设置进程的页表
 void SetProcessPageTable(int pid) {
-    // 计算页目录和页表的位置
-    u32 PDECount = RAMSize / 0x400000 + (RAMSize % 0x400000 > 0 ? 1 : 0);
-    u32 *PDE     = (u32*)(PROCESS_PDE_START + pid * PROCESS_PTE_SIZE);
-    u32 *PTE     = (u32*)(PROCESS_PTE_START + pid * PROCESS_PTE_SIZE);
-    // 对于内核部分设置 线性地址 = 虚拟地址 的页表
-    // 对于用户部分设置 线性地址 = 虚拟地址 + PROCESS_PSIZE * pid
-    for (u32 i = 0; i < PDECount; i++)
-        PDE[i] = ((u32)PTE + (i<<12)) | PAGE_P | PAGE_U | PAGE_W;
-    for (u32 i = 0; i < PDECount * 1024; i++)
-        if (i < 256)
-            PTE[i] = (i<<12) | PAGE_P | PAGE_U | PAGE_W;
+    // 计算页目录指针表、页目录和页表的位置
+    u32  base       = PROCESS_PAGE_START + pid * PROCESS_PAGE_SIZE;
+    u64 *PDPT       = (u64*) base;
+    u64 *PD0        = (u64*)(base + PROCESS_PD0_OFFSET);
+    u64 *PT0        = (u64*)(base + PROCESS_PT0_OFFSET);
+    u64 *PD1        = (u64*)(base + PROCESS_PD1_OFFSET);
+    u64 *kernelPDPT = (u64*) PAGE_DIR_BASE;
+    u64 *kernelPD0  = (u64*) PAGE_PD_BASE;
+    // 0 -> 1G 使用进程私有的页目录，其中 0 -> 2M 使用私有的页表，其余页目录项与内核共享
+    // 1G -> 2G 为文件映射区域，页表在页错误时分配；2G -> 4G 与内核共享页目录
+    PDPT[0] = (u32)PD0 | PAGE_P;
+    PDPT[1] = (u32)PD1 | PAGE_P;
+    PDPT[2] = kernelPDPT[2];
+    PDPT[3] = kernelPDPT[3];
+    PD0[0]  = (u32)PT0 | PAGE_P | PAGE_U | PAGE_W;
+    for (u32 i = 1; i < PAGE_ENTRIES; i++)
+        PD0[i] = kernelPD0[i];
+    for (u32 i = 0; i < PAGE_ENTRIES; i++)
+        PD1[i] = 0;
+    // 对于内核部分设置 线性地址 = 虚拟地址 的页表，只有显存可以在 Ring3 访问
+    // 对于用户部分(0x100000 开始的 PROCESS_PSIZE 大小)设置 线性地址 = 虚拟地址 + PROCESS_PSIZE * pid
+    for (u32 i = 0; i < PAGE_ENTRIES; i++)
+        if (i >= 256 && i < 256 + PROCESS_PSIZE / 0x1000)
+            PT0[i] = ((i<<12) + PROCESS_PSIZE * pid) | PAGE_P | PAGE_U | PAGE_W;
+        else if (i >= 0xb8 && i < 0xc0)
+            PT0[i] = (i<<12) | PAGE_P | PAGE_U | PAGE_W;
         else
-            PTE[i] = ((i<<12) + PROCESS_PSIZE * pid) | PAGE_P | PAGE_U | PAGE_W;
-    process[pid].pageDirBase = (u32)PDE;
+            PT0[i] = (i<<12) | PAGE_P | PAGE_W;
+    process[pid].pageDirBase = (u32)PDPT;
+}
+
+/* ========================== 用户地址空间 ========================== */
+// 检查 [va, va + len) 是否在任务 pcb 可以访问的地址范围内
+int UserRangeOk(PCB *pcb, u32 va, u32 len) {
+    if (pcb->pageDirBase == PAGE_DIR_BASE)
+        return 1;
+    return va >= PROCESS_PSTART && len <= PROCESS_PSIZE && va - PROCESS_PSTART <= PROCESS_PSIZE - len;
+}
+
+#ifndef HOSTED
+// 在任务 pcb 的地址 va 与内核地址 kernel 之间复制 len 字节，toUser 为 1 时复制到任务，需要在关中断状态下调用
+// 当前页表不是该任务的页表时，临时切换到内核页表，按任务的物理地址复制
+static void CopyUser(PCB *pcb, u32 va, u8 *kernel, u32 len, int toUser) {
+    u32 cr3;
+    __asm__ __volatile__ ("movl %%cr3, %0" : "=r"(cr3));
+    u8 *user = (u8 *)va;
+    if (pcb->pageDirBase != PAGE_DIR_BASE && cr3 != pcb->pageDirBase) {
+        user = (u8 *)(va + pcb->pid * PROCESS_PSIZE);
+        __asm__ __volatile__ ("movl %0, %%cr3" :: "r"(PAGE_DIR_BASE) : "memory");
+    }
+    if (toUser)
+        memcpy(user, kernel, len);
+    else
+        memcpy(kernel, user, len);
+    if (user != (u8 *)va)
+        __asm__ __volatile__ ("movl %0, %%cr3" :: "r"(cr3) : "memory");
+}
+
+// 将 len 字节从内核地址 src 复制到任务 pcb 的地址 va
+void CopyToUser(PCB *pcb, u32 va, void *src, u32 len) {
+    CopyUser(pcb, va, src, len, 1);
+}
+
+// 将 len 字节从任务 pcb 的地址 va 复制到内核地址 dst
+void CopyFromUser(PCB *pcb, u32 va, void *dst, u32 len) {
+    CopyUser(pcb, va, dst, len, 0);
+}
+
+#endif
+
+/* ========================== 内核线程 ========================== */
+// 创建内核线程，返回其 pid，进程表已满时返回 -1
+// 内核线程运行在 Ring1，使用覆盖全部地址空间的段和内核页表，可以直接访问内核的数据和函数，
+// IOPL 为 1 因此可以开关中断；线程被中断时寄存器与用户任务一样保存在进程表中，
+// 需要睡眠时设置阻塞状态后调用 Yield() 让出处理器
+u32 KernelThreadCreate(void (*entry)(), u32 priority, u32 policy) {
+    if (procCount >= MAX_TASKS)
+        return -1;
+    u32 pid  = procCount;
+    PCB *pcb = &process[pid];
+    pcb->pid      = pid;
+    pcb->priority = priority;
+    // 填充 GDT 表中的 LDT 描述符，初始化局部描述符表
+    SetDesEntry(&gdt[INDEX_LDT_FIRST + pid], (u32)pcb->ldts, LDT_SIZE * sizeof(Descriptor) - 1, DA_LDT);
+    pcb->ldtSelector = SELECTOR_LDT_FIRST + 0x8 * pid;
+    SetDesEntry(&pcb->ldts[0], 0, 0xfffff, DA_C | DA_DPL1 | DA_32 | DA_LIMIT_4K);   // Ring1 的平坦代码段
+    SetDesEntry(&pcb->ldts[1], 0, 0xfffff, DA_DRW | DA_DPL1 | DA_32 | DA_LIMIT_4K); // Ring1 的平坦数据段
+    // 初始化段寄存器
+    pcb->regs.cs = (0x0 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL1;
+    pcb->regs.ds = (0x8 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL1;
+    pcb->regs.es = (0x8 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL1;
+    pcb->regs.fs = (0x8 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL1;
+    pcb->regs.ss = (0x8 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL1;
+    pcb->regs.gs = (SELECTOR_VIDEO & SA_RPL_MASK) | SA_RPL1;
+    // 从 entry 开始执行，使用按 pid 分配的栈
+    pcb->regs.eip    = (u32)entry;
+    pcb->regs.esp    = KTHREAD_STACK_BASE + (pid + 1) * KTHREAD_STACK_SIZE;
+    pcb->regs.eflags = 0x1202;
+    pcb->pageDirBase = PAGE_DIR_BASE;
+    procCount++;
+    SchedSetup(pcb, policy);
+    return pid;
+}
+
+#ifndef HOSTED
+/* ========================== 分阶段装入任务 ========================== */
+static u32 loaderPid    = -1;       // 装入线程的 pid
+static u64 loadStart    = 0;        // 开始装入任务的时间戳
+static u64 firstTaskTsc = 0;        // 第一次进入用户任务的时间戳
+static u64 allTasksTsc  = 0;        // 最后一个任务加入调度的时间戳
+
+// 显示任务装入的错误信息
+static void LoadError(const int pid, char *message) {
+    Print("[KERNEL] Error: ", F_Red | L_Light);
+    Print(taskName[pid], F_Red | L_Light);
+    Print(message, F_Red | L_Light);
+    Print("\n", F_Red | L_Light);
+}
+
+// 装入任务 pid 的映像并设置页表，随后加入调度，失败时返回错误信息，任务保持未使用状态
+static char *LoadProcess(int pid) {
+    char *error = ReadProcessToMemory(pid);
+    if (error)
+        return error;
+    SetProcessPageTable(pid);
+    u32 flags = SpinLockIrqSave(&schedLock);
+    SchedSetup(&process[pid], schedPolicy[pid]);
+    SpinUnlockIrqRestore(&schedLock, flags);
+    return 0;
+}
+
+// 时间戳之差换算为微秒，没有校准时间戳计数器时为 0
+static u32 LoadMicros(u64 tsc) {
+    return tscPerMs ? Div64((tsc - loadStart) * 1000, tscPerMs) : 0;
+}
+
+// 装入线程，依次装入 1 号之后的任务，每个任务装入后立即加入调度
+// 作为实时任务每 LOADER_PERIOD 个节拍最多执行 LOADER_BUDGET 个节拍，其余时间留给已经装入的任务；
+// 全部装入后在屏幕和串口报告装入时间并结束:
+//     LOAD first_task_us 开始装入到第一次进入任务的时间 all_tasks_us 开始装入到最后一个任务就绪的时间 tasks 任务数
+static void LoaderThread() {
+    PCB *self = &process[loaderPid];
+    SchedSetEdf(self, LOADER_PERIOD, LOADER_BUDGET, 0);
+    Yield();
+    for (int i = 1; i < taskCount; i++) {
+        char *error = LoadProcess(i);
+        if (error)
+            LoadError(i, error);
+    }
+    allTasksTsc = ReadTsc();
+    while (!firstTaskTsc)
+        Yield();
+    Print("[KERNEL] Tasks: first started after ", F_Cyan | L_Light);
+    PrintDecimal(LoadMicros(firstTaskTsc), F_White | L_Light);
+    Print(" us, all loaded after ", F_White);
+    PrintDecimal(LoadMicros(allTasksTsc), F_White | L_Light);
+    Print(" us\n", F_White);
+    SerialPrint("LOAD first_task_us ");     SerialPrintDecimal(LoadMicros(firstTaskTsc));
+    SerialPrint(" all_tasks_us ");          SerialPrintDecimal(LoadMicros(allTasksTsc));
+    SerialPrint(" tasks ");                 SerialPrintDecimal(taskCount);
+    SerialPrint("\n");
+#ifdef BENCH_SUITE
+    BenchBoot(firstTaskTsc);
+#endif
+    SchedExit(self);
+    Yield();
 }
 
 // 设置进程的函数
+// 初始化所有任务的进程表项，只装入 0 号任务，其余任务由装入线程在任务运行的同时装入，
+// 还没有装入的任务保持未使用状态，不会被调度
 void SetupProcess() {
     // 若请求的进程数量大于最大进程数，显示错误信息
     if (taskCount > MAX_TASKS) {
@@ -61,13 +240,13 @@ void SetupProcess() {
         // 设置基本信息
         pcb->pid = i;
         pcb->priority = priority[i];
-        pcb->tick = priority[i];
         // 填充 GDT 表中的 LDT 描述符
         SetDesEntry(&gdt[INDEX_LDT_FIRST + i], (u32)pcb->ldts, LDT_SIZE * sizeof(Descriptor) - 1, DA_LDT);
         // 初始化局部描述符表
         pcb->ldtSelector = SELECTOR_LDT_FIRST + 0x8 * i;
-        SetDesEntry(&pcb->ldts[0], 0, 0x10f, DA_C | DA_DPL3 | DA_32 | DA_LIMIT_4K);   // 用户级的平坦代码段
-        SetDesEntry(&pcb->ldts[1], 0, 0x10f, DA_DRW | DA_DPL3 | DA_32 | DA_LIMIT_4K); // 用户级的平坦数据段
+        // 段界限覆盖文件映射部分，Ring3 实际能访问的地址由页表决定
+        SetDesEntry(&pcb->ldts[0], 0, MMAP_END / PAGE_SIZE - 1, DA_C | DA_DPL3 | DA_32 | DA_LIMIT_4K);   // 用户级的平坦代码段
+        SetDesEntry(&pcb->ldts[1], 0, MMAP_END / PAGE_SIZE - 1, DA_DRW | DA_DPL3 | DA_32 | DA_LIMIT_4K); // 用户级的平坦数据段
         // 初始化段寄存器
         pcb->regs.cs = (0x0 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL3;
         pcb->regs.ds = (0x8 & SA_RPL_MASK & SA_TI_MASK) | SA_TIL | SA_RPL3;
@@ -81,50 +260,75 @@ void SetupProcess() {
         pcb->regs.esp = 0x10ffff;
         // 初始化标志寄存器
         pcb->regs.eflags = 0x1202;
-        // 将进程从硬盘装入内存
-        ReadProcessToMemory(i);
-        // 设置进程的页表
-        SetProcessPageTable(i);
     }
-}
+    procCount = taskCount;
 
-/* ========================== 进程调度函数 ========================== */
-// 进程选择函数
-// 使用优先级调度算法选择优先级最高的进程执行，将待调度的 pid 保存在 readyRid 中
-void choose() {
-    // 当前运行有任务且任务 tick 不为 0 则继续执行
-    if (readyPid != -1 && process[readyPid].tick > 0) {
-        process[readyPid].tick -= 1;
-        return;
+    // 装入 0 号任务，失败时停机
+    loadStart = ReadTsc();
+    char *error = LoadProcess(0);
+    if (error) {
+        LoadError(0, error);
+        while (1) ;
     }
-    int maxTick = 0, maxId = -1;
-    // 寻找最大 tick 程序
-    for (int i = 0; i < taskCount; i++) {
-        if (process[i].tick > maxTick) {
-            maxTick = process[i].tick;
-            maxId   = i;
+    if (taskCount <= 1)
+        return;
+    // 进程表没有空位创建装入线程时，同步装入其余任务
+    loaderPid = KernelThreadCreate(LoaderThread, KTHREAD_PRIORITY, SCHED_POLICY);
+    if (loaderPid == (u32)-1) {
+        for (int i = 1; i < taskCount; i++) {
+            error = LoadProcess(i);
+            if (error)
+                LoadError(i, error);
         }
     }
-    // 若全部为 0 则重置 tick 为优先级并再次选择
-    if (maxId == -1) {
-        readyPid = -1;
-        for (int i = 0; i < taskCount; i++)
-            process[i].tick = priority[i];
-        choose();
-    } else
-        readyPid = maxId;
 }
 
-// 重启函数
-// 转入执行 readPid 进程，执行特权级转换和代码跳转
+/* ========================== 进程切换函数 ========================== */
+// 空闲函数
+// 处理器上没有可执行的任务时，在内核栈上开中断并等待下一次时钟中断
+// 应用处理器空闲时改用单次定时器，减少空闲时的时钟中断
+static void Idle(CPU *cpu) {
+    if (cpu->id != 0)
+        LapicTimerOneShot(IDLE_DEADLINE_US);
+    __asm__ __volatile__ (
+        "movl   %0, %%esp\n"
+        "1:\n"
+        "sti\n"
+        "hlt\n"
+        "jmp    1b\n"
+        :: "r"(cpu->stackTop)
+    );
+}
+
+// 重启函数，调用前需持有 schedLock
+// 转入执行当前处理器的 readyPid 进程，执行特权级转换和代码跳转
 void restart() {
+    CPU *cpu = ThisCpu();
+    IrqOffEnd(cpu);
+    if (cpu->readyPid == -1) {
+        SpinUnlock(&schedLock);
+        Idle(cpu);
+    }
+    PCB *pcb = &process[cpu->readyPid];
+    // 离开空闲状态时恢复周期定时器
+    if (cpu->oneShot)
+        LapicTimerPeriodic(TIMER_HZ);
+    // 记录第一次进入用户任务的时间
+    if (!firstTaskTsc && (pcb->regs.cs & SA_RPL3) == SA_RPL3)
+        firstTaskTsc = ReadTsc();
+    // 任务读到了键盘输入，统计从按键到恢复执行的延迟
+    if (pcb->inputStamp) {
+        KeyboardLatency(ReadTsc() - pcb->inputStamp);
+        pcb->inputStamp = 0;
+    }
     // 当下次中断发生的时候，返回到的内核栈为对应 process 的 stack frame
-    tss.esp0 = sizeof(StackFrame) + (u32)&process[readyPid];
+    cpu->tss.esp0 = sizeof(StackFrame) + (u32)pcb;
     // 进行页表的切换
     __asm__ __volatile__ (
         "movl %%eax, %%cr3\n"
-        ::"a"(process[readyPid].pageDirBase)
+        ::"a"(pcb->pageDirBase)
     );
+    SpinUnlock(&schedLock);
     // 执行中断返回
     __asm__ __volatile__ (
         "movl   %0, %%esp\n"        // 转移堆栈到 stack frame
@@ -136,6 +340,7 @@ void restart() {
         "popal\n"
         "sti\n"                     // 开中断
         "iretl\n"                   // 返回对应的进程，进入 Ring3
-        :: "r"(&process[readyPid]), "m"(process[readyPid].ldtSelector)
+        :: "r"(pcb), "m"(pcb->ldtSelector)
     );
-}
\ No newline at end of file
+}
+#endif
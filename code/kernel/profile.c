@@ -0,0 +1,125 @@
+//  profile.c         by OrangeYYC
+//  TinyOS 采样分析器
+//
+//  使用 make PROFILE=1 构建时启用。PIT 以 PROF_HZ 的频率产生中断，与调度使用的本地 APIC 定时器无关，
+//  每次中断记录被打断代码的任务编号、特权级和 eip，按 (任务, 特权级, eip) 合并计数放入样本表。
+//  没有本地 APIC 时 PIT 同时作为调度时钟，每 PROF_HZ / TIMER_HZ 次采样调用一次原来的时钟处理函数。
+//  样本表每 PROF_DUMP_PERIOD 个节拍由工作队列线程写到串口后清空，格式为:
+//      PROF begin hz 频率 samples 样本数 idle 空闲样本数 dropped 丢弃的样本数
+//      PROF task 任务编号 文件名
+//      PROF 任务编号 特权级 eip 样本数
+//      PROF end
+//  主机上的 code/tools/profsym.sh 使用未剥离符号的 kernel.elf 和任务的 .dbg 文件把地址转换为函数名
+
+#include "common.h"
+
+#ifdef PROFILE
+#if PROF_HZ % TIMER_HZ
+#error "PROF_HZ must be a multiple of TIMER_HZ"
+#endif
+
+static Spinlock    profLock    = {};    // 采样与输出之间的同步
+static volatile u32 profActive = 0;     // 是否记录样本，输出期间暂停
+static u32         profSamples = 0;     // 记录的样本数
+static u32         profIdle    = 0;     // 处理器空闲时的样本数
+static u32         profDropped = 0;     // 样本表中找不到空闲表项而丢弃的样本数
+static u32         profDivider = 0;     // 没有本地 APIC 时距离上一次调用时钟处理函数的采样次数
+static IrqHandler  tickHandler = 0;     // 没有本地 APIC 时原来的时钟处理函数
+static Work        profWork    = {};    // 输出样本表的工作
+
+// 在样本表中为 key 计数，从散列位置开始最多探测 PROF_PROBE 个表项
+static void ProfileRecord(u32 key) {
+    ProfSlot *table = (ProfSlot *)PROF_BASE;
+    u32 index = ((key * 2654435761u) >> 16) & (PROF_SLOTS - 1);
+    for (u32 n = 0; n < PROF_PROBE; n++) {
+        ProfSlot *slot = &table[(index + n) & (PROF_SLOTS - 1)];
+        if (!slot->count)
+            slot->key = key;
+        if (slot->key == key) {
+            slot->count++;
+            profSamples++;
+            return;
+        }
+    }
+    profDropped++;
+}
+
+// 记录一个样本，frame 为被打断的代码保存的寄存器，为 0 时处理器空闲
+// 任务(Ring1/3)的样本使用任务编号，内核代码(Ring0)的样本使用 PROF_PID_KERNEL
+static void ProfileSample(StackFrame *frame) {
+    SpinLock(&profLock);
+    if (profActive) {
+        if (!frame) {
+            profIdle++;
+        } else {
+            u32 ring = frame->cs & 3;
+            u32 pid  = ring ? ThisCpu()->readyPid : PROF_PID_KERNEL;
+            ProfileRecord(pid << 28 | ring << 26 | (frame->eip & 0x3ffffff));
+        }
+    }
+    SpinUnlock(&profLock);
+}
+
+// PIT 中断的上半部
+static void ProfileTopHalf(u32 irq) {
+    ProfileSample(ThisCpu()->irqFrame);
+    if (tickHandler && ++profDivider >= PROF_HZ / TIMER_HZ) {
+        profDivider = 0;
+        tickHandler(irq);
+    }
+}
+
+// 将样本表写到串口后清空，在工作队列线程中执行，输出期间暂停采样
+static void ProfileDump(Work *work) {
+    ProfSlot *table = (ProfSlot *)PROF_BASE;
+    profActive = 0;
+    u32 flags = SpinLockIrqSave(&profLock);
+    SpinUnlockIrqRestore(&profLock, flags);
+    SerialPrint("PROF begin hz ");  SerialPrintDecimal(PROF_HZ);
+    SerialPrint(" samples ");       SerialPrintDecimal(profSamples);
+    SerialPrint(" idle ");          SerialPrintDecimal(profIdle);
+    SerialPrint(" dropped ");       SerialPrintDecimal(profDropped);
+    SerialPrint("\n");
+    for (int i = 0; i < taskCount; i++) {
+        SerialPrint("PROF task ");  SerialPrintDecimal(i);
+        SerialPrint(" ");           SerialPrint(taskName[i]);
+        SerialPrint("\n");
+    }
+    for (u32 i = 0; i < PROF_SLOTS; i++) {
+        if (!table[i].count)
+            continue;
+        SerialPrint("PROF ");       SerialPrintDecimal(table[i].key >> 28);
+        SerialPrint(" ");           SerialPrintDecimal((table[i].key >> 26) & 3);
+        SerialPrint(" ");           SerialPrintHex(table[i].key & 0x3ffffff);
+        SerialPrint(" ");           SerialPrintDecimal(table[i].count);
+        SerialPrint("\n");
+    }
+    SerialPrint("PROF end\n");
+    memset(table, 0, PROF_SLOTS * sizeof(ProfSlot));
+    profSamples = profIdle = profDropped = 0;
+    profActive = 1;
+}
+
+// 请求输出样本表，由时钟中断的下半部每 PROF_DUMP_PERIOD 个节拍调用
+void ProfileFlush() {
+    WorkSchedule(&profWork);
+}
+
+// 采样分析器初始化函数，在时钟初始化之后调用
+// 有本地 APIC 时 PIT 只用于采样，否则接管 PIT 的时钟中断并按比例调用原来的处理函数
+void ProfileInit() {
+    SpinInit(&profLock, "prof");
+    memset((void *)PROF_BASE, 0, PROF_SLOTS * sizeof(ProfSlot));
+    profWork.func = ProfileDump;
+    IrqHandler old = IrqRegister(0, ProfileTopHalf);
+    if (!lapicBase)
+        tickHandler = old;
+    PitInit(PROF_HZ);
+    if (lapicBase)
+        IrqEnable(0, 0);
+    profActive = 1;
+    Print("[KERNEL] Profiler: ", F_Cyan | L_Light);
+    PrintDecimal(PROF_HZ, F_White | L_Light);
+    Print(" Hz PIT sampling, results on serial port\n", F_White);
+}
+#endif
@@ -0,0 +1,610 @@
+//  sched.c         by OrangeYYC
+//  TinyOS 的进程调度策略在本文件中实现
+
+#include "common.h"
+
+Spinlock schedLock = {};            // 调度锁，保护进程表中的调度信息和各处理器的运行队列
+
+// 判断任务是否在处理器 cpu 的运行队列中且使用 policy 策略就绪
+static int Runnable(PCB *pcb, u32 policy, u32 cpu) {
+    return pcb->state == TASK_READY && pcb->policy == policy && pcb->cpu == cpu;
+}
+
+/* ========================== 最早截止时间优先调度 ========================== */
+// EDF 调度: 实时任务声明周期、预算和相对截止时间，每个周期释放一个作业，总是选择绝对截止时间最早的作业，
+// 作业每个周期最多执行预算个节拍；作业完成(wait_period)或预算耗尽后任务进入 TASK_WAITING，
+// 由 SchedRelease 在下一个周期释放新的作业。实时任务不参与工作窃取，接纳控制按处理器分别计算
+// 节拍数允许回绕，比较时使用差值的符号
+#define DEADLINE_BEFORE(a, b)   ((int)((a) - (b)) < 0)
+
+static u32 edfClock = 0;            // 最近一次调用 SchedRelease 时的时钟节拍
+
+// 在 now 时释放任务的一个新作业
+static void EDFRelease(PCB *pcb, u32 now) {
+    pcb->release     = now;
+    pcb->absDeadline = now + pcb->deadline;
+    pcb->slice       = pcb->budget;
+    pcb->edfFlags    = 0;
+    pcb->releaseTsc  = ReadTsc();
+    pcb->jobs       += 1;
+}
+
+static void EDFSetup(PCB *pcb) {
+    EDFRelease(pcb, edfClock);
+}
+
+// 当前作业消耗一个节拍，预算耗尽时等待下一个周期，有截止时间更早的作业时让出处理器
+static int EDFTick(PCB *pcb) {
+    if (pcb->slice <= 1) {
+        pcb->slice = 0;
+        pcb->state = TASK_WAITING;
+        return 1;
+    }
+    pcb->slice -= 1;
+    for (int i = 0; i < procCount; i++)
+        if (Runnable(&process[i], SCHED_EDF, pcb->cpu)
+            && DEADLINE_BEFORE(process[i].absDeadline, pcb->absDeadline))
+            return 1;
+    return 0;
+}
+
+// 选择截止时间最早的作业，作业第一次被选中时统计从释放到开始执行的时间
+static int EDFPick(u32 cpu) {
+    int minId = -1;
+    for (int i = 0; i < procCount; i++) {
+        PCB *pcb = &process[i];
+        if (!Runnable(pcb, SCHED_EDF, cpu))
+            continue;
+        if (minId == -1 || DEADLINE_BEFORE(pcb->absDeadline, process[minId].absDeadline))
+            minId = i;
+    }
+    if (minId != -1 && !(process[minId].edfFlags & EDF_STARTED)) {
+        PCB *pcb = &process[minId];
+        u32 jitter = (u32)(ReadTsc() - pcb->releaseTsc);
+        pcb->edfFlags  |= EDF_STARTED;
+        pcb->jitterSum += jitter;
+        if (jitter > pcb->jitterMax)
+            pcb->jitterMax = jitter;
+    }
+    return minId;
+}
+
+static void EDFWakeup(PCB *pcb) {
+}
+
+/* ========================== 优先数调度 ========================== */
+// 优先数调度: 任务拥有与优先级相等的节拍数，选择剩余节拍最多的任务执行，
+// 所有就绪任务的节拍耗尽后重新按照优先级分配节拍
+static void PrioritySetup(PCB *pcb) {
+    pcb->tick = pcb->priority;
+}
+
+static int PriorityTick(PCB *pcb) {
+    if (pcb->tick > 0) {
+        pcb->tick -= 1;
+        return 0;
+    }
+    return 1;
+}
+
+static int PriorityPick(u32 cpu) {
+    for (int pass = 0; pass < 2; pass++) {
+        int maxTick = 0, maxId = -1, found = 0;
+        // 寻找最大 tick 程序
+        for (int i = 0; i < procCount; i++) {
+            PCB *pcb = &process[i];
+            if (!Runnable(pcb, SCHED_PRIORITY, cpu))
+                continue;
+            found = 1;
+            if (pcb->tick > maxTick) {
+                maxTick = pcb->tick;
+                maxId   = i;
+            }
+        }
+        if (maxId != -1 || !found)
+            return maxId;
+        // 若全部为 0 则重置 tick 为优先级并再次选择
+        for (int i = 0; i < procCount; i++)
+            if (process[i].policy == SCHED_PRIORITY && process[i].cpu == cpu)
+                process[i].tick = process[i].priority;
+    }
+    return -1;
+}
+
+static void PriorityWakeup(PCB *pcb) {
+}
+
+/* ========================== 轮转调度 ========================== */
+// 轮转调度: 就绪任务按 pid 顺序轮流执行 RR_SLICE 个节拍，不考虑优先级
+static int rrNext[MAX_CPUS] = {};   // 各处理器下一次开始查找的任务，即上一次选中的任务之后的一个
+
+static void RRSetup(PCB *pcb) {
+    pcb->slice = RR_SLICE;
+}
+
+static int RRTick(PCB *pcb) {
+    if (pcb->slice > 1) {
+        pcb->slice -= 1;
+        return 0;
+    }
+    pcb->slice = RR_SLICE;
+    return 1;
+}
+
+static int RRPick(u32 cpu) {
+    for (int n = 0; n < procCount; n++) {
+        int i = (rrNext[cpu] + n) % procCount;
+        if (Runnable(&process[i], SCHED_RR, cpu)) {
+            rrNext[cpu] = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void RRWakeup(PCB *pcb) {
+}
+
+/* ========================== 多级反馈队列调度 ========================== */
+// 多级反馈队列调度: 新任务进入最高级队列，用完时间片后降一级，级别越低时间片越长；
+// 主动睡眠的任务保留级别，因此交互型任务停留在高级队列；
+// 每个处理器每运行 MLFQ_BOOST 个节拍把本处理器上的任务全部提升到最高级
+static int mlfqNext[MAX_CPUS]  = {};    // 各处理器下一次开始查找的任务
+static u32 mlfqClock[MAX_CPUS] = {};    // 各处理器距离上一次全体提升经过的节拍
+
+static void MLFQSetup(PCB *pcb) {
+    pcb->level = 0;
+    pcb->slice = MLFQ_QUANTUM;
+}
+
+// 判断处理器 cpu 上是否有级别高于 level 的就绪任务
+static int MLFQHigherReady(u32 level, u32 cpu) {
+    for (int i = 0; i < procCount; i++)
+        if (Runnable(&process[i], SCHED_MLFQ, cpu) && process[i].level < level)
+            return 1;
+    return 0;
+}
+
+static int MLFQTick(PCB *pcb) {
+    // 周期性地将所有任务提升到最高级，防止低级任务饥饿
+    if (++mlfqClock[pcb->cpu] >= MLFQ_BOOST) {
+        mlfqClock[pcb->cpu] = 0;
+        for (int i = 0; i < procCount; i++)
+            if (process[i].policy == SCHED_MLFQ && process[i].cpu == pcb->cpu)
+                MLFQSetup(&process[i]);
+        return 1;
+    }
+    if (pcb->slice > 1) {
+        pcb->slice -= 1;
+        return MLFQHigherReady(pcb->level, pcb->cpu);
+    }
+    // 用完时间片则降级
+    if (pcb->level < MLFQ_LEVELS - 1)
+        pcb->level += 1;
+    pcb->slice = MLFQ_QUANTUM << pcb->level;
+    return 1;
+}
+
+static int MLFQPick(u32 cpu) {
+    for (u32 level = 0; level < MLFQ_LEVELS; level++)
+        for (int n = 0; n < procCount; n++) {
+            int i = (mlfqNext[cpu] + n) % procCount;
+            PCB *pcb = &process[i];
+            if (Runnable(pcb, SCHED_MLFQ, cpu) && pcb->level == level) {
+                mlfqNext[cpu] = i + 1;
+                return i;
+            }
+        }
+    return -1;
+}
+
+static void MLFQWakeup(PCB *pcb) {
+}
+
+/* ========================== 虚拟运行时间公平调度 ========================== */
+// CFS 调度: 任务每运行一个节拍，虚拟运行时间增加 CFS_SCALE / 优先级，
+// 总是选择虚拟运行时间最小的任务，使各任务获得的处理器时间与优先级成正比
+// 虚拟运行时间允许回绕，比较时使用差值的符号
+#define VRUNTIME_BEFORE(a, b)   ((int)((a) - (b)) < 0)
+
+static u32 cfsFloor[MAX_CPUS] = {}; // 各处理器最近一次选中任务的虚拟运行时间，作为新任务和唤醒任务的基准
+
+static void CFSSetup(PCB *pcb) {
+    pcb->vruntime = cfsFloor[pcb->cpu];
+    pcb->slice    = 0;
+}
+
+static int CFSTick(PCB *pcb) {
+    pcb->vruntime += CFS_SCALE / pcb->priority;
+    pcb->slice    += 1;
+    if (pcb->slice < CFS_MIN_GRAN)
+        return 0;
+    // 运行满最小粒度后，若有虚拟运行时间更小的任务则让出处理器
+    for (int i = 0; i < procCount; i++)
+        if (Runnable(&process[i], SCHED_CFS, pcb->cpu)
+            && VRUNTIME_BEFORE(process[i].vruntime, pcb->vruntime))
+            return 1;
+    return 0;
+}
+
+static int CFSPick(u32 cpu) {
+    int minId = -1;
+    for (int i = 0; i < procCount; i++) {
+        PCB *pcb = &process[i];
+        if (!Runnable(pcb, SCHED_CFS, cpu))
+            continue;
+        if (minId == -1 || VRUNTIME_BEFORE(pcb->vruntime, process[minId].vruntime))
+            minId = i;
+    }
+    if (minId != -1) {
+        cfsFloor[cpu] = process[minId].vruntime;
+        process[minId].slice = 0;
+    }
+    return minId;
+}
+
+// 睡眠过的任务最多获得 CFS_WAKEUP_CREDIT 的补偿，避免长时间睡眠后独占处理器
+static void CFSWakeup(PCB *pcb) {
+    u32 floor = cfsFloor[pcb->cpu];
+    if (VRUNTIME_BEFORE(pcb->vruntime, floor - CFS_WAKEUP_CREDIT))
+        pcb->vruntime = floor - CFS_WAKEUP_CREDIT;
+}
+
+/* ========================== 调度类与进程选择 ========================== */
+// 调度类表，按策略编号索引，编号小的调度类优先于编号大的调度类
+static SchedClass schedClass[SCHED_COUNT] = {
+    { "EDF ", EDFSetup,      EDFTick,      EDFPick,      EDFWakeup      },
+    { "PRIO", PrioritySetup, PriorityTick, PriorityPick, PriorityWakeup },
+    { "RR  ", RRSetup,       RRTick,       RRPick,       RRWakeup       },
+    { "MLFQ", MLFQSetup,     MLFQTick,     MLFQPick,     MLFQWakeup     },
+    { "CFS ", CFSSetup,      CFSTick,      CFSPick,      CFSWakeup      },
+};
+
+// 判断处理器 cpu 上是否有比 policy 更优先的调度类中存在就绪任务
+static int HigherClassReady(u32 policy, u32 cpu) {
+    for (int i = 0; i < procCount; i++)
+        if (process[i].state == TASK_READY && process[i].policy < policy && process[i].cpu == cpu)
+            return 1;
+    return 0;
+}
+
+// 判断任务是否正在某个处理器上运行
+static int Running(int pid) {
+    return cpus[process[pid].cpu].readyPid == pid;
+}
+
+// 判断任务是否可以被其他处理器窃取，实时任务固定在接纳它的处理器上
+static int Stealable(int pid) {
+    return process[pid].state == TASK_READY && process[pid].policy != SCHED_EDF && !Running(pid);
+}
+
+// 工作窃取函数
+// 当前处理器没有可执行任务时，从等待任务最多的处理器上取走一个就绪且未在运行的任务，
+// CFS 任务的虚拟运行时间换算到本处理器的基准上
+static int Steal(CPU *cpu) {
+    u32 waiting[MAX_CPUS] = {};
+    int busiest = -1;
+    for (int i = 0; i < procCount; i++)
+        if (Stealable(i))
+            waiting[process[i].cpu]++;
+    for (int c = 0; c < cpuCount; c++)
+        if (c != cpu->id && waiting[c] > 0 && (busiest == -1 || waiting[c] > waiting[busiest]))
+            busiest = c;
+    if (busiest == -1)
+        return 0;
+    for (int i = 0; i < procCount; i++)
+        if (Stealable(i) && process[i].cpu == busiest) {
+            process[i].vruntime += cfsFloor[cpu->id] - cfsFloor[busiest];
+            process[i].cpu = cpu->id;
+            return 1;
+        }
+    return 0;
+}
+
+// 依次询问各调度类，选出处理器 cpu 上的下一个任务
+static int PickNext(u32 cpu) {
+    int pid = -1;
+    for (int i = 0; i < SCHED_COUNT && pid == -1; i++)
+        pid = schedClass[i].Pick(cpu);
+    return pid;
+}
+
+// 进程选择函数，调用前需持有 schedLock
+// 由当前任务的调度类决定是否继续执行，需要重新选择时依次询问各调度类，
+// 本处理器没有可执行任务时从其他处理器窃取任务，将待调度的 pid 保存在当前处理器的 readyPid 中
+// tick 为上一次调度以来经过的时钟节拍数，当前任务逐个节拍消耗时间片，时间片用完时不再继续消耗
+// 换下当前任务时，仍然就绪且没有主动让出的记为被动切换，否则记为主动切换
+void choose(int tick) {
+    CPU *cpu = ThisCpu();
+    int yield = cpu->yield;
+    u32 prev  = cpu->readyPid;
+    cpu->yield = 0;
+    // 当前运行有任务、没有主动让出且调度类不要求重新选择则继续执行
+    if (cpu->readyPid != -1 && process[cpu->readyPid].state == TASK_READY && !yield) {
+        PCB *pcb = &process[cpu->readyPid];
+        int expired = 0;
+        while (tick-- > 0 && !expired)
+            expired = schedClass[pcb->policy].Tick(pcb);
+        if (!expired && !HigherClassReady(pcb->policy, cpu->id))
+            return;
+    }
+    cpu->readyPid = -1;
+    cpu->readyPid = PickNext(cpu->id);
+    if (cpu->readyPid == -1 && Steal(cpu))
+        cpu->readyPid = PickNext(cpu->id);
+    if (prev != -1 && cpu->readyPid != prev) {
+        if (process[prev].state == TASK_READY && !yield)
+            process[prev].usage.involuntary++;
+        else
+            process[prev].usage.voluntary++;
+    }
+}
+
+// 将任务加入调度，使用 policy 指定的调度策略
+void SchedSetup(PCB *pcb, u32 policy) {
+    pcb->policy = policy;
+    pcb->state  = TASK_READY;
+    schedClass[policy].Setup(pcb);
+}
+
+// 将任务设为阻塞，下一次调用 choose() 时让出处理器，调用时不能持有 schedLock
+void SchedSleep(PCB *pcb) {
+    u32 flags = SpinLockIrqSave(&schedLock);
+    pcb->state = TASK_BLOCKED;
+    SpinUnlockIrqRestore(&schedLock, flags);
+}
+
+// 结束任务，任务不再被调度，也不会被唤醒，调用时不能持有 schedLock
+// 实时任务结束时把统计信息写到串口
+void SchedExit(PCB *pcb) {
+    u32 flags = SpinLockIrqSave(&schedLock);
+    pcb->state = TASK_EXITED;
+    SpinUnlockIrqRestore(&schedLock, flags);
+    if (pcb->policy == SCHED_EDF)
+        EdfReportTask(pcb);
+}
+
+// 唤醒阻塞的任务，调用时不能持有 schedLock
+void SchedWakeup(PCB *pcb) {
+    u32 flags = SpinLockIrqSave(&schedLock);
+    if (pcb->state == TASK_BLOCKED) {
+        pcb->state = TASK_READY;
+        schedClass[pcb->policy].Wakeup(pcb);
+    }
+    SpinUnlockIrqRestore(&schedLock, flags);
+}
+
+// 修改任务 pcb 的优先级，在下一次调度时生效，优先级超出范围时返回 -1
+// 优先数调度中剩余的节拍数按新旧优先级之差增减，CFS 从下一个节拍起按新的权重计算虚拟运行时间
+u32 SchedSetPriority(PCB *pcb, u32 priority) {
+    if (priority < PRIO_MIN || priority > PRIO_MAX)
+        return -1;
+    u32 flags = SpinLockIrqSave(&schedLock);
+    u32 old   = pcb->priority;
+    if (priority > old)
+        pcb->tick += priority - old;
+    else
+        pcb->tick = pcb->tick > old - priority ? pcb->tick - (old - priority) : 0;
+    pcb->priority = priority;
+    SpinUnlockIrqRestore(&schedLock, flags);
+    return 0;
+}
+
+/* ========================== 实时任务 ========================== */
+// 任务是否为仍在调度中的实时任务，还没有装入(TASK_UNUSED)或已经结束的任务不计入
+static int EdfActive(PCB *pcb) {
+    return pcb->policy == SCHED_EDF && pcb->state != TASK_EXITED && pcb->state != TASK_UNUSED;
+}
+
+// 使任务 pcb 成为实时任务，每 period 个节拍释放一个作业，作业最多执行 budget 个节拍，
+// 需要在释放后 deadline 个节拍内完成(0 表示等于周期)，成功返回 0
+// 接纳控制: 任务所在处理器上所有实时任务的 budget / deadline 之和不能超过 EDF_UTIL_LIMIT，
+// 此时在截止时间不大于周期的条件下 EDF 可以保证所有作业按时完成
+u32 SchedSetEdf(PCB *pcb, u32 period, u32 budget, u32 deadline) {
+    if (!deadline)
+        deadline = period;
+    if (!budget || budget > deadline || deadline > period)
+        return -1;
+    u32 util  = (budget * EDF_UTIL_SCALE + deadline - 1) / deadline;
+    u32 flags = SpinLockIrqSave(&schedLock);
+    for (int i = 0; i < procCount; i++) {
+        PCB *other = &process[i];
+        if (other != pcb && EdfActive(other) && other->cpu == pcb->cpu)
+            util += (other->budget * EDF_UTIL_SCALE + other->deadline - 1) / other->deadline;
+    }
+    if (util > EDF_UTIL_LIMIT) {
+        SpinUnlockIrqRestore(&schedLock, flags);
+        return -1;
+    }
+    pcb->period    = period;
+    pcb->budget    = budget;
+    pcb->deadline  = deadline;
+    pcb->jobs      = 0;
+    pcb->misses    = 0;
+    pcb->jitterMax = 0;
+    pcb->jitterSum = 0;
+    SchedSetup(pcb, SCHED_EDF);
+    SpinUnlockIrqRestore(&schedLock, flags);
+    return 0;
+}
+
+// 实时任务完成本周期的作业，等待下一个周期，不是实时任务时返回 -1
+u32 SchedWaitPeriod(PCB *pcb) {
+    if (pcb->policy != SCHED_EDF)
+        return -1;
+    u32 flags = SpinLockIrqSave(&schedLock);
+    pcb->edfFlags |= EDF_DONE;
+    pcb->state     = TASK_WAITING;
+    SpinUnlockIrqRestore(&schedLock, flags);
+    return 0;
+}
+
+// 实时任务的周期处理，启动处理器每个时钟节拍调用一次，now 为当前的时钟节拍
+// 统计到达截止时间仍未完成的作业，为到达下一个周期的任务释放新作业；
+// 落后超过一个周期(例如长时间阻塞)时从 now 重新开始计算周期
+void SchedRelease(u32 now) {
+    SpinLock(&schedLock);
+    edfClock = now;
+    for (int i = 0; i < procCount; i++) {
+        PCB *pcb = &process[i];
+        if (!EdfActive(pcb))
+            continue;
+        if (!(pcb->edfFlags & (EDF_DONE | EDF_MISSED)) && !DEADLINE_BEFORE(now, pcb->absDeadline)) {
+            pcb->edfFlags |= EDF_MISSED;
+            pcb->misses   += 1;
+        }
+        u32 next = pcb->release + pcb->period;
+        if (pcb->state == TASK_WAITING && !DEADLINE_BEFORE(now, next)) {
+            EDFRelease(pcb, now - next >= pcb->period ? now : next);
+            pcb->state = TASK_READY;
+        }
+    }
+    SpinUnlock(&schedLock);
+}
+
+// 将实时任务 pcb 的统计信息写到串口:
+// EDF pid 编号 jobs 作业数 misses 错过截止时间的作业数 jitter_max 最长延迟 jitter_avg 平均延迟 cycles
+void EdfReportTask(PCB *pcb) {
+    u32 flags     = SpinLockIrqSave(&schedLock);
+    u32 jobs      = pcb->jobs;
+    u32 misses    = pcb->misses;
+    u32 jitterMax = pcb->jitterMax;
+    u64 jitterSum = pcb->jitterSum;
+    SpinUnlockIrqRestore(&schedLock, flags);
+    SerialPrint("EDF pid ");        SerialPrintDecimal(pcb->pid);
+    SerialPrint(" jobs ");          SerialPrintDecimal(jobs);
+    SerialPrint(" misses ");        SerialPrintDecimal(misses);
+    SerialPrint(" jitter_max ");    SerialPrintDecimal(jitterMax);
+    SerialPrint(" jitter_avg ");    SerialPrintDecimal(jobs ? Div64(jitterSum, jobs) : 0);
+    SerialPrint(" cycles\n");
+}
+
+// 将所有实时任务的统计信息写到串口，由时钟中断的下半部每 EDF_REPORT_PERIOD 个节拍调用
+void EdfReport() {
+    for (int i = 0; i < procCount; i++)
+        if (EdfActive(&process[i]))
+            EdfReportTask(&process[i]);
+}
+
+#ifdef TOP
+/* ========================== 任务监视器 ========================== */
+static char *stateNames[] = { "unused", "ready", "blocked", "exited", "waiting" };
+
+// 在屏幕第 row 行第 col 列显示 value
+static void TopField(u32 row, u32 col, u32 value) {
+    SetCursor(row, col);
+    PrintDecimal(value, F_White | L_Light);
+}
+
+// 以表格显示每个进程的调度参数和资源使用统计，从屏幕第 TOP_ROW 行开始，由时钟中断的下半部每 TOP_PERIOD 个节拍调用
+// CPU% 为上一个周期中该进程占用一个处理器的时间比例，统计值不加锁读取，只用于显示
+void TopDump() {
+    static u32  lastTicks[MAX_TASKS];
+    static char blank[CONSOLE_COLS + 1];
+    memset(blank, ' ', CONSOLE_COLS);
+    PrintAtPos(blank, F_White, TOP_ROW, 0);
+    PrintAtPos("PID NAME     POL  PRI  STATE   CPU%  USER    KERN    VCSW    ICSW    FAULT",
+               F_Cyan | L_Light, TOP_ROW, 0);
+    for (u32 i = 0; i < procCount; i++) {
+        PCB *pcb = &process[i];
+        u32 row  = TOP_ROW + 1 + i;
+        u32 used = pcb->usage.userTicks + pcb->usage.kernelTicks;
+        PrintAtPos(blank, F_White, row, 0);
+        TopField(row, 0, i);
+        PrintAtPos((int)i < taskCount ? taskName[i] : "kthread", F_White | L_Light, row, 4);
+        PrintAtPos(schedClass[pcb->policy].name, F_White, row, 13);
+        TopField(row, 18, pcb->priority);
+        PrintAtPos(stateNames[pcb->state], F_White, row, 23);
+        TopField(row, 31, (used - lastTicks[i]) * 100 / TOP_PERIOD);
+        TopField(row, 37, pcb->usage.userTicks);
+        TopField(row, 45, pcb->usage.kernelTicks);
+        TopField(row, 53, pcb->usage.voluntary);
+        TopField(row, 61, pcb->usage.involuntary);
+        TopField(row, 69, pcb->usage.faults);
+        lastTicks[i] = used;
+    }
+}
+#endif
+
+#ifdef SCHED_BENCH
+/* ========================== 调度策略基准测试 ========================== */
+// 模拟负载: 偶数号任务为计算密集型，始终就绪；奇数号任务为交互型，
+// 每运行 BENCH_BURST 个节拍完成一次请求，随后睡眠 BENCH_THINK 个节拍
+#define BENCH_TICKS     10000
+#define BENCH_BURST     2
+#define BENCH_THINK     30
+
+// 在一种调度策略下运行模拟负载并输出结果
+// work: 计算型任务获得的节拍  req: 交互型任务完成的请求数
+// lat: 最坏唤醒延迟(节拍)  sw: 任务切换次数  share: 实际占用率/配置权重比例(%)
+static void BenchmarkPolicy(u32 policy) {
+    u32 used[MAX_TASKS], sleepUntil[MAX_TASKS], wokeAt[MAX_TASKS], left[MAX_TASKS];
+    u32 work = 0, requests = 0, switches = 0, maxLatency = 0, busy = 0, weightSum = 0;
+    u32 last = -1;
+    CPU *cpu = ThisCpu();
+    cpu->readyPid = -1;
+    for (int i = 0; i < taskCount; i++) {
+        process[i].pid      = i;
+        process[i].priority = priority[i];
+        SchedSetup(&process[i], policy);
+        used[i]   = 0;
+        wokeAt[i] = -1;
+        left[i]   = BENCH_BURST;
+        weightSum += priority[i];
+    }
+    for (u32 t = 0; t < BENCH_TICKS; t++) {
+        // 唤醒睡眠结束的交互型任务
+        for (int i = 0; i < taskCount; i++)
+            if (process[i].state == TASK_BLOCKED && t >= sleepUntil[i]) {
+                SchedWakeup(&process[i]);
+                wokeAt[i] = t;
+            }
+        choose(1);
+        u32 pid = cpu->readyPid;
+        if (pid == -1)
+            continue;
+        if (pid != last)
+            switches++;
+        last = pid;
+        busy++;
+        used[pid]++;
+        if (wokeAt[pid] != -1) {
+            if (t - wokeAt[pid] > maxLatency)
+                maxLatency = t - wokeAt[pid];
+            wokeAt[pid] = -1;
+        }
+        if ((pid & 1) == 0) {
+            work++;
+        } else if (--left[pid] == 0) {
+            left[pid] = BENCH_BURST;
+            requests++;
+            SchedSleep(&process[pid]);
+            sleepUntil[pid] = t + 1 + BENCH_THINK;
+        }
+    }
+    Print("[SCHED] ", F_Cyan | L_Light);  Print(schedClass[policy].name, F_White | L_Light);
+    Print(" work ",   F_White);           PrintDecimal(work, F_White | L_Light);
+    Print(" req ",    F_White);           PrintDecimal(requests, F_White | L_Light);
+    Print(" lat ",    F_White);           PrintDecimal(maxLatency, F_White | L_Light);
+    Print(" sw ",     F_White);           PrintDecimal(switches, F_White | L_Light);
+    Print(" share",   F_White);
+    for (int i = 0; i < taskCount; i++) {
+        Print(" ", F_White);
+        PrintDecimal(busy ? used[i] * 100 / busy : 0, F_White | L_Light);
+        Print("/", F_White);
+        PrintDecimal(priority[i] * 100 / weightSum, F_White);
+    }
+    Print("\n", F_White);
+}
+
+// 调度策略基准测试函数，依次测试所有普通任务的调度策略，结束后清空进程表
+void SchedBenchmark() {
+    Print("[KERNEL] Scheduler Benchmark\n", F_Cyan | L_Light);
+    procCount = taskCount;
+    for (u32 policy = SCHED_PRIORITY; policy < SCHED_COUNT; policy++)
+        BenchmarkPolicy(policy);
+    memset(process, 0, sizeof(process));
+    procCount = 0;
+    ThisCpu()->readyPid = -1;
+}
+#endif
\ No newline at end of file
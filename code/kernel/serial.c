@@ -0,0 +1,72 @@
+//  serial.c         by OrangeYYC
+//  TinyOS 串口输出
+//
+//  第一个串口(COM1)用于输出机器可读的信息，不使用中断，每个字符等待发送缓冲区为空后写入。
+//  任务通过 write 系统调用向 FD_SERIAL 号文件写入，内核使用 SerialPrint。
+//  在 QEMU 中使用 -serial file:... 或 -serial stdio 即可得到输出，基准测试套件的结果从这里输出
+
+#include "common.h"
+
+static Spinlock serialLock = {};                // 保证一次写入的内容不与其他处理器的输出交错
+
+// 等待发送缓冲区为空后输出一个字符
+static void SerialPutc(u8 ch) {
+    while (!(InByte(SERIAL_PORT + 5) & 0x20)) ;
+    OutByte(SERIAL_PORT, ch);
+}
+
+// 输出字符串
+void SerialPrint(char *message) {
+    u32 flags = SpinLockIrqSave(&serialLock);
+    while (*message)
+        SerialPutc(*message++);
+    SpinUnlockIrqRestore(&serialLock, flags);
+}
+
+// 输出十进制数
+void SerialPrintDecimal(u32 value) {
+    char digits[11];
+    int  n = 10;
+    digits[n] = 0;
+    do {
+        digits[--n] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    SerialPrint(&digits[n]);
+}
+
+// 输出 8 位的十六进制数
+void SerialPrintHex(u32 value) {
+    char digits[11] = "0x";
+    for (int i = 0; i < 8; i++)
+        digits[2 + i] = "0123456789abcdef"[(value >> (28 - 4 * i)) & 0xf];
+    digits[10] = 0;
+    SerialPrint(digits);
+}
+
+// 将任务 pcb 地址 va 处的 count 个字符写到串口，返回写入的字节数
+u32 SerialWrite(PCB *pcb, u32 va, u32 count) {
+    u8  data[SERIAL_CHUNK];
+    u32 flags = SpinLockIrqSave(&serialLock);
+    for (u32 done = 0; done < count; ) {
+        u32 n = count - done < SERIAL_CHUNK ? count - done : SERIAL_CHUNK;
+        CopyFromUser(pcb, va + done, data, n);
+        for (u32 i = 0; i < n; i++)
+            SerialPutc(data[i]);
+        done += n;
+    }
+    SpinUnlockIrqRestore(&serialLock, flags);
+    return count;
+}
+
+// 串口初始化函数，设置为 115200 波特率、8 位数据、无校验、1 位停止位，关闭串口中断
+void SerialInit() {
+    SpinInit(&serialLock, "serial");
+    OutByte(SERIAL_PORT + 1, 0x00);             // 关闭中断
+    OutByte(SERIAL_PORT + 3, 0x80);             // 设置波特率除数
+    OutByte(SERIAL_PORT + 0, 0x01);             // 115200 / 1
+    OutByte(SERIAL_PORT + 1, 0x00);
+    OutByte(SERIAL_PORT + 3, 0x03);             // 8 位数据、无校验、1 位停止位
+    OutByte(SERIAL_PORT + 2, 0xc7);             // 开启并清空 FIFO
+    OutByte(SERIAL_PORT + 4, 0x03);             // DTR RTS
+}
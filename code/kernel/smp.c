@@ -0,0 +1,204 @@
+//  smp.c         by OrangeYYC
+//  TinyOS 多处理器的启动与管理在本文件中实现
+
+#include "common.h"
+
+#define STR(x)      #x
+#define XSTR(x)     STR(x)
+
+/* ========================== 当前处理器 ========================== */
+static u8 apicToCpu[256];           // APIC 编号到处理器编号的映射
+
+// 获取当前处理器的处理器结构
+CPU *ThisCpu() {
+    return &cpus[apicToCpu[LapicId()]];
+}
+
+// 端口延时函数，每次写 0x80 端口约 1 微秒
+static void IoDelay(u32 us) {
+    for (u32 i = 0; i < us; i++)
+        OutByte(0x80, 0);
+}
+
+// 多处理器初始化函数，在开启分页后调用
+// 确保启动处理器为 0 号处理器，并为每个处理器分配内核栈
+void SmpInit() {
+    u32 bsp = LapicId();
+    for (int i = 1; i < cpuCount; i++)
+        if (cpus[i].apicId == bsp) {
+            cpus[i].apicId = cpus[0].apicId;
+            cpus[0].apicId = bsp;
+        }
+    for (int i = 0; i < cpuCount; i++) {
+        CPU *cpu = &cpus[i];
+        cpu->id       = i;
+        cpu->readyPid = -1;
+        cpu->stackTop = i == 0 ? BSP_STACK_TOP : CPU_STACK_BASE + i * CPU_STACK_SIZE;
+        apicToCpu[cpu->apicId]   = i;
+        kernelStack[cpu->apicId] = cpu->stackTop;
+        irqStack[cpu->apicId]    = IRQ_STACK_BASE + (i + 1) * IRQ_STACK_SIZE;
+    }
+    cpus[0].started = 1;
+}
+
+/* ========================== 应用处理器启动代码 ========================== */
+// 应用处理器收到 STARTUP 中断后从 AP_TRAMPOLINE 处以实模式开始执行，
+// 这段代码被复制到 AP_TRAMPOLINE，加载全局描述符表后进入保护模式并跳转到 ApEntry，
+// 之后按本处理器的 APIC 编号从 kernelStack 取得栈顶，晚于等待时间启动的处理器也不会与其他处理器共用栈
+// 启动代码从 kernel.bin 中复制，必须放在 .text 段中，不能跟随前面的变量进入 .bss 段
+void ApTrampoline();
+void ApTrampolineEnd();
+void ApEntry();
+void ApMain();
+
+asm (
+".pushsection .text\n"
+".code16\n"
+"ApTrampoline:\n"
+    "cli\n"
+    "xorw   %ax, %ax\n"             // 设置 ds = 0
+    "movw   %ax, %ds\n"
+    "lgdtl  gdtPtr\n"               // 加载全局描述符表
+    "movl   %cr0, %eax\n"           // 修改控制寄存器进入保护模式
+    "orl    $0x1, %eax\n"
+    "movl   %eax, %cr0\n"
+    "ljmpl  $0x8, $ApEntry\n"       // 长跳转进入 32 位代码
+"ApTrampolineEnd:\n"
+".code32\n"
+"ApEntry:\n"
+    "movw   $0x10, %ax\n"           // 初始化寄存器
+    "movw   %ax, %ds\n"
+    "movw   %ax, %es\n"
+    "movw   %ax, %fs\n"
+    "movw   %ax, %ss\n"
+    "movw   $0x1B, %ax\n"
+    "movw   %ax, %gs\n"
+    "movl   kernelCr4, %eax\n"     // 与启动处理器相同的 cr4 设置(PAE 分页、SSE)
+    "testl  %eax, %eax\n"
+    "jz     1f\n"
+    "movl   %cr4, %ebx\n"
+    "orl    %ebx, %eax\n"
+    "movl   %eax, %cr4\n"
+    "1:\n"
+    "movl   $" XSTR(PAGE_DIR_BASE) ", %eax\n"     // 使用内核页表开启分页
+    "movl   %eax, %cr3\n"
+    "movl   %cr0, %eax\n"
+    "orl    $0x80000000, %eax\n"
+    "movl   %eax, %cr0\n"
+    "movl   lapicBase, %eax\n"      // 取得本处理器的 APIC 编号
+    "movl   0x20(%eax), %eax\n"
+    "shrl   $24, %eax\n"
+    "movl   kernelStack(,%eax,4), %esp\n"    // 切换到本处理器的内核栈
+    "call   ApMain\n"
+".popsection\n"
+);
+
+// 应用处理器的主函数
+void ApMain() {
+    CPU *cpu = ThisCpu();
+    // 设置本处理器的全局描述符表和任务状态段，加载中断向量表
+    SetupCpu(cpu);
+    __asm__ __volatile__ (
+        "lidt %0\n"
+        ::"m"(idtPtr)
+    );
+    // 与启动处理器使用相同的页属性表
+    if (kernelPat)
+        WriteMsr(MSR_PAT, kernelPat);
+    // 开启本地 APIC 和本地定时器
+    LapicInit();
+    LapicTimerPeriodic(TIMER_HZ);
+    cpu->started = 1;
+#ifdef SMP_BENCH
+    SmpBenchWorker(cpu);
+#endif
+    // 选择并执行任务
+    SpinLock(&schedLock);
+    choose(0);
+    restart();
+}
+
+// 启动应用处理器的函数
+// 对每个应用处理器依次发送 INIT 和两次 STARTUP 处理器间中断，并等待其完成启动
+void SmpBoot() {
+    if (cpuCount < 2 || !lapicBase)
+        return;
+    Print("[KERNEL] Starting Application Processors\n", F_Cyan | L_Light);
+    // 复制启动代码
+    memcpy((void *)AP_TRAMPOLINE, ApTrampoline, (u32)ApTrampolineEnd - (u32)ApTrampoline);
+    for (int i = 1; i < cpuCount; i++) {
+        CPU *cpu = &cpus[i];
+        LapicSendIpi(cpu->apicId, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+        PitWaitMs(10);
+        LapicSendIpi(cpu->apicId, ICR_INIT | ICR_LEVEL);
+        for (int j = 0; j < 2; j++) {
+            LapicSendIpi(cpu->apicId, ICR_STARTUP | (AP_TRAMPOLINE >> 12));
+            IoDelay(200);
+        }
+        // 最多等待 100 毫秒
+        for (int t = 0; t < 100000 && !cpu->started; t++)
+            IoDelay(1);
+        Print("CPU ", F_White);
+        PrintDecimal(i, F_White | L_Light);
+        Print(cpu->started ? " Started\n" : " Failed\n", cpu->started ? F_Green | L_Light : F_Red | L_Light);
+    }
+}
+
+#ifdef SMP_BENCH
+/* ========================== 多处理器扩展性基准测试 ========================== */
+// 将固定的计算任务平均分给 1 到 N 个处理器并行执行，测量完成时间和加速比
+#define BENCH_UNITS         64          // 计算任务的总单元数
+#define BENCH_UNIT_LOOPS    200000      // 每个单元的循环次数
+
+static volatile u32 benchRound    = 0;  // 测试轮次，改变时工作处理器开始计算
+static volatile u32 benchWorkers  = 0;  // 本轮参与计算的处理器数量
+static volatile u32 benchDone     = 0;  // 本轮完成计算的应用处理器数量
+static volatile u32 benchFinished = 0;  // 测试全部结束
+static volatile u32 benchSink     = 0;  // 计算结果，防止计算被优化掉
+
+// 处理器 id 完成分配给自己的计算单元
+static void BenchShare(u32 id) {
+    u32 x = id + 1;
+    for (u32 unit = id; unit < BENCH_UNITS; unit += benchWorkers)
+        for (u32 i = 0; i < BENCH_UNIT_LOOPS; i++)
+            x = x * 1103515245 + 12345;
+    benchSink += x;
+}
+
+// 应用处理器在进入调度之前参与基准测试
+void SmpBenchWorker(CPU *cpu) {
+    u32 seen = 0;
+    while (!benchFinished) {
+        if (benchRound == seen)
+            continue;
+        seen = benchRound;
+        if (cpu->id < benchWorkers) {
+            BenchShare(cpu->id);
+            __asm__ __volatile__ ("lock incl %0" : "+m"(benchDone));
+        }
+    }
+}
+
+// 扩展性基准测试函数，在启动应用处理器之后由启动处理器调用
+// 输出每种处理器数量下的完成时间(K 周期)和相对单处理器的加速比
+void SmpBenchmark() {
+    Print("[KERNEL] SMP Scaling Benchmark\n", F_Cyan | L_Light);
+    u32 base = 0;
+    for (u32 n = 1; n <= cpuCount && cpus[n - 1].started; n++) {
+        benchWorkers = n;
+        benchDone    = 0;
+        u64 start    = ReadTsc();
+        benchRound++;
+        BenchShare(0);
+        while (benchDone < n - 1) ;
+        u32 kcycles = (u32)((ReadTsc() - start) >> 10);
+        if (n == 1)
+            base = kcycles;
+        Print("[SMP] cpus ", F_Cyan | L_Light);  PrintDecimal(n, F_White | L_Light);
+        Print(" kcycles ", F_White);              PrintDecimal(kcycles, F_White | L_Light);
+        Print(" speedup ", F_White);              PrintDecimal(base * 100 / kcycles, F_White | L_Light);
+        Print("%\n", F_White);
+    }
+    benchFinished = 1;
+}
+#endif
\ No newline at end of file
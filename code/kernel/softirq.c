@@ -0,0 +1,164 @@
+//  softirq.c         by OrangeYYC
+//  TinyOS 中断的下半部: 软中断、小任务与工作队列
+//
+//  中断处理分为两部分: 上半部在关中断状态下只响应设备并登记要做的工作，
+//  下半部在中断返回前以开中断状态执行，执行期间到来的中断只执行上半部，
+//  需要睡眠的工作交给工作队列内核线程执行
+
+#include "common.h"
+
+/* ========================== 关中断时间统计 ========================== */
+// 开启 IRQ_STAT 时记录每个处理器最长的关中断时间
+// 统计的区间为中断处理中关中断执行的部分和 SpinLockIrqSave 保护的临界区
+
+// 开始关中断
+void IrqOffBegin(CPU *cpu) {
+#ifdef IRQ_STAT
+    cpu->irqOffStart = ReadTsc();
+#endif
+}
+
+// 结束关中断，更新最长关中断时间
+void IrqOffEnd(CPU *cpu) {
+#ifdef IRQ_STAT
+    if (!cpu->irqOffStart)
+        return;
+    u64 cycles = ReadTsc() - cpu->irqOffStart;
+    if (cycles > cpu->irqOffMax)
+        cpu->irqOffMax = cycles;
+    cpu->irqOffStart = 0;
+#endif
+}
+
+#ifdef IRQ_STAT
+// 输出每个处理器最长的关中断时间(微秒)、最大中断嵌套深度和补上的节拍数，在屏幕第 row 行
+void IrqStatDump(u32 row) {
+    SetCursor(row, 0);
+    Print("[IRQ] max irq-off us", F_Cyan | L_Light);
+    u32 perUs = tscPerMs / 1000;
+    for (u32 i = 0; i < cpuCount; i++) {
+        Print(" ", F_White);
+        PrintDecimal(perUs ? (u32)cpus[i].irqOffMax / perUs : 0, F_White | L_Light);
+    }
+    Print(" depth", F_White);
+    for (u32 i = 0; i < cpuCount; i++) {
+        Print(" ", F_White);
+        PrintDecimal(cpus[i].irqDepthMax, F_White | L_Light);
+    }
+    Print(" lost", F_White);
+    for (u32 i = 0; i < cpuCount; i++) {
+        Print(" ", F_White);
+        PrintDecimal(cpus[i].lostTicks, F_White | L_Light);
+    }
+    Print("    \n", F_White);
+}
+#endif
+
+/* ========================== 软中断 ========================== */
+static void (*softirqHandlers[SOFTIRQ_COUNT])();   // 软中断处理函数
+
+// 登记编号为 nr 的软中断的处理函数
+void SoftirqRegister(u32 nr, void (*handler)()) {
+    softirqHandlers[nr] = handler;
+}
+
+// 在当前处理器上触发软中断，需要在关中断状态下调用
+void RaiseSoftirq(u32 nr) {
+    ThisCpu()->softirqPending |= 1 << nr;
+}
+
+// 执行当前处理器上等待的软中断，在中断处理的外层以关中断状态调用，返回时仍为关中断
+// 执行期间开中断，新触发的软中断在本轮结束后继续执行，最多重复 SOFTIRQ_RESTART 轮
+void RunSoftirqs(CPU *cpu) {
+    for (int round = 0; round < SOFTIRQ_RESTART && cpu->softirqPending; round++) {
+        u32 pending = cpu->softirqPending;
+        cpu->softirqPending = 0;
+        IrqOffEnd(cpu);
+        __asm__ __volatile__ ("sti" ::: "memory");
+        for (u32 nr = 0; nr < SOFTIRQ_COUNT; nr++)
+            if ((pending & (1 << nr)) && softirqHandlers[nr])
+                softirqHandlers[nr]();
+        __asm__ __volatile__ ("cli" ::: "memory");
+        IrqOffBegin(cpu);
+    }
+}
+
+/* ========================== 小任务 ========================== */
+// 将小任务加入当前处理器的链表，已经排队的小任务不会重复加入
+void TaskletSchedule(Tasklet *tasklet) {
+    u32 flags = IrqSave();
+    if (!tasklet->scheduled) {
+        CPU *cpu = ThisCpu();
+        tasklet->scheduled = 1;
+        tasklet->next      = cpu->tasklets;
+        cpu->tasklets      = tasklet;
+        RaiseSoftirq(SOFTIRQ_TASKLET);
+    }
+    IrqRestore(flags);
+}
+
+// 小任务软中断，取下当前处理器的整个链表依次执行
+static void TaskletSoftirq() {
+    __asm__ __volatile__ ("cli" ::: "memory");
+    CPU *cpu = ThisCpu();
+    Tasklet *list = cpu->tasklets;
+    cpu->tasklets = 0;
+    __asm__ __volatile__ ("sti" ::: "memory");
+    while (list) {
+        Tasklet *tasklet = list;
+        list = list->next;
+        tasklet->scheduled = 0;
+        tasklet->func(tasklet->data);
+    }
+}
+
+/* ========================== 工作队列 ========================== */
+static Spinlock   workLock    = {};     // 保护工作队列
+static Work      *workHead    = 0;      // 队首
+static Work      *workTail    = 0;      // 队尾
+static WaitQueue  workWaiters = {};     // 等待工作的内核线程
+static u32        workerPid   = -1;     // 工作队列内核线程的 pid
+
+// 将工作加入工作队列并唤醒工作线程，已经排队的工作不会重复加入，可以在中断处理中调用
+void WorkSchedule(Work *work) {
+    u32 flags = SpinLockIrqSave(&workLock);
+    if (!work->pending) {
+        work->pending = 1;
+        work->next    = 0;
+        if (workTail)
+            workTail->next = work;
+        else
+            workHead = work;
+        workTail = work;
+        WaitQueueWakeOne(&workWaiters);
+    }
+    SpinUnlockIrqRestore(&workLock, flags);
+}
+
+// 工作队列内核线程，依次执行队列中的工作，队列为空时睡眠
+static void WorkerThread() {
+    for (;;) {
+        u32 flags = SpinLockIrqSave(&workLock);
+        while (!workHead) {
+            WaitQueueSleep(&workWaiters, &process[workerPid]);
+            SpinUnlockIrqRestore(&workLock, flags);
+            Yield();
+            flags = SpinLockIrqSave(&workLock);
+        }
+        Work *work = workHead;
+        workHead = work->next;
+        if (!workHead)
+            workTail = 0;
+        work->pending = 0;
+        SpinUnlockIrqRestore(&workLock, flags);
+        work->func(work);
+    }
+}
+
+/* ========================== 下半部初始化 ========================== */
+// 下半部初始化函数，登记小任务软中断并创建工作队列内核线程，在创建用户任务之后调用
+void SoftirqInit() {
+    SpinInit(&workLock, "work");
+    SoftirqRegister(SOFTIRQ_TASKLET, TaskletSoftirq);
+    workerPid = KernelThreadCreate(WorkerThread, KTHREAD_PRIORITY, SCHED_POLICY);
+}
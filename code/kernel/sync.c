@@ -0,0 +1,307 @@
+//  sync.c         by OrangeYYC
+//  TinyOS 内核同步原语: 自旋锁、读写锁、顺序锁、等待队列、互斥锁与信号量
+//
+//  使用规则:
+//  1. 自旋锁、读写锁和顺序锁的持有时间必须很短，持有期间不能睡眠
+//  2. 会在中断处理函数中获取的锁，在其他地方必须使用 SpinLockIrqSave 获取，
+//     否则持锁时到来的中断会在同一处理器上死锁；中断处理函数运行时中断已关闭，直接使用 SpinLock
+//  3. 互斥锁和信号量只能代表任务获取，获取失败时任务被阻塞，
+//     调用者随后应当重新调度，任务被唤醒时已经持有互斥锁或信号量
+//  4. 释放互斥锁、信号量和唤醒等待队列的函数可以在中断处理函数中调用
+//  5. 多个锁嵌套时的顺序: 互斥锁/信号量/等待队列的锁 -> schedLock，不能反向获取
+
+#include "common.h"
+
+// 编译器屏障，防止编译器将内存访问移过此处
+#define Barrier()   __asm__ __volatile__ ("" ::: "memory")
+
+// 自旋等待时的提示指令，在不支持的处理器上等价于 nop
+static inline void Pause() {
+    __asm__ __volatile__ ("rep; nop" ::: "memory");
+}
+
+// 比较并交换，*ptr 等于 old 时写入 new，返回 *ptr 原来的值
+static inline u32 Cmpxchg(volatile u32 *ptr, u32 old, u32 new) {
+    u32 prev;
+    __asm__ __volatile__ (
+        "lock cmpxchgl %2, %1\n"
+        : "=a"(prev), "+m"(*ptr)
+        : "r"(new), "0"(old)
+        : "memory"
+    );
+    return prev;
+}
+
+/* ========================== 中断开关 ========================== */
+// 关闭中断，返回关闭前的标志寄存器
+u32 IrqSave() {
+    u32 flags;
+    __asm__ __volatile__ (
+        "pushfl\n"
+        "popl   %0\n"
+        "cli\n"
+        : "=r"(flags) :: "memory"
+    );
+#ifdef IRQ_STAT
+    if (flags & EFLAGS_IF)
+        IrqOffBegin(ThisCpu());
+#endif
+    return flags;
+}
+
+// 恢复 IrqSave 保存的中断状态
+void IrqRestore(u32 flags) {
+    if (flags & EFLAGS_IF) {
+#ifdef IRQ_STAT
+        IrqOffEnd(ThisCpu());
+#endif
+        __asm__ __volatile__ ("sti" ::: "memory");
+    }
+}
+
+/* ========================== 锁统计 ========================== */
+#ifdef LOCK_STAT
+static Spinlock *lockList[LOCK_STAT_MAX];       // 记录统计信息的锁
+static u32       lockListCount = 0;
+
+// 输出所有登记的锁的统计信息，从屏幕第 row 行开始
+// acq: 获取次数  cont: 需要等待的次数  spin: 等待的总周期数(K)  hold: 最长持有周期数
+void LockStatDump(u32 row) {
+    SetCursor(row, 0);
+    for (u32 i = 0; i < lockListCount; i++) {
+        Spinlock *lock = lockList[i];
+        Print("[LOCK] ", F_Cyan | L_Light);  Print(lock->name, F_White | L_Light);
+        Print(" acq ",   F_White);           PrintDecimal(lock->acquires, F_White | L_Light);
+        Print(" cont ",  F_White);           PrintDecimal(lock->contended, F_White | L_Light);
+        Print(" spin ",  F_White);           PrintDecimal((u32)(lock->spinCycles >> 10), F_White | L_Light);
+        Print("K hold ", F_White);           PrintDecimal((u32)lock->maxHold, F_White | L_Light);
+        Print("    \n",  F_White);
+    }
+}
+#endif
+
+/* ========================== 自旋锁 ========================== */
+// 初始化自旋锁，开启锁统计时以 name 登记
+void SpinInit(Spinlock *lock, char *name) {
+    lock->next  = 0;
+    lock->owner = 0;
+#ifdef LOCK_STAT
+    lock->name       = name;
+    lock->acquires   = 0;
+    lock->contended  = 0;
+    lock->spinCycles = 0;
+    lock->maxHold    = 0;
+    if (lockListCount < LOCK_STAT_MAX)
+        lockList[lockListCount++] = lock;
+#endif
+}
+
+// 获取自旋锁，原子地取得排队号后等待轮到自己
+void SpinLock(Spinlock *lock) {
+    u32 ticket = 1;
+    __asm__ __volatile__ (
+        "lock xaddl %0, %1\n"
+        : "+r"(ticket), "+m"(lock->next)
+        :: "memory"
+    );
+#ifdef LOCK_STAT
+    u64 start = 0;
+    if (lock->owner != ticket) {
+        start = ReadTsc();
+        while (lock->owner != ticket)
+            Pause();
+        lock->spinCycles += ReadTsc() - start;
+        lock->contended++;
+    }
+    lock->acquires++;
+    lock->acquiredAt = ReadTsc();
+#else
+    while (lock->owner != ticket)
+        Pause();
+#endif
+    Barrier();
+}
+
+// 尝试获取自旋锁，成功返回 1，锁被占用时立即返回 0
+int SpinTryLock(Spinlock *lock) {
+    u32 owner = lock->owner;
+    if (Cmpxchg(&lock->next, owner, owner + 1) != owner)
+        return 0;
+#ifdef LOCK_STAT
+    lock->acquires++;
+    lock->acquiredAt = ReadTsc();
+#endif
+    return 1;
+}
+
+// 释放自旋锁，将锁交给下一个排队号
+void SpinUnlock(Spinlock *lock) {
+#ifdef LOCK_STAT
+    u64 hold = ReadTsc() - lock->acquiredAt;
+    if (hold > lock->maxHold)
+        lock->maxHold = hold;
+#endif
+    Barrier();
+    lock->owner = lock->owner + 1;
+}
+
+// 关闭中断并获取自旋锁，返回关闭前的标志寄存器
+u32 SpinLockIrqSave(Spinlock *lock) {
+    u32 flags = IrqSave();
+    SpinLock(lock);
+    return flags;
+}
+
+// 释放自旋锁并恢复中断状态
+void SpinUnlockIrqRestore(Spinlock *lock, u32 flags) {
+    SpinUnlock(lock);
+    IrqRestore(flags);
+}
+
+/* ========================== 读写锁 ========================== */
+// 获取读锁，没有写者持有或等待时读者计数加一
+void ReadLock(RWLock *lock) {
+    for (;;) {
+        u32 count = lock->count;
+        if (!(count & (RW_WRITER | RW_WAITING)) && Cmpxchg(&lock->count, count, count + 1) == count)
+            break;
+        Pause();
+    }
+    Barrier();
+}
+
+// 释放读锁
+void ReadUnlock(RWLock *lock) {
+    Barrier();
+    __asm__ __volatile__ ("lock decl %0" : "+m"(lock->count) :: "memory");
+}
+
+// 获取写锁，先设置等待标记阻止新的读者进入，再等待已有的读者全部离开
+void WriteLock(RWLock *lock) {
+    for (;;) {
+        __asm__ __volatile__ ("lock orl %1, %0" : "+m"(lock->count) : "i"(RW_WAITING) : "memory");
+        if (Cmpxchg(&lock->count, RW_WAITING, RW_WRITER) == RW_WAITING)
+            break;
+        Pause();
+    }
+}
+
+// 释放写锁
+void WriteUnlock(RWLock *lock) {
+    Barrier();
+    lock->count = 0;
+}
+
+/* ========================== 顺序锁 ========================== */
+// 写者开始写入，序号变为奇数，写者之间用自旋锁互斥
+void WriteSeqLock(SeqLock *lock) {
+    SpinLock(&lock->lock);
+    lock->seq++;
+    Barrier();
+}
+
+// 写者结束写入，序号变回偶数
+void WriteSeqUnlock(SeqLock *lock) {
+    Barrier();
+    lock->seq++;
+    SpinUnlock(&lock->lock);
+}
+
+// 读者开始读取，等待正在进行的写入结束，返回当前序号
+u32 ReadSeqBegin(SeqLock *lock) {
+    u32 seq;
+    while ((seq = lock->seq) & 1)
+        Pause();
+    Barrier();
+    return seq;
+}
+
+// 读者结束读取，读取期间发生过写入时返回 1，需要重新读取
+int ReadSeqRetry(SeqLock *lock, u32 seq) {
+    Barrier();
+    return lock->seq != seq;
+}
+
+/* ========================== 等待队列 ========================== */
+// 等待队列由使用者的锁保护，以下函数调用时需持有该锁
+
+// 将任务加入等待队列队尾并阻塞
+void WaitQueueSleep(WaitQueue *queue, PCB *pcb) {
+    queue->pids[(queue->head + queue->count++) % MAX_TASKS] = pcb->pid;
+    SchedSleep(pcb);
+}
+
+// 唤醒等待最久的任务，返回其 pid，队列为空时返回 -1
+u32 WaitQueueWakeOne(WaitQueue *queue) {
+    if (!queue->count)
+        return -1;
+    u32 pid = queue->pids[queue->head];
+    queue->head = (queue->head + 1) % MAX_TASKS;
+    queue->count--;
+    SchedWakeup(&process[pid]);
+    return pid;
+}
+
+// 唤醒队列中所有的任务
+void WaitQueueWakeAll(WaitQueue *queue) {
+    while (WaitQueueWakeOne(queue) != -1) ;
+}
+
+/* ========================== 互斥锁 ========================== */
+// 初始化互斥锁
+void MutexInit(Mutex *mutex, char *name) {
+    SpinInit(&mutex->lock, name);
+    mutex->owner         = -1;
+    mutex->waiters.head  = 0;
+    mutex->waiters.count = 0;
+}
+
+// 任务 pcb 获取互斥锁，成功返回 1
+// 互斥锁被占用时任务进入等待队列并阻塞，返回 0，任务被唤醒时已经持有互斥锁
+int MutexLock(Mutex *mutex, PCB *pcb) {
+    u32 flags = SpinLockIrqSave(&mutex->lock);
+    int acquired = mutex->owner == -1;
+    if (acquired)
+        mutex->owner = pcb->pid;
+    else
+        WaitQueueSleep(&mutex->waiters, pcb);
+    SpinUnlockIrqRestore(&mutex->lock, flags);
+    return acquired;
+}
+
+// 释放互斥锁，有任务等待时直接交给等待最久的任务
+void MutexUnlock(Mutex *mutex) {
+    u32 flags = SpinLockIrqSave(&mutex->lock);
+    mutex->owner = WaitQueueWakeOne(&mutex->waiters);
+    SpinUnlockIrqRestore(&mutex->lock, flags);
+}
+
+/* ========================== 信号量 ========================== */
+// 初始化信号量，初始资源数量为 count
+void SemInit(Semaphore *sem, u32 count, char *name) {
+    SpinInit(&sem->lock, name);
+    sem->count         = count;
+    sem->waiters.head  = 0;
+    sem->waiters.count = 0;
+}
+
+// 任务 pcb 获取信号量，成功返回 1
+// 资源数量为 0 时任务进入等待队列并阻塞，返回 0，任务被唤醒时已经获得资源
+int SemDown(Semaphore *sem, PCB *pcb) {
+    u32 flags = SpinLockIrqSave(&sem->lock);
+    int acquired = sem->count > 0;
+    if (acquired)
+        sem->count--;
+    else
+        WaitQueueSleep(&sem->waiters, pcb);
+    SpinUnlockIrqRestore(&sem->lock, flags);
+    return acquired;
+}
+
+// 释放信号量，有任务等待时直接交给等待最久的任务，否则资源数量加一
+void SemUp(Semaphore *sem) {
+    u32 flags = SpinLockIrqSave(&sem->lock);
+    if (WaitQueueWakeOne(&sem->waiters) == -1)
+        sem->count++;
+    SpinUnlockIrqRestore(&sem->lock, flags);
+}
@@ -0,0 +1,176 @@
+//  syscall.c         by OrangeYYC
+//  TinyOS 系统调用的分发与处理
+//
+//  系统调用通过 int 0x80 进入内核，调用号放在 eax 中，参数依次放在 ebx ecx edx esi 中，
+//  处理函数在关中断状态下执行，返回值写回任务栈帧的 eax；需要等待的调用使任务阻塞，
+//  由唤醒任务的一方完成调用并填写返回值
+
+#include "common.h"
+
+/* ========================== 系统调用处理函数 ========================== */
+// 读取输入 read(fd, buf, count)，目前只支持 0 号文件(键盘)
+static u32 SysRead(PCB *pcb) {
+    u32 fd    = pcb->regs.ebx;
+    u32 buf   = pcb->regs.ecx;
+    u32 count = pcb->regs.edx;
+    if (fd != 0 || !UserRangeOk(pcb, buf, count))
+        return -1;
+    return KeyboardRead(pcb, buf, count);
+}
+
+// 映射文件 mmap(name, length, flags)，返回映射的起始地址，失败时返回 -1
+// flags 为 MAP_ANON 时建立匿名内存，不使用 name
+static u32 SysMmap(PCB *pcb) {
+    char name[FS_NAME_LEN] = {};
+    u32  va    = pcb->regs.ebx;
+    u32  flags = pcb->regs.edx;
+    if (flags != MAP_ANON) {
+        if (!UserRangeOk(pcb, va, FS_NAME_LEN))
+            return -1;
+        CopyFromUser(pcb, va, name, FS_NAME_LEN);
+        name[FS_NAME_LEN - 1] = 0;
+    }
+    return Mmap(pcb, name, pcb->regs.ecx, flags);
+}
+
+// 写入输出 write(fd, buf, count)，1 号和 2 号文件为任务的控制台，FD_SERIAL 号文件为串口
+static u32 SysWrite(PCB *pcb) {
+    u32 fd    = pcb->regs.ebx;
+    u32 buf   = pcb->regs.ecx;
+    u32 count = pcb->regs.edx;
+    if ((fd != 1 && fd != 2 && fd != FD_SERIAL) || !UserRangeOk(pcb, buf, count))
+        return -1;
+    if (fd == FD_SERIAL)
+        return SerialWrite(pcb, buf, count);
+    return ConsoleWrite(pcb, buf, count);
+}
+
+// 结束任务 exit(code)，释放任务的文件映射，任务不再被调度
+static u32 SysExit(PCB *pcb) {
+#ifdef BENCH_SUITE
+    BenchTaskExit(pcb);
+#endif
+    MmRelease(pcb);
+    SchedExit(pcb);
+    return SYSCALL_BLOCKED;
+}
+
+// 让出处理器 yield()，由任务的调度类重新选择下一个任务，可能仍然选中该任务
+static u32 SysYield(PCB *pcb) {
+    ThisCpu()->yield = 1;
+    return 0;
+}
+
+// 成为实时任务 edf(period, budget, deadline)，单位为时钟节拍，通过接纳控制时返回 0，否则返回 -1
+static u32 SysEdf(PCB *pcb) {
+    return SchedSetEdf(pcb, pcb->regs.ebx, pcb->regs.ecx, pcb->regs.edx);
+}
+
+// 实时任务完成本周期的作业 wait_period()，在下一个周期开始时返回 0
+static u32 SysWaitPeriod(PCB *pcb) {
+    return SchedWaitPeriod(pcb);
+}
+
+// 系统调用参数中的任务编号 pid 对应的进程，PID_SELF 表示调用者 pcb，编号无效时返回 0
+static PCB *SyscallTarget(PCB *pcb, u32 pid) {
+    if (pid == PID_SELF)
+        return pcb;
+    if (pid >= procCount || process[pid].state == TASK_UNUSED)
+        return 0;
+    return &process[pid];
+}
+
+// 修改任务的优先级 setpriority(pid, priority)，在下一次调度时生效，成功返回 0
+// 只能修改用户任务，内核线程的优先级固定
+static u32 SysSetPriority(PCB *pcb) {
+    PCB *target = SyscallTarget(pcb, pcb->regs.ebx);
+    if (!target || (target->regs.cs & SA_RPL3) != SA_RPL3)
+        return -1;
+    return SchedSetPriority(target, pcb->regs.ecx);
+}
+
+// 读取任务的优先级 getpriority(pid)，编号无效时返回 -1
+static u32 SysGetPriority(PCB *pcb) {
+    PCB *target = SyscallTarget(pcb, pcb->regs.ebx);
+    return target ? target->priority : -1;
+}
+
+// 读取任务的资源使用统计 getrusage(pid, buf)，把 Rusage 结构复制到 buf，成功返回 0
+static u32 SysGetRusage(PCB *pcb) {
+    PCB *target = SyscallTarget(pcb, pcb->regs.ebx);
+    u32  buf    = pcb->regs.ecx;
+    if (!target || !UserRangeOk(pcb, buf, sizeof(Rusage)))
+        return -1;
+    Rusage usage = target->usage;
+    CopyToUser(pcb, buf, &usage, sizeof(Rusage));
+    return 0;
+}
+
+// 从任务地址 va 复制文件名，找到文件，地址无效或文件不存在时返回 0
+static FsEntry *SyscallFile(PCB *pcb, u32 va) {
+    char name[FS_NAME_LEN] = {};
+    if (!UserRangeOk(pcb, va, FS_NAME_LEN))
+        return 0;
+    CopyFromUser(pcb, va, name, FS_NAME_LEN);
+    name[FS_NAME_LEN - 1] = 0;
+    return FsLookup(name);
+}
+
+// 写入文件 pwrite(name, buf, count, offset)，返回写入的字节数，失败时返回 -1
+// 文件大小固定，超出文件结尾的部分不写入；数据进入页缓存后返回，之后由后台写回，需要写到硬盘时调用 fsync
+// 只覆盖一部分的页需要先从硬盘读入时任务阻塞，读入完成后重新执行整个调用(写入同样的数据到同样的位置)
+static u32 SysPwrite(PCB *pcb) {
+    u8  chunk[FILE_CHUNK];
+    FsEntry *entry = SyscallFile(pcb, pcb->regs.ebx);
+    u32 buf    = pcb->regs.ecx;
+    u32 count  = pcb->regs.edx;
+    u32 offset = pcb->regs.esi;
+    if (!entry || offset > entry->size || !UserRangeOk(pcb, buf, count))
+        return -1;
+    if (count > entry->size - offset)
+        count = entry->size - offset;
+    for (u32 done = 0, n; done < count; done += n) {
+        n = count - done < FILE_CHUNK ? count - done : FILE_CHUNK;
+        CopyFromUser(pcb, buf + done, chunk, n);
+        int ok = PageCacheWrite(entry, offset + done, chunk, n, pcb);
+        if (ok == PAGE_WAIT) {
+            pcb->regs.eip -= SYSCALL_INSN_SIZE;
+            return SYSCALL_BLOCKED;
+        }
+        if (!ok)
+            return done ? done : -1;
+    }
+    return count;
+}
+
+// 把文件写回硬盘 fsync(name)，写回文件的脏页并让硬盘写出缓存后返回 0，失败时返回 -1
+// 任务阻塞，由工作队列线程写回后填写返回值并唤醒任务
+static u32 SysFsync(PCB *pcb) {
+    FsEntry *entry = SyscallFile(pcb, pcb->regs.ebx);
+    return entry ? PageCacheFsync(pcb, entry) : -1;
+}
+
+/* ========================== 系统调用分发 ========================== */
+// 系统调用表，按调用号索引
+static u32 (*syscallTable[SYSCALL_COUNT])(PCB *pcb) = {
+    SysRead,
+    SysMmap,
+    SysWrite,
+    SysExit,
+    SysYield,
+    SysEdf,
+    SysWaitPeriod,
+    SysSetPriority,
+    SysGetPriority,
+    SysGetRusage,
+    SysPwrite,
+    SysFsync,
+};
+
+// 系统调用处理函数，处理当前任务 pcb 发起的系统调用
+void Syscall(PCB *pcb) {
+    u32 nr  = pcb->regs.eax;
+    u32 ret = nr < SYSCALL_COUNT ? syscallTable[nr](pcb) : -1;
+    if (ret != SYSCALL_BLOCKED)
+        pcb->regs.eax = ret;
+}
@@ -0,0 +1,100 @@
+#include "lib.h"
+
+// 基准测试套件的驱动任务: 在 Ring3 测量系统调用、时钟中断和任务切换的开销，
+// 结果按 "BENCH 名称 数值 单位" 的格式写到串口，结束后内核关闭模拟器
+#define ROUNDS          1000        // 每项测量的次数
+#define BATCH           100         // 系统调用每批连续执行的次数
+#define GAPS            50          // 统计的时钟中断次数
+
+// 输出一行结果
+static void Report(char *name, u32 value, char *unit) {
+    char line[64];
+    char digits[10];
+    u32  n = 0, d = 0;
+    memcpy(line, "BENCH ", 6);
+    n = 6;
+    memcpy(line + n, name, strlen(name));
+    n += strlen(name);
+    line[n++] = ' ';
+    do {
+        digits[d++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (d)
+        line[n++] = digits[--d];
+    line[n++] = ' ';
+    memcpy(line + n, unit, strlen(unit));
+    n += strlen(unit);
+    line[n++] = '\n';
+    Write(FD_SERIAL, line, n);
+}
+
+// 系统调用: 每批连续执行 BATCH 次写入 0 字节，取平均值最小的一批，排除时钟中断和切换的影响
+static void BenchSyscall() {
+    char buf[1];
+    u32  best = -1;
+    for (u32 r = 0; r < ROUNDS / BATCH * 10; r++) {
+        u64 start = ReadTsc();
+        for (u32 i = 0; i < BATCH; i++)
+            Write(FD_SERIAL, buf, 0);
+        u32 t = (u32)(ReadTsc() - start) / BATCH;
+        if (t < best)
+            best = t;
+    }
+    Report("syscall_null", best, "cycles");
+}
+
+// 时钟中断: 连续读取时间戳计数器，两次读取的间隔远大于平时的间隔时说明发生了中断，
+// 间隔包括进入中断、时钟处理、调度和返回任务的全部时间
+static void BenchClock() {
+    u32 base = -1;
+    u64 last = ReadTsc();
+    for (u32 i = 0; i < ROUNDS; i++) {
+        u64 now = ReadTsc();
+        if ((u32)(now - last) < base)
+            base = (u32)(now - last);
+        last = now;
+    }
+    u32 threshold = base * 20 > 1000 ? base * 20 : 1000;
+    u32 gaps = 0, best = -1, sum = 0;
+    last = ReadTsc();
+    while (gaps < GAPS) {
+        u64 now = ReadTsc();
+        u32 t = (u32)(now - last);
+        last = now;
+        if (t < threshold)
+            continue;
+        gaps++;
+        sum += t;
+        if (t < best)
+            best = t;
+    }
+    Report("clock_int_min", best, "cycles");
+    Report("clock_int_avg", sum / GAPS, "cycles");
+}
+
+// 任务切换: 让出处理器后 bench2 执行并立即让出，回到本任务经过两次系统调用、两次切换(包括页目录切换)
+static void BenchSwitch() {
+    u32 best = -1, sum = 0;
+    for (u32 i = 0; i < ROUNDS; i++) {
+        u64 start = ReadTsc();
+        Yield();
+        u32 t = (u32)(ReadTsc() - start);
+        sum += t;
+        if (t < best)
+            best = t;
+    }
+    Report("ctx_switch_min", best / 2, "cycles");
+    Report("ctx_switch_avg", sum / ROUNDS / 2, "cycles");
+}
+
+int main() {
+    MoveTo(16, 30);
+    SetColor(F_Cyan | L_Light);
+    Puts("Benchmark running, results on serial port");
+    Flush();
+    BenchSyscall();
+    BenchClock();
+    BenchSwitch();
+    return 0;
+}
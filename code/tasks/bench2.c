@@ -0,0 +1,7 @@
+#include "lib.h"
+
+// 基准测试套件的陪同任务: 不断让出处理器，与 bench1 构成切换的另一方
+int main() {
+    while (1)
+        Yield();
+}
@@ -0,0 +1,17 @@
+//  crt0.c         by OrangeYYC
+//  TinyOS 任务的启动代码
+//
+//  内核从虚拟地址 0x100000 开始执行任务，链接脚本把 .text.start 段放在最前面；
+//  启动代码将栈顶对齐到 16 字节后调用 main，main 返回后以其返回值结束任务
+
+asm (
+".section .text.start\n"
+".globl _start\n"
+"_start:\n"
+    "andl   $0xfffffff0, %esp\n"    // 内核设置的栈顶为 0x10ffff
+    "call   main\n"
+    "pushl  %eax\n"
+    "call   Exit\n"                 // 输出缓冲区中剩余的内容并结束任务
+    "1:\n"
+    "jmp    1b\n"
+);
@@ -1,18 +1,183 @@
 #include "lib.h"
 
-// 写显存辅助函数
-static void WriteToVedio(u32 code, u32 pos) {
+/* ========================== 系统调用 ========================== */
+// 系统调用: 调用号为 nr，参数依次放在 ebx ecx edx 中
+static u32 Syscall(u32 nr, u32 a, u32 b, u32 c) {
+    u32 ret;
     __asm__ __volatile__ (
-        "movw   %%ax, %%gs:(%%ebx)\n"
-        :: "a"(code), "b"(pos)
+        "int    $0x80\n"
+        : "=a"(ret)
+        : "a"(nr), "b"(a), "c"(b), "d"(c)
+        : "memory"
     );
+    return ret;
 }
 
-// 字符串定位输出函数
-void PrintAtPos(char *message, int color, int x, int y) {
-    for (char *c = message; *c; c++) {
-        u32 code = ((*c) & 0xff) | color;
-        u32 pos  = (80 * x + y++) * 2;
-        WriteToVedio(code, pos);
-    }
-}
\ No newline at end of file
+// 系统调用: 调用号为 nr，参数依次放在 ebx ecx edx esi 中
+static u32 Syscall4(u32 nr, u32 a, u32 b, u32 c, u32 d) {
+    u32 ret;
+    __asm__ __volatile__ (
+        "int    $0x80\n"
+        : "=a"(ret)
+        : "a"(nr), "b"(a), "c"(b), "d"(c), "S"(d)
+        : "memory"
+    );
+    return ret;
+}
+
+// 系统调用: 从文件 fd 读取最多 count 字节到 buf，返回读取的字节数，没有输入时阻塞
+u32 Read(u32 fd, char *buf, u32 count) {
+    return Syscall(SYS_READ, fd, (u32)buf, count);
+}
+
+// 系统调用: 将 buf 中的 count 字节写到文件 fd(1 为控制台，FD_SERIAL 为串口)，返回写入的字节数
+u32 Write(u32 fd, char *buf, u32 count) {
+    return Syscall(SYS_WRITE, fd, (u32)buf, count);
+}
+
+// 系统调用: 映射文件 name 开头的 length 字节(0 表示整个文件)，返回映射的地址，失败时返回 -1
+void *Mmap(char *name, u32 length, u32 flags) {
+    return (void *)Syscall(SYS_MMAP, (u32)name, length, flags);
+}
+
+// 系统调用: 输出缓冲区中剩余的内容后结束任务，不会返回
+void Exit(u32 code) {
+    Flush();
+    Syscall(SYS_EXIT, code, 0, 0);
+}
+
+// 系统调用: 让出处理器
+void Yield() {
+    Syscall(SYS_YIELD, 0, 0, 0);
+}
+
+// 系统调用: 成为实时任务，每 period 个节拍执行一个作业，作业最多执行 budget 个节拍，
+// 需要在 deadline 个节拍内完成(0 表示等于周期)；内核接纳时返回 0，否则返回 -1
+u32 Edf(u32 period, u32 budget, u32 deadline) {
+    return Syscall(SYS_EDF, period, budget, deadline);
+}
+
+// 系统调用: 实时任务完成本周期的作业，下一个周期开始时返回
+void WaitPeriod() {
+    Syscall(SYS_WAIT_PERIOD, 0, 0, 0);
+}
+
+// 系统调用: 把任务 pid(PID_SELF 为自己)的优先级改为 priority，下一次调度时生效，成功返回 0
+u32 SetPriority(u32 pid, u32 priority) {
+    return Syscall(SYS_SETPRIORITY, pid, priority, 0);
+}
+
+// 系统调用: 读取任务 pid 的优先级，编号无效时返回 -1
+u32 GetPriority(u32 pid) {
+    return Syscall(SYS_GETPRIORITY, pid, 0, 0);
+}
+
+// 系统调用: 读取任务 pid 的资源使用统计到 usage，成功返回 0
+u32 GetRusage(u32 pid, Rusage *usage) {
+    return Syscall(SYS_GETRUSAGE, pid, (u32)usage, 0);
+}
+
+// 系统调用: 把 buf 中的 count 字节写到文件 name 的 offset 处，返回写入的字节数，失败时返回 -1
+// 文件大小固定，超出结尾的部分不写入；数据之后由内核写回硬盘，需要保证写到硬盘时调用 Fsync
+u32 PWrite(char *name, char *buf, u32 count, u32 offset) {
+    return Syscall4(SYS_PWRITE, (u32)name, (u32)buf, count, offset);
+}
+
+// 系统调用: 把文件 name 写入的内容写回硬盘，完成后返回 0，失败时返回 -1
+u32 Fsync(char *name) {
+    return Syscall(SYS_FSYNC, (u32)name, 0, 0);
+}
+
+// 读取时间戳计数器，内核没有禁止 Ring3 使用 rdtsc
+u64 ReadTsc() {
+    u64 rv;
+    __asm__ __volatile__ ("rdtsc\n" : "=A"(rv));
+    return rv;
+}
+
+/* ========================== 缓冲输出 ========================== */
+static char outBuf[OUT_BUF_SIZE];       // 输出缓冲区
+static u32  outLen = 0;                 // 缓冲区中的字节数
+
+// VGA 颜色编号(黑 蓝 绿 青 红 品红 棕 白)对应的 ANSI 颜色编号
+static char ansiColor[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+// 将缓冲区中的内容写到控制台
+void Flush() {
+    if (outLen)
+        Write(1, outBuf, outLen);
+    outLen = 0;
+}
+
+// 输出一个字符，缓冲区满或输出换行时写到控制台
+void Putc(char ch) {
+    outBuf[outLen++] = ch;
+    if (ch == '\n' || outLen == OUT_BUF_SIZE)
+        Flush();
+}
+
+// 输出字符串
+void Puts(char *s) {
+    while (*s)
+        Putc(*s++);
+}
+
+// 输出十进制数
+void PutDecimal(u32 value) {
+    char digits[10];
+    int  n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n)
+        Putc(digits[--n]);
+}
+
+// 输出移动光标的控制序列，行和列从 0 开始计数
+void MoveTo(int row, int col) {
+    Puts("\033[");
+    PutDecimal(row + 1);
+    Putc(';');
+    PutDecimal(col + 1);
+    Putc('H');
+}
+
+// 输出设置颜色的控制序列，color 使用 lib.h 中的颜色定义组合
+void SetColor(int color) {
+    Puts("\033[0;3");
+    Putc('0' + ansiColor[(color >> 8) & 7]);
+    Puts(";4");
+    Putc('0' + ansiColor[(color >> 12) & 7]);
+    if (color & L_Light)
+        Puts(";1");
+    if (color & Flicker)
+        Puts(";5");
+    Putc('m');
+}
+
+/* ========================== 内存与字符串 ========================== */
+// 复制 n 字节
+void *memcpy(void *dst, const void *src, u32 n) {
+    u8 *d = dst;
+    const u8 *s = src;
+    while (n--)
+        *d++ = *s++;
+    return dst;
+}
+
+// 将 n 字节设置为 value
+void *memset(void *dst, int value, u32 n) {
+    u8 *d = dst;
+    while (n--)
+        *d++ = value;
+    return dst;
+}
+
+// 字符串长度
+u32 strlen(const char *s) {
+    u32 n = 0;
+    while (s[n])
+        n++;
+    return n;
+}
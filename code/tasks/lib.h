@@ -1,11 +1,75 @@
 #ifndef _TASK_H_
 #define _TASK_H_
 
+typedef unsigned long long u64;
 typedef unsigned int    u32;
 typedef unsigned short  u16;
 typedef unsigned char    u8;
 
-void PrintAtPos(char *message, int color, int x, int y);
+// 任务的资源使用统计，与内核 defs.h 中的定义一致
+typedef struct s_rusage {
+    u32 userTicks;                  // 在用户态执行时经过的时钟节拍
+    u32 kernelTicks;                // 在内核中为该任务执行时经过的时钟节拍
+    u32 voluntary;                  // 主动切换次数
+    u32 involuntary;                // 被动切换次数
+    u32 faults;                     // 页错误次数
+} Rusage;
+
+// 系统调用
+u32   Read(u32 fd, char *buf, u32 count);
+u32   Write(u32 fd, char *buf, u32 count);
+void *Mmap(char *name, u32 length, u32 flags);
+void  Exit(u32 code);
+void  Yield();
+u32   Edf(u32 period, u32 budget, u32 deadline);
+void  WaitPeriod();
+u32   SetPriority(u32 pid, u32 priority);
+u32   GetPriority(u32 pid);
+u32   GetRusage(u32 pid, Rusage *usage);
+u32   PWrite(char *name, char *buf, u32 count, u32 offset);
+u32   Fsync(char *name);
+
+// 读取时间戳计数器
+u64   ReadTsc();
+
+// 缓冲输出，缓冲区满、输出换行或调用 Flush 时用一次 write 写到控制台
+void  Putc(char ch);
+void  Puts(char *s);
+void  PutDecimal(u32 value);
+void  MoveTo(int row, int col);
+void  SetColor(int color);
+void  Flush();
+
+// 内存与字符串函数
+void *memcpy(void *dst, const void *src, u32 n);
+void *memset(void *dst, int value, u32 n);
+u32   strlen(const char *s);
+
+// 输出缓冲区大小
+#define OUT_BUF_SIZE    128
+
+// 系统调用编号，与内核 defs.h 中的定义一致
+#define SYS_READ        0
+#define SYS_MMAP        1
+#define SYS_WRITE       2
+#define SYS_EXIT        3
+#define SYS_YIELD       4
+#define SYS_EDF         5
+#define SYS_WAIT_PERIOD 6
+#define SYS_SETPRIORITY 7
+#define SYS_GETPRIORITY 8
+#define SYS_GETRUSAGE   9
+#define SYS_PWRITE      10
+#define SYS_FSYNC       11
+#define PID_SELF        0xffffffff  // 表示调用者自己的任务编号
+
+// 写入串口的文件编号，与内核 defs.h 中的定义一致
+#define FD_SERIAL       3
+
+// 文件映射方式，与内核 defs.h 中的定义一致
+#define MAP_SHARED      1           // 只读共享
+#define MAP_PRIVATE     2           // 私有，写入时复制
+#define MAP_ANON        4           // 匿名内存，不使用文件名
 
 #define F_Black			0
 #define F_Blue			(1 << 8)
@@ -1,6 +1,24 @@
 #include "lib.h"
 
-void _start() {
-    while (1)
-        PrintAtPos("      VERY (TASK A)      ", F_Brown | B_Brown | L_Light, 16, 30);
+int main() {
+    // 只读共享地映射数据文件，显示其第一行
+    char *motd = Mmap("motd", 0, MAP_SHARED);
+    if (motd != (char *)-1) {
+        char line[61];
+        u32  n = 0;
+        while (n < 60 && motd[n] != '\n')
+            n++;
+        memcpy(line, motd, n);
+        line[n] = 0;
+        MoveTo(19, 0);
+        SetColor(F_White | L_Light);
+        Puts(line);
+        Flush();
+    }
+    while (1) {
+        MoveTo(16, 30);
+        SetColor(F_Brown | B_Brown | L_Light);
+        Puts("      VERY (TASK A)      ");
+        Flush();
+    }
 }
@@ -1,6 +1,33 @@
 #include "lib.h"
 
-void _start() {
-    while (1)
-        PrintAtPos("      LOVE (TASK B)      ", F_Red | B_Red | L_Light, 16, 30);
+int main() {
+    // 私有地映射同一个数据文件，改为大写后显示，写入的是自己的副本，不影响其他任务
+    char *motd = Mmap("motd", 0, MAP_PRIVATE);
+    if (motd != (char *)-1) {
+        int i;
+        for (i = 0; i < 60 && motd[i] != '\n'; i++)
+            if (motd[i] >= 'a' && motd[i] <= 'z')
+                motd[i] -= 'a' - 'A';
+        motd[i] = 0;
+        MoveTo(20, 0);
+        SetColor(F_White | L_Light);
+        Puts(motd);
+        Flush();
+    }
+    // 成为实时任务: 每 10 个节拍执行一次，每次最多 1 个节拍，不被接纳时仍作为普通任务执行
+    u32 realtime = Edf(10, 1, 0) == 0;
+    for (u32 jobs = 1; ; jobs++) {
+        MoveTo(16, 30);
+        SetColor(F_Red | B_Red | L_Light);
+        Puts("      LOVE (TASK B)      ");
+        if (realtime) {
+            MoveTo(22, 0);
+            SetColor(F_White | L_Light);
+            Puts("TASK B EDF jobs: ");
+            PutDecimal(jobs);
+        }
+        Flush();
+        if (realtime)
+            WaitPeriod();
+    }
 }
@@ -1,6 +1,30 @@
 #include "lib.h"
 
-void _start() {
-    while (1)
-        PrintAtPos("      HUST (TASK C)      ", F_Pink | B_Pink | L_Light, 16, 30);
+// 匿名内存的大小，页在第一次访问时由内核分配，优先使用高端内存
+#define HEAP_SIZE   (8 << 20)
+
+int main() {
+    // 申请匿名内存，逐页写入后检查，显示结果
+    u32 *heap = Mmap(0, HEAP_SIZE, MAP_ANON);
+    if (heap != (u32 *)-1) {
+        u32 pages = 0;
+        for (u32 i = 0; i < HEAP_SIZE / 4; i += 1024)
+            heap[i] = i;
+        for (u32 i = 0; i < HEAP_SIZE / 4; i += 1024)
+            pages += heap[i] == i;
+        MoveTo(21, 0);
+        SetColor(F_White | L_Light);
+        Puts("TASK C heap: ");
+        PutDecimal(pages * 4);
+        Puts("K of ");
+        PutDecimal(HEAP_SIZE >> 10);
+        Puts("K ok");
+        Flush();
+    }
+    while (1) {
+        MoveTo(16, 30);
+        SetColor(F_Pink | B_Pink | L_Light);
+        Puts("      HUST (TASK C)      ");
+        Flush();
+    }
 }
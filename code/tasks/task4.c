@@ -1,6 +1,82 @@
 #include "lib.h"
 
-void _start() {
-    while (1)
-        PrintAtPos("      MRSU (TASK D)      ", F_Cyan | B_Cyan | L_Light, 16, 30);
+// 执行 "nice 编号 优先级" 命令，修改任务的优先级，返回要显示的结果；不是该命令时返回 0
+static char *Nice(char *line) {
+    char *p = "nice ";
+    for (; *p; p++, line++)
+        if (*line != *p)
+            return 0;
+    u32 pid = 0, priority = 0;
+    if (*line < '0' || *line > '9')
+        return "usage: nice pid priority";
+    while (*line >= '0' && *line <= '9')
+        pid = pid * 10 + *line++ - '0';
+    if (*line++ != ' ' || *line < '0' || *line > '9')
+        return "usage: nice pid priority";
+    while (*line >= '0' && *line <= '9')
+        priority = priority * 10 + *line++ - '0';
+    if (*line || SetPriority(pid, priority))
+        return "nice failed";
+    return "priority changed";
+}
+
+// 执行 "save 文本" 命令，把文本和换行写到数据文件 scratch 的开头并写回硬盘，返回要显示的结果；不是该命令时返回 0
+static char *Save(char *line) {
+    char *p = "save ";
+    for (; *p; p++, line++)
+        if (*line != *p)
+            return 0;
+    u32 n = strlen(line);
+    line[n] = '\n';
+    u32 written = PWrite("scratch", line, n + 1, 0);
+    line[n] = 0;
+    if (written != n + 1 || Fsync("scratch"))
+        return "save failed";
+    return "saved to scratch";
+}
+
+// 交互型任务: 阻塞读取键盘输入并回显，其余任务为计算型
+// 输入 "nice 编号 优先级" 后回车可以在运行中修改任务的优先级，输入 "save 文本" 后回车把文本保存到硬盘上，
+// 结果显示在输入行上直到下一次按键
+int main() {
+    char line[51];
+    u32  pos = 0, shown = 0;
+    memset(line, 0, sizeof(line));
+    MoveTo(16, 30);
+    SetColor(F_Cyan | B_Cyan | L_Light);
+    Puts("      MRSU (TASK D)      ");
+    Flush();
+    while (1) {
+        char ch;
+        if (Read(0, &ch, 1) != 1)
+            continue;
+        if (shown) {
+            memset(line, 0, sizeof(line));
+            shown = 0;
+        }
+        if (ch == '\n' || pos == 50) {
+            char *result = ch == '\n' ? Nice(line) : 0;
+            if (ch == '\n' && !result)
+                result = Save(line);
+            memset(line, 0, sizeof(line));
+            pos = 0;
+            if (result) {
+                memcpy(line, result, strlen(result));
+                shown = 1;
+            }
+        } else if (ch == '\b') {
+            if (pos > 0)
+                line[--pos] = 0;
+        } else {
+            line[pos++] = ch;
+        }
+        // 整行一次写出，清除行尾残留的字符
+        MoveTo(17, 15);
+        SetColor(F_Cyan | L_Light);
+        Puts("> ");
+        SetColor(F_White | L_Light);
+        Puts(line);
+        Puts("\033[K");
+        Flush();
+    }
 }
@@ -0,0 +1,101 @@
+//  bench.c         by OrangeYYC
+//  TinyOS 内核代码的主机微基准测试
+//
+//  用法: kbench <硬盘镜像>
+//  每项测试的函数执行 n 次被测操作，n 从 1 开始倍增，直到一轮的时间超过 BENCH_MIN_NS，
+//  输出最后一轮中每次操作的平均时间
+
+#include <stdio.h>
+#include "hal.h"
+
+#define BENCH_MIN_NS    100000000ull    // 每项测试最后一轮至少运行的时间 (100ms)
+
+static volatile u32 sink;               // 防止编译器删除被测操作
+
+/* ========================== 测试项目 ========================== */
+static void BenchSetDesEntry(u32 n) {
+    Descriptor des;
+    for (u32 i = 0; i < n; i++) {
+        SetDesEntry(&des, i, 0xfffff, DA_DRW | DA_DPL3 | DA_32 | DA_LIMIT_4K);
+        sink = des.baseLow;
+    }
+}
+
+// 所有任务就绪，每次调用 choose(1) 消耗一个节拍
+static void BenchChoose(u32 n, u32 policy) {
+    for (u32 i = 0; i < MAX_TASKS; i++) {
+        process[i].pid      = i;
+        process[i].priority = 100 + i;
+        SchedSetup(&process[i], policy);
+    }
+    procCount = MAX_TASKS;
+    cpus[0].readyPid = -1;
+    for (u32 i = 0; i < n; i++)
+        choose(1);
+    sink = cpus[0].readyPid;
+}
+
+static void BenchChoosePriority(u32 n) { BenchChoose(n, SCHED_PRIORITY); }
+static void BenchChooseRR(u32 n)       { BenchChoose(n, SCHED_RR); }
+static void BenchChooseMLFQ(u32 n)     { BenchChoose(n, SCHED_MLFQ); }
+static void BenchChooseCFS(u32 n)      { BenchChoose(n, SCHED_CFS); }
+
+static void BenchSetProcessPageTable(u32 n) {
+    for (u32 i = 0; i < n; i++)
+        SetProcessPageTable(i % MAX_TASKS);
+}
+
+// 页缓存命中时装入任务
+static void BenchLoadCached(u32 n) {
+    taskName[0] = "task1";
+    for (u32 i = 0; i < n; i++)
+        sink = (u32)(unsigned long)ReadProcessToMemory(0);
+}
+
+// 每次装入前清空页缓存，从硬盘镜像读取
+static void BenchLoadCold(u32 n) {
+    taskName[0] = "task1";
+    for (u32 i = 0; i < n; i++) {
+        MmInit();
+        sink = (u32)(unsigned long)ReadProcessToMemory(0);
+    }
+}
+
+/* ========================== 运行测试 ========================== */
+static struct {
+    char *name;
+    void (*run)(u32 n);
+} benches[] = {
+    { "SetDesEntry",         BenchSetDesEntry         },
+    { "choose/PRIO",         BenchChoosePriority      },
+    { "choose/RR",           BenchChooseRR            },
+    { "choose/MLFQ",         BenchChooseMLFQ          },
+    { "choose/CFS",          BenchChooseCFS           },
+    { "SetProcessPageTable", BenchSetProcessPageTable },
+    { "LoadTask/cached",     BenchLoadCached          },
+    { "LoadTask/cold",       BenchLoadCold            },
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: kbench <image>\n");
+        return 2;
+    }
+    HalInit(argv[1]);
+    printf("%-24s %12s %12s\n", "Benchmark", "Time(ns)", "Iterations");
+    for (u32 b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        u32 n = 1;
+        u64 ns;
+        while (1) {
+            HalReset();
+            u64 start = HalNanoseconds();
+            benches[b].run(n);
+            ns = HalNanoseconds() - start;
+            if (ns >= BENCH_MIN_NS || n >= 0x40000000)
+                break;
+            n *= 2;
+        }
+        printf("%-24s %12.1f %12u\n", benches[b].name, (double)ns / n, n);
+    }
+    return 0;
+}
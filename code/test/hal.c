@@ -0,0 +1,211 @@
+//  hal.c         by OrangeYYC
+//  TinyOS 主机测试的硬件抽象层
+//
+//  在 Linux 上运行内核的调度、装入、页表和描述符等代码(使用 -DHOSTED 编译)，代替访问硬件的函数:
+//    内存     在内核使用的物理地址处映射一块内存 [HAL_ARENA_START, HAL_ARENA_END)，内核代码按原样访问
+//    硬盘     镜像由 mkfs 生成，启动时复制到临时文件，ReadDiskExtent 和 WriteDiskPages 读写临时文件
+//    显示     Print 等函数的输出保存在 halOutput 中
+//    处理器   只有一个处理器，锁和开关中断为空操作
+//  测试程序以非 PIE 方式链接到 0x10000000，全局变量的地址在 4G 以下，内核代码中地址与 u32 的转换仍然有效
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <x86intrin.h>
+
+// 内核的 defs.h 定义了同名的 MAP_* 常量，先保存映射内存使用的系统常量
+static const int arenaFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+#undef MAP_PRIVATE
+#undef MAP_SHARED
+#undef MAP_ANON
+
+#include "hal.h"
+
+u32         halDiskReads = 0;
+u32         halDiskWrites = 0;
+u32         halDiskWriteCmds = 0;
+u32         halDiskFlushes = 0;
+u64         halTicks = 0;
+u32         halCpu = 0;
+Work       *halWork = 0;
+char        halOutput[HAL_OUTPUT_SIZE];
+static u32  outputPos = 0;
+static FILE *disk = 0;
+static u64  kmapPte = 0;                // KernelPte 返回的页表项，测试中不使用高端内存
+
+/* ========================== 显示 ========================== */
+void Print(char *message, int color) {
+    while (*message) {
+        halOutput[outputPos] = *message++;
+        outputPos = (outputPos + 1) % (HAL_OUTPUT_SIZE - 1);
+    }
+    halOutput[outputPos] = 0;
+}
+
+void PrintAtPos(char *message, int color, int x, int y) {
+    Print(message, color);
+}
+
+void SetCursor(int x, int y) {
+}
+
+void PrintNumber(u32 value, int color) {
+    char text[11];
+    snprintf(text, sizeof(text), "0x%08x", value);
+    Print(text, color);
+}
+
+void PrintDecimal(u32 value, int color) {
+    char text[11];
+    snprintf(text, sizeof(text), "%u", value);
+    Print(text, color);
+}
+
+// 串口的输出同样保存在 halOutput 中
+void SerialPrint(char *message) {
+    Print(message, 0);
+}
+
+void SerialPrintDecimal(u32 value) {
+    PrintDecimal(value, 0);
+}
+
+/* ========================== 硬盘 ========================== */
+// 从镜像文件读取 count 个扇区，超出文件的部分填 0
+void ReadDiskExtent(u32 sector, u32 count, u32 buffer) {
+    void *data = (void *)(unsigned long)buffer;
+    memset(data, 0, count * DISK_SECTOR_SIZE);
+    if (disk && !fseek(disk, (long)sector * DISK_SECTOR_SIZE, SEEK_SET))
+        fread(data, DISK_SECTOR_SIZE, count, disk);
+    halDiskReads += count;
+}
+
+void ReadDisk(u32 sector, u32 buffer) {
+    ReadDiskExtent(sector, 1, buffer);
+}
+
+// 把 count 个扇区写到镜像的临时副本，数据依次取自 pages 中的各页
+int WriteDiskPages(u32 sector, u32 count, u32 *pages) {
+    u32 per = PAGE_SIZE / DISK_SECTOR_SIZE;
+    for (u32 s = 0; s < count; s++) {
+        void *data = (void *)(unsigned long)(pages[s / per] + s % per * DISK_SECTOR_SIZE);
+        if (!disk || fseek(disk, (long)(sector + s) * DISK_SECTOR_SIZE, SEEK_SET) || fwrite(data, DISK_SECTOR_SIZE, 1, disk) != 1)
+            return 0;
+    }
+    halDiskWrites += count;
+    halDiskWriteCmds++;
+    return 1;
+}
+
+int FlushDisk() {
+    halDiskFlushes++;
+    return disk && !fflush(disk);
+}
+
+/* ========================== 处理器 ========================== */
+u64 ReadTsc() {
+    return __rdtsc();
+}
+
+u64 GetTicks() {
+    return halTicks;
+}
+
+u32 Div64(u64 n, u32 d) {
+    return (u32)(n / d);
+}
+
+CPU *ThisCpu() {
+    return &cpus[halCpu];
+}
+
+u32  IrqSave()                      { return 0; }
+void IrqRestore(u32 flags)          { }
+void SpinInit(Spinlock *lock, char *name) { }
+void SpinLock(Spinlock *lock)       { }
+void SpinUnlock(Spinlock *lock)     { }
+u32  SpinLockIrqSave(Spinlock *lock) { return 0; }
+void SpinUnlockIrqRestore(Spinlock *lock, u32 flags) { }
+
+// 等待队列与 sync.c 中的实现相同
+void WaitQueueSleep(WaitQueue *queue, PCB *pcb) {
+    queue->pids[(queue->head + queue->count++) % MAX_TASKS] = pcb->pid;
+    SchedSleep(pcb);
+}
+
+void WaitQueueWakeAll(WaitQueue *queue) {
+    for (; queue->count; queue->count--, queue->head = (queue->head + 1) % MAX_TASKS)
+        SchedWakeup(&process[queue->pids[queue->head]]);
+}
+
+// 没有工作队列线程，记录最近安排的工作，由测试调用 halWork->func 执行
+void WorkSchedule(Work *work) {
+    halWork = work;
+}
+
+void Yield()                        { }
+
+u64 *KernelPte(u32 addr) {
+    return &kmapPte;
+}
+
+/* ========================== 内存 ========================== */
+void PageZero(void *page) {
+    memset(page, 0, PAGE_SIZE);
+}
+
+void PageCopy(void *dst, const void *src) {
+    memcpy(dst, src, PAGE_SIZE);
+}
+
+/* ========================== 测试环境 ========================== */
+// 返回单调时钟的纳秒数
+u64 HalNanoseconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 映射内存并打开硬盘镜像，image 为 0 时没有硬盘
+void HalInit(char *image) {
+    void *arena = mmap((void *)HAL_ARENA_START, HAL_ARENA_END - HAL_ARENA_START, PROT_READ | PROT_WRITE, arenaFlags, -1, 0);
+    if (arena != (void *)HAL_ARENA_START) {
+        fprintf(stderr, "hal: cannot map memory at %#x\n", HAL_ARENA_START);
+        exit(2);
+    }
+    if (!image)
+        return;
+    // 写入的内容只进入临时副本，不修改镜像文件
+    FILE *source = fopen(image, "rb");
+    if (!source || !(disk = tmpfile())) {
+        fprintf(stderr, "hal: cannot open disk image %s\n", image);
+        exit(2);
+    }
+    char buffer[DISK_SECTOR_SIZE];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), source)) > 0)
+        fwrite(buffer, 1, n, disk);
+    fclose(source);
+}
+
+// 恢复启动时的状态: 清空内存、进程表和处理器表，重新初始化页缓存和文件系统
+void HalReset() {
+    memset((void *)HAL_ARENA_START, 0, HAL_ARENA_END - HAL_ARENA_START);
+    memset(process, 0, sizeof(PCB) * MAX_TASKS);
+    memset(cpus, 0, sizeof(CPU) * MAX_CPUS);
+    for (u32 i = 0; i < MAX_CPUS; i++) {
+        cpus[i].id       = i;
+        cpus[i].readyPid = -1;
+    }
+    cpuCount  = 1;
+    halCpu    = 0;
+    procCount = 0;
+    RAMSize   = HAL_ARENA_END;
+    MemoryEntryCount = 0;
+    MmInit();
+    FsInit();
+    halDiskReads = halDiskWrites = halDiskWriteCmds = halDiskFlushes = 0;
+    halTicks = 0;
+    halWork  = 0;
+}
@@ -0,0 +1,29 @@
+//  hal.h         by OrangeYYC
+//  TinyOS 主机测试的硬件抽象层
+
+#ifndef _HAL_H_
+#define _HAL_H_
+
+#include "../kernel/common.h"
+
+// 在内核使用的物理地址处映射的内存范围，覆盖任务页表、任务内存窗口、内核页表和页框池
+#define HAL_ARENA_START     0x10000
+#define HAL_ARENA_END       (FRAME_BASE + FRAME_COUNT * PAGE_SIZE)
+// 保存内核输出的缓冲区大小
+#define HAL_OUTPUT_SIZE     4096
+
+extern u32  halDiskReads;               // ReadDiskExtent 读取的扇区数
+extern u32  halDiskWrites;              // WriteDiskPages 写入的扇区数
+extern u32  halDiskWriteCmds;           // WriteDiskPages 的调用次数，对应硬盘的写命令
+extern u32  halDiskFlushes;             // FlushDisk 的调用次数
+extern u64  halTicks;                   // GetTicks 返回的时钟节拍
+extern u32  halCpu;                     // ThisCpu 返回的处理器编号
+extern Work *halWork;                   // 最近一次 WorkSchedule 安排的工作
+extern char halOutput[HAL_OUTPUT_SIZE]; // Print 等函数输出的内容，满时从头开始
+extern u32  schedPolicy[MAX_TASKS];     // 每个任务的调度策略(process.c)
+
+extern void HalInit      (char *image);
+extern void HalReset     ();
+extern u64  HalNanoseconds();
+
+#endif
@@ -0,0 +1,456 @@
+//  test.c         by OrangeYYC
+//  TinyOS 内核代码的主机单元测试
+//
+//  用法: ktest <硬盘镜像> <任务文件>
+//  硬盘镜像由 mkfs 生成，其中包含 task1 task2 motd 和 scratch，任务文件为 task1 的 elf 文件，用于核对装入的内容。
+//  每个测试开始前调用 HalReset 恢复启动时的状态
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <elf.h>
+#include "hal.h"
+
+static int   checks = 0, failures = 0;
+static char *taskFile;
+
+// 检查条件，不成立时输出位置和条件并继续执行
+#define CHECK(cond) do {                                                        \
+    checks++;                                                                   \
+    if (!(cond)) {                                                              \
+        failures++;                                                             \
+        fprintf(stderr, "%s:%d: %s: CHECK(%s) failed\n", __FILE__, __LINE__, __func__, #cond); \
+    }                                                                           \
+} while (0)
+
+// 将进程表中的前 count 项设为就绪的任务，使用 policy 策略
+static void MakeTasks(u32 count, u32 policy) {
+    for (u32 i = 0; i < count; i++) {
+        process[i].pid      = i;
+        process[i].priority = 100 * (i + 1);
+        SchedSetup(&process[i], policy);
+    }
+    procCount = count;
+}
+
+/* ========================== 描述符 ========================== */
+static void TestSetDesEntry() {
+    Descriptor des;
+    SetDesEntry(&des, 0x12345678, 0xabcde, DA_DRW | DA_DPL3 | DA_32 | DA_LIMIT_4K);
+    CHECK(des.limitLow == 0xbcde);
+    CHECK(des.baseLow == 0x5678);
+    CHECK(des.baseMid == 0x34);
+    CHECK(des.baseHigh == 0x12);
+    CHECK(des.attr1 == (DA_DRW | DA_DPL3));
+    CHECK(des.limitHighAttr2 == (0xc0 | 0xa));
+    SetDesEntry(&des, 0, sizeof(TSS) - 1, DA_386TSS);
+    CHECK(des.limitLow == sizeof(TSS) - 1 && des.limitHighAttr2 == 0 && des.attr1 == DA_386TSS);
+}
+
+/* ========================== 调度 ========================== */
+// 优先数调度选择剩余节拍最多的任务，全部耗尽后按优先级重新分配
+static void TestChoosePriority() {
+    MakeTasks(3, SCHED_PRIORITY);
+    choose(0);
+    CHECK(cpus[0].readyPid == 2);
+    process[2].tick = 0;
+    choose(1);
+    CHECK(cpus[0].readyPid == 1);
+    process[0].tick = process[1].tick = 0;
+    choose(1);
+    CHECK(cpus[0].readyPid == 2 && process[2].tick == process[2].priority);
+    process[2].state = TASK_BLOCKED;
+    choose(0);
+    CHECK(cpus[0].readyPid == 1);
+    process[0].state = process[1].state = TASK_BLOCKED;
+    choose(0);
+    CHECK(cpus[0].readyPid == -1);
+}
+
+// 轮转调度按 pid 顺序轮流执行，时间片用完或主动让出时换到下一个任务
+static void TestChooseRoundRobin() {
+    MakeTasks(3, SCHED_RR);
+    choose(0);
+    u32 first = cpus[0].readyPid;
+    for (u32 t = 0; t < RR_SLICE - 1; t++)
+        choose(1);
+    CHECK(cpus[0].readyPid == first);
+    choose(1);
+    CHECK(cpus[0].readyPid == (first + 1) % 3);
+    cpus[0].yield = 1;
+    choose(0);
+    CHECK(cpus[0].readyPid == (first + 2) % 3);
+    CHECK(cpus[0].yield == 0);
+}
+
+// 一次调度经过多个节拍时逐个消耗时间片，时间片用完后不再消耗下一个任务的时间片
+static void TestChooseLostTicks() {
+    MakeTasks(3, SCHED_RR);
+    choose(0);
+    u32 first = cpus[0].readyPid;
+    choose(RR_SLICE - 1);
+    CHECK(cpus[0].readyPid == first && process[first].slice == 1);
+    choose(3);
+    CHECK(cpus[0].readyPid == (first + 1) % 3);
+    CHECK(process[first].slice == RR_SLICE && process[(first + 1) % 3].slice == RR_SLICE);
+}
+
+// 阻塞的任务可以被唤醒，结束的任务不再被调度和唤醒
+static void TestChooseExited() {
+    MakeTasks(2, SCHED_RR);
+    SchedSleep(&process[0]);
+    SchedExit(&process[1]);
+    choose(0);
+    CHECK(cpus[0].readyPid == -1);
+    SchedWakeup(&process[0]);
+    SchedWakeup(&process[1]);
+    CHECK(process[0].state == TASK_READY && process[1].state == TASK_EXITED);
+    choose(0);
+    CHECK(cpus[0].readyPid == 0);
+}
+
+// 换下仍然就绪的任务记为被动切换，让出或阻塞的任务记为主动切换
+static void TestChooseSwitchCount() {
+    MakeTasks(2, SCHED_RR);
+    choose(0);
+    u32 first = cpus[0].readyPid, second = 1 - first;
+    choose(RR_SLICE);
+    CHECK(cpus[0].readyPid == second && process[first].usage.involuntary == 1);
+    cpus[0].yield = 1;
+    choose(0);
+    CHECK(cpus[0].readyPid == first && process[second].usage.voluntary == 1);
+    SchedSleep(&process[first]);
+    choose(0);
+    CHECK(process[first].usage.voluntary == 1 && process[first].usage.involuntary == 1);
+    // 让出后仍然选中自己不算切换
+    cpus[0].yield = 1;
+    choose(0);
+    CHECK(cpus[0].readyPid == second && process[second].usage.voluntary == 1);
+}
+
+// 修改优先级后优先数调度的剩余节拍按差值增减，CFS 按新的权重分配
+static void TestSetPriority() {
+    MakeTasks(2, SCHED_PRIORITY);
+    CHECK(SchedSetPriority(&process[0], 0) == -1 && SchedSetPriority(&process[0], PRIO_MAX + 1) == -1);
+    CHECK(SchedSetPriority(&process[0], 250) == 0);
+    CHECK(process[0].priority == 250 && process[0].tick == 250);
+    choose(0);
+    CHECK(cpus[0].readyPid == 0);
+    CHECK(SchedSetPriority(&process[0], 50) == 0 && process[0].tick == 50);
+    CHECK(SchedSetPriority(&process[1], 10) == 0 && process[1].tick == 10);
+    u32 used[2] = {};
+    MakeTasks(2, SCHED_CFS);
+    SchedSetPriority(&process[1], 300);
+    choose(0);
+    for (u32 t = 0; t < 4000; t++) {
+        used[cpus[0].readyPid]++;
+        choose(1);
+    }
+    CHECK(used[1] > 2900 && used[1] < 3100);
+}
+
+// 编号小的调度类优先于编号大的调度类
+static void TestChooseClassOrder() {
+    MakeTasks(2, SCHED_CFS);
+    choose(0);
+    CHECK(process[cpus[0].readyPid].policy == SCHED_CFS);
+    SchedSetup(&process[1], SCHED_RR);
+    choose(0);
+    CHECK(cpus[0].readyPid == 1);
+}
+
+// CFS 使各任务获得的节拍数与优先级成正比
+static void TestChooseCfsShare() {
+    u32 used[3] = {};
+    MakeTasks(3, SCHED_CFS);
+    choose(0);
+    for (u32 t = 0; t < 6000; t++) {
+        used[cpus[0].readyPid]++;
+        choose(1);
+    }
+    // 优先级为 100 200 300，份额为 1/6 2/6 3/6
+    CHECK(used[0] > 900 && used[0] < 1100);
+    CHECK(used[1] > 1900 && used[1] < 2100);
+    CHECK(used[2] > 2900 && used[2] < 3100);
+}
+
+// CFS 的基准按处理器分别记录，另一个处理器上运行的任务不影响本处理器新任务的虚拟运行时间
+static void TestCfsPerCpu() {
+    MakeTasks(2, SCHED_CFS);
+    cpuCount = 2;
+    process[1].cpu = 1;
+    choose(0);
+    CHECK(cpus[0].readyPid == 0);
+    halCpu = 1;
+    choose(0);
+    for (u32 t = 0; t < 1000; t++)
+        choose(1);
+    cpus[1].yield = 1;
+    choose(0);
+    CHECK(cpus[1].readyPid == 1 && process[1].vruntime != process[0].vruntime);
+    halCpu = 0;
+    process[2].pid = 2;
+    procCount = 3;
+    SchedSetup(&process[2], SCHED_CFS);
+    CHECK(process[2].vruntime == process[0].vruntime);
+}
+
+// 接纳控制: 同一处理器上实时任务的 预算/截止时间 之和不超过 EDF_UTIL_LIMIT
+static void TestEdfAdmission() {
+    MakeTasks(3, SCHED_RR);
+    SchedRelease(0);
+    CHECK(SchedSetEdf(&process[0], 10, 5, 0) == 0);
+    CHECK(SchedSetEdf(&process[1], 10, 5, 0) == -1);
+    CHECK(process[1].policy == SCHED_RR);
+    CHECK(SchedSetEdf(&process[1], 10, 4, 0) == 0);
+    CHECK(SchedSetEdf(&process[2], 10, 0, 0) == -1);
+    CHECK(SchedSetEdf(&process[2], 10, 4, 2) == -1);
+    CHECK(SchedSetEdf(&process[2], 10, 2, 20) == -1);
+    // 每个处理器分别计算
+    process[1].cpu = 1;
+    CHECK(SchedSetEdf(&process[2], 10, 5, 0) == -1);
+    process[2].cpu = 1;
+    CHECK(SchedSetEdf(&process[2], 10, 5, 0) == 0);
+}
+
+// 实时任务优先于普通任务，截止时间早的先执行，预算耗尽后等待下一个周期，未完成的作业计为错过截止时间
+static void TestEdfSchedule() {
+    MakeTasks(3, SCHED_RR);
+    SchedRelease(0);
+    CHECK(SchedSetEdf(&process[1], 10, 2, 0) == 0);
+    CHECK(SchedSetEdf(&process[2], 20, 2, 5) == 0);
+    choose(0);
+    CHECK(cpus[0].readyPid == 2);
+    choose(1);
+    CHECK(cpus[0].readyPid == 2);
+    choose(1);
+    CHECK(cpus[0].readyPid == 1 && process[2].state == TASK_WAITING);
+    SchedWaitPeriod(&process[1]);
+    choose(0);
+    CHECK(cpus[0].readyPid == 0);
+    SchedRelease(5);
+    CHECK(process[1].misses == 0 && process[2].misses == 1);
+    SchedRelease(10);
+    CHECK(process[1].state == TASK_READY && process[1].absDeadline == 20);
+    choose(1);
+    CHECK(cpus[0].readyPid == 1);
+    choose(1);
+    choose(1);
+    CHECK(cpus[0].readyPid == 0);
+    SchedRelease(20);
+    CHECK(process[1].misses == 1 && process[1].jobs == 3);
+    CHECK(process[2].misses == 1 && process[2].jobs == 2 && process[2].state == TASK_READY);
+    CHECK(SchedWaitPeriod(&process[0]) == -1);
+}
+
+/* ========================== 页表 ========================== */
+static void TestSetProcessPageTable() {
+    u64 *kernelPDPT = (u64 *)PAGE_DIR_BASE;
+    u64 *kernelPD0  = (u64 *)PAGE_PD_BASE;
+    kernelPDPT[2] = 0x402001;
+    kernelPDPT[3] = 0x403001;
+    kernelPD0[5]  = 0xa00000 | PAGE_P | PAGE_W | PAGE_PS;
+    SetProcessPageTable(2);
+    u32  base = PROCESS_PAGE_START + 2 * PROCESS_PAGE_SIZE;
+    u64 *PDPT = (u64 *)base;
+    u64 *PD0  = (u64 *)(base + PROCESS_PD0_OFFSET);
+    u64 *PT0  = (u64 *)(base + PROCESS_PT0_OFFSET);
+    CHECK(process[2].pageDirBase == base);
+    CHECK(PDPT[0] == ((base + PROCESS_PD0_OFFSET) | PAGE_P));
+    CHECK(PDPT[1] == ((base + PROCESS_PD1_OFFSET) | PAGE_P));
+    CHECK(PDPT[2] == 0x402001 && PDPT[3] == 0x403001);
+    CHECK(PD0[0] == ((base + PROCESS_PT0_OFFSET) | PAGE_P | PAGE_U | PAGE_W));
+    CHECK(PD0[5] == kernelPD0[5]);
+    // 任务窗口映射到该任务的物理内存，显存可以在 Ring3 访问，其余为内核页
+    CHECK(PT0[PROCESS_PSTART >> 12] == ((PROCESS_PSTART + 2 * PROCESS_PSIZE) | PAGE_P | PAGE_U | PAGE_W));
+    CHECK(PT0[0xb8] == (0xb8000 | PAGE_P | PAGE_U | PAGE_W));
+    CHECK(PT0[0x10] == (0x10000 | PAGE_P | PAGE_W));
+    CHECK(PT0[(PROCESS_PSTART + PROCESS_PSIZE) >> 12] == ((PROCESS_PSTART + PROCESS_PSIZE) | PAGE_P | PAGE_W));
+}
+
+/* ========================== 装入 ========================== */
+// 装入的内容与 elf 文件的第一个段相同，段之后填 0，再次装入时不读硬盘
+static void TestLoadTask() {
+    static u8 file[PROCESS_PSIZE * 2];
+    FILE *f = fopen(taskFile, "rb");
+    CHECK(f != 0);
+    if (!f)
+        return;
+    size_t size = fread(file, 1, sizeof(file), f);
+    fclose(f);
+    Elf32_Ehdr *header  = (Elf32_Ehdr *)file;
+    Elf32_Phdr *pHeader = (Elf32_Phdr *)(file + header->e_phoff);
+    CHECK(size >= pHeader->p_offset + pHeader->p_filesz);
+
+    taskName[1] = "task1";
+    memset((void *)(PROCESS_PSTART + PROCESS_PSIZE), 0xcc, PROCESS_PSIZE);
+    CHECK(ReadProcessToMemory(1) == 0);
+    u8 *v = (u8 *)(PROCESS_PSTART + PROCESS_PSIZE);
+    CHECK(!memcmp(v, file + pHeader->p_offset, pHeader->p_filesz));
+    for (u32 i = pHeader->p_filesz; i < pHeader->p_memsz; i++)
+        if (v[i]) {
+            CHECK(v[i] == 0);
+            break;
+        }
+    CHECK(halDiskReads > 0);
+    halDiskReads = 0;
+    CHECK(ReadProcessToMemory(1) == 0);
+    CHECK(halDiskReads == 0);
+}
+
+static void TestLoadErrors() {
+    taskName[0] = "missing";
+    CHECK(ReadProcessToMemory(0) != 0);
+    taskName[0] = "motd";
+    CHECK(ReadProcessToMemory(0) != 0);
+}
+
+/* ========================== 写回 ========================== */
+// 写入的页成为脏页，读取时看到新的内容，变脏超过 DIRTY_EXPIRE 个节拍后才由后台写回
+static void TestWriteBack() {
+    static u8 sector[DISK_SECTOR_SIZE];
+    char data[] = "hello", back[sizeof(data)] = {};
+    FsEntry *entry = FsLookup("scratch");
+    CHECK(entry != 0);
+    if (!entry)
+        return;
+    halTicks = 10;
+    CHECK(PageCacheWrite(entry, 5000, data, sizeof(data), 0));
+    CHECK(!PageCacheWrite(entry, entry->size - 2, data, sizeof(data), 0));
+    CHECK(PageCacheRead(entry, 5000, back, sizeof(back)));
+    CHECK(!memcmp(back, data, sizeof(data)));
+    halTicks = 10 + DIRTY_EXPIRE - 1;
+    PageCacheWriteback();
+    CHECK(halDiskWrites == 0);
+    halTicks = 10 + DIRTY_EXPIRE;
+    PageCacheWriteback();
+    CHECK(halDiskWrites == PAGE_SIZE / DISK_SECTOR_SIZE);
+    CHECK(halDiskFlushes == 0);
+    ReadDiskExtent(entry->start + 5000 / DISK_SECTOR_SIZE, 1, (u32)sector);
+    CHECK(!memcmp(sector + 5000 % DISK_SECTOR_SIZE, data, sizeof(data)));
+}
+
+// 整页写入不读硬盘，硬盘上相邻的脏页按扇区合并为一条写命令，PageCacheSync 让硬盘写出缓存；
+// 脏页数量达到 DIRTY_BACKGROUND 时后台写回不等待，一条写命令最多写入 ATA_MAX_SECTORS 个扇区
+static void TestWriteCoalesce() {
+    static u8 page[PAGE_SIZE], data[4 * PAGE_SIZE];
+    FsEntry *entry = FsLookup("scratch");
+    CHECK(entry != 0 && entry->size >= DIRTY_BACKGROUND * PAGE_SIZE);
+    if (!entry || entry->size < DIRTY_BACKGROUND * PAGE_SIZE)
+        return;
+    for (int i = 3; i >= 0; i--) {
+        memset(page, 'a' + i, PAGE_SIZE);
+        CHECK(PageCacheWrite(entry, i * PAGE_SIZE, page, PAGE_SIZE, 0));
+    }
+    CHECK(halDiskReads == 0);
+    CHECK(PageCacheSync(entry));
+    CHECK(halDiskWriteCmds == 1);
+    CHECK(halDiskWrites == 4 * PAGE_SIZE / DISK_SECTOR_SIZE);
+    CHECK(halDiskFlushes == 1);
+    ReadDiskExtent(entry->start, 4 * PAGE_SIZE / DISK_SECTOR_SIZE, (u32)data);
+    CHECK(data[0] == 'a' && data[PAGE_SIZE - 1] == 'a' && data[3 * PAGE_SIZE] == 'd');
+
+    int ok = 1;
+    halDiskWrites = halDiskWriteCmds = 0;
+    for (u32 i = 0; i < DIRTY_BACKGROUND; i++)
+        ok &= PageCacheWrite(entry, i * PAGE_SIZE, page, PAGE_SIZE, 0);
+    CHECK(ok);
+    PageCacheWriteback();
+    CHECK(halDiskWrites == DIRTY_BACKGROUND * PAGE_SIZE / DISK_SECTOR_SIZE);
+    CHECK(halDiskWriteCmds == DIRTY_BACKGROUND * PAGE_SIZE / DISK_SECTOR_SIZE / ATA_MAX_SECTORS);
+}
+
+// 任务运行后需要读入的页交给工作队列线程: 写入一部分的任务阻塞，读入完成后被唤醒，重新写入成功
+static void TestWriteWaitsForRead() {
+    char data[] = "later", back[sizeof(data)] = {};
+    FsEntry *entry = FsLookup("scratch");
+    CHECK(entry != 0);
+    if (!entry)
+        return;
+    MakeTasks(1, SCHED_RR);
+    MmIoStart();
+    CHECK(PageCacheWrite(entry, 100, data, sizeof(data), &process[0]) == PAGE_WAIT);
+    CHECK(process[0].state == TASK_BLOCKED && halDiskReads == 0 && halWork != 0);
+    if (!halWork)
+        return;
+    halWork->func(halWork);
+    CHECK(process[0].state == TASK_READY && halDiskReads == PAGE_SIZE / DISK_SECTOR_SIZE);
+    CHECK(PageCacheWrite(entry, 100, data, sizeof(data), &process[0]) == 1);
+    CHECK(PageCacheRead(entry, 100, back, sizeof(back)) && !memcmp(back, data, sizeof(data)));
+}
+
+// 任务运行后 fsync 阻塞任务，由工作队列线程写回脏页并让硬盘写出缓存，完成后填写返回值并唤醒任务
+static void TestFsyncBlocks() {
+    char data[] = "synced";
+    FsEntry *entry = FsLookup("scratch");
+    CHECK(entry != 0);
+    if (!entry)
+        return;
+    MakeTasks(1, SCHED_RR);
+    CHECK(PageCacheWrite(entry, 200, data, sizeof(data), 0));
+    MmIoStart();
+    process[0].regs.eax = 1;
+    CHECK(PageCacheFsync(&process[0], entry) == SYSCALL_BLOCKED);
+    CHECK(process[0].state == TASK_BLOCKED && halDiskWrites == 0 && halWork != 0);
+    if (!halWork)
+        return;
+    halWork->func(halWork);
+    CHECK(process[0].state == TASK_READY && process[0].regs.eax == 0);
+    CHECK(halDiskWrites == PAGE_SIZE / DISK_SECTOR_SIZE && halDiskFlushes == 1);
+}
+
+// 任务结束时释放文件映射，同一编号的任务再次映射时从映射区域的开头开始
+static void TestMmRelease() {
+    MakeTasks(2, SCHED_RR);
+    SetProcessPageTable(1);
+    CHECK(Mmap(&process[1], 0, 3 * PAGE_SIZE, MAP_ANON) == MMAP_BASE);
+    CHECK(Mmap(&process[1], 0, PAGE_SIZE, MAP_ANON) == MMAP_BASE + 3 * PAGE_SIZE);
+    MmRelease(&process[1]);
+    CHECK(Mmap(&process[1], 0, PAGE_SIZE, MAP_ANON) == MMAP_BASE);
+    for (u32 i = 1; i < MAX_VMAS; i++)
+        CHECK(Mmap(&process[1], 0, PAGE_SIZE, MAP_ANON) == MMAP_BASE + i * PAGE_SIZE);
+    CHECK(Mmap(&process[1], 0, PAGE_SIZE, MAP_ANON) == (u32)-1);
+}
+
+/* ========================== 运行测试 ========================== */
+static struct {
+    char *name;
+    void (*run)();
+} tests[] = {
+    { "SetDesEntry",         TestSetDesEntry         },
+    { "ChoosePriority",      TestChoosePriority      },
+    { "ChooseRoundRobin",    TestChooseRoundRobin    },
+    { "ChooseLostTicks",     TestChooseLostTicks     },
+    { "ChooseExited",        TestChooseExited        },
+    { "ChooseSwitchCount",   TestChooseSwitchCount   },
+    { "SetPriority",         TestSetPriority         },
+    { "ChooseClassOrder",    TestChooseClassOrder    },
+    { "ChooseCfsShare",      TestChooseCfsShare      },
+    { "CfsPerCpu",           TestCfsPerCpu           },
+    { "EdfAdmission",        TestEdfAdmission        },
+    { "EdfSchedule",         TestEdfSchedule         },
+    { "SetProcessPageTable", TestSetProcessPageTable },
+    { "LoadTask",            TestLoadTask            },
+    { "LoadErrors",          TestLoadErrors          },
+    { "WriteBack",           TestWriteBack           },
+    { "WriteCoalesce",       TestWriteCoalesce       },
+    { "WriteWaitsForRead",   TestWriteWaitsForRead   },
+    { "FsyncBlocks",         TestFsyncBlocks         },
+    { "MmRelease",           TestMmRelease           },
+};
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: ktest <image> <task1 elf>\n");
+        return 2;
+    }
+    taskFile = argv[2];
+    HalInit(argv[1]);
+    for (u32 i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        int before = failures;
+        HalReset();
+        tests[i].run();
+        printf("[%s] %s\n", failures == before ? "  OK  " : " FAIL ", tests[i].name);
+    }
+    printf("%d checks, %d failures\n", checks, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,22 @@
+#!/bin/sh
+#  benchcmp.sh         by OrangeYYC
+#  比较两次基准测试套件的结果，在主机上运行
+#
+#  用法: benchcmp.sh <基准结果> <本次结果>
+#  结果文件每行为 "BENCH 名称 数值 单位"，按名称对应后输出两次的数值和变化的百分比；
+#  基准结果不存在时只输出本次结果
+
+if [ ! -f "$1" ]; then
+    echo "benchcmp: no baseline $1, use make bench-baseline to save one"
+    cat "$2"
+    exit 0
+fi
+awk '
+    NR == FNR { if (NF == 4) base[$2] = $3; next }
+    NF == 4 {
+        if ($2 in base && base[$2] > 0)
+            printf "%-20s %12s %12s %-8s %+7.1f%%\n", $2, base[$2], $3, $4, ($3 - base[$2]) * 100 / base[$2]
+        else
+            printf "%-20s %12s %12s %-8s %8s\n", $2, "-", $3, $4, "new"
+    }
+' "$1" "$2"
@@ -0,0 +1,90 @@
+//  mkfs.c         by OrangeYYC
+//  TinyOS 文件系统镜像生成工具，在主机上运行
+//
+//  用法: mkfs <镜像文件> <文件>...
+//  在镜像的 FS_START_SECTOR 扇区处写入超级块、目录哈希表和各文件的数据，
+//  每个文件占用一段连续的扇区，文件名取路径的最后一部分
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../kernel/defs.h"
+
+// 文件名哈希函数 (FNV-1a)，与内核 fs.c 中的实现一致
+static u32 FsHash(const char *name) {
+    u32 hash = 2166136261u;
+    for (const char *c = name; *c; c++)
+        hash = (hash ^ (u8)*c) * 16777619u;
+    return hash;
+}
+
+// 显示错误信息并退出
+static void Fail(const char *message, const char *arg) {
+    fprintf(stderr, "mkfs: %s%s\n", message, arg);
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    static FsEntry dir[FS_DIR_ENTRIES];
+    FsSuper super = {};
+    if (argc < 2)
+        Fail("usage: mkfs <image> <file>...", "");
+    FILE *image = fopen(argv[1], "r+b");
+    if (!image)
+        Fail("cannot open image ", argv[1]);
+
+    super.magic      = FS_MAGIC;
+    super.dirStart   = FS_START_SECTOR + 1;
+    super.dirSectors = sizeof(dir) / DISK_SECTOR_SIZE;
+    super.dirEntries = FS_DIR_ENTRIES;
+    super.dataStart  = super.dirStart + super.dirSectors;
+    u32 next = super.dataStart;
+
+    // 依次写入文件数据，并把目录项放入哈希表
+    for (int i = 2; i < argc; i++) {
+        const char *name = strrchr(argv[i], '/') ? strrchr(argv[i], '/') + 1 : argv[i];
+        if (strlen(name) >= FS_NAME_LEN)
+            Fail("file name too long: ", name);
+        FILE *file = fopen(argv[i], "rb");
+        if (!file)
+            Fail("cannot open ", argv[i]);
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        char *data = calloc(1, size + DISK_SECTOR_SIZE);
+        if (fread(data, 1, size, file) != (size_t)size)
+            Fail("cannot read ", argv[i]);
+        fclose(file);
+
+        u32 slot = FsHash(name) % FS_DIR_ENTRIES;
+        for (u32 n = 0; dir[slot].name[0]; n++) {
+            if (!strcmp(dir[slot].name, name))
+                Fail("duplicate file name: ", name);
+            if (n == FS_DIR_ENTRIES - 1)
+                Fail("directory is full at ", name);
+            slot = (slot + 1) % FS_DIR_ENTRIES;
+        }
+        FsEntry *entry = &dir[slot];
+        strcpy(entry->name, name);
+        entry->start   = next;
+        entry->sectors = (size + DISK_SECTOR_SIZE - 1) / DISK_SECTOR_SIZE;
+        entry->size    = size;
+        fseek(image, (long)entry->start * DISK_SECTOR_SIZE, SEEK_SET);
+        fwrite(data, DISK_SECTOR_SIZE, entry->sectors, image);
+        free(data);
+        next += entry->sectors;
+        super.fileCount++;
+        printf("mkfs: %-20s sector %5u  %6u bytes\n", name, entry->start, entry->size);
+    }
+
+    // 写入超级块和目录哈希表
+    char sector[DISK_SECTOR_SIZE] = {};
+    super.totalSectors = next - FS_START_SECTOR;
+    memcpy(sector, &super, sizeof(super));
+    fseek(image, (long)FS_START_SECTOR * DISK_SECTOR_SIZE, SEEK_SET);
+    fwrite(sector, DISK_SECTOR_SIZE, 1, image);
+    fwrite(dir, sizeof(dir), 1, image);
+    if (fclose(image))
+        Fail("cannot write ", argv[1]);
+    return 0;
+}
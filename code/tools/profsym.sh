@@ -0,0 +1,83 @@
+#!/bin/sh
+#  profsym.sh         by OrangeYYC
+#  把采样分析器输出的地址转换为函数名，在主机上运行
+#
+#  用法: profsym.sh <串口输出> <构建目录>
+#  串口输出中 "PROF" 开头的行由内核的 profile.c 产生，所有输出周期的样本合并统计。
+#  特权级 3 的样本使用 <构建目录>/<任务文件名>.dbg 的符号，特权级 0 和 1 的样本使用 <构建目录>/kernel.elf，
+#  按 (任务, 函数) 汇总后以样本数从多到少输出，任务编号 15 表示内核自身
+
+if [ ! -f "$1" ]; then
+    echo "profsym: no profile log $1"
+    exit 1
+fi
+awk -v dir="$2" '
+    # 十六进制字符串转换为数值，可带 0x 前缀
+    function hex(s,    v, i) {
+        sub(/^0[xX]/, "", s)
+        s = tolower(s); v = 0
+        for (i = 1; i <= length(s); i++)
+            v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+        return v
+    }
+    # 读取 file 中的函数符号，按地址排序保存在 addr[file, i] 和 name[file, i] 中
+    function load(file,    cmd, n, line, f) {
+        if (file in count)
+            return
+        n = 0
+        cmd = "nm -n " file " 2>/dev/null"
+        while ((cmd | getline line) > 0) {
+            split(line, f, " ")
+            if (f[2] ~ /^[tTwW]$/) {
+                addr[file, n] = hex(f[1])
+                name[file, n] = f[3]
+                n++
+            }
+        }
+        close(cmd)
+        count[file] = n
+        if (!n)
+            printf "profsym: no symbols in %s\n", file > "/dev/stderr"
+    }
+    # 二分查找不大于 eip 的最后一个符号
+    function lookup(file, eip,    lo, hi, mid) {
+        load(file)
+        lo = 0; hi = count[file] - 1
+        if (hi < 0 || eip < addr[file, 0])
+            return sprintf("0x%08x", eip)
+        while (lo < hi) {
+            mid = int((lo + hi + 1) / 2)
+            if (addr[file, mid] <= eip) lo = mid; else hi = mid - 1
+        }
+        return name[file, lo]
+    }
+    $1 != "PROF" { next }
+    $2 == "begin" { hz = $4; samples += $6; idle += $8; dropped += $10; next }
+    $2 == "task"  { task[$3] = $4; next }
+    $2 == "end"   { next }
+    NF == 5 {
+        pid = $2; ring = $3; eip = hex($4)
+        if (ring == 3 && pid in task) {
+            file = dir "/" task[pid] ".dbg"
+            who = task[pid]
+        } else {
+            file = dir "/kernel.elf"
+            who = pid == 15 ? "kernel" : (pid in task ? task[pid] : "pid" pid)
+        }
+        hits[who " " lookup(file, eip)] += $5
+    }
+    END {
+        total = samples + idle
+        if (!total) {
+            print "profsym: no samples"
+            exit 1
+        }
+        printf "%u samples at %u Hz, %u idle (%.1f%%), %u dropped\n", total, hz, idle, idle * 100 / total, dropped
+        printf "%8s %7s  %-10s %s\n", "Samples", "Share", "Task", "Function"
+        for (k in hits) {
+            split(k, f, " ")
+            printf "%8u %6.1f%%  %-10s %s\n", hits[k], hits[k] * 100 / total, f[1], f[2] | "sort -k1,1nr"
+        }
+        close("sort -k1,1nr")
+    }
+' "$1"
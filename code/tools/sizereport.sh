@@ -0,0 +1,32 @@
+#!/bin/sh
+#  sizereport.sh         by OrangeYYC
+#  输出内核每个目标文件和每个段的大小，在主机上运行
+#
+#  用法: sizereport.sh <构建配置> <kernel.elf> <kernel.bin> <目标文件>...
+#  依次输出每个目标文件的代码(text，包括只读数据)、数据(data)、未初始化数据(bss)的大小，以及 kernel.elf 中
+#  每个装入内存的段的大小；最后以 "BENCH 名称 数值 bytes" 的格式输出内核映像、每个段和每个目标文件的大小，
+#  make bench 把这些行加入基准测试的结果，与测量的周期数一起和基准比较
+
+if [ ! -f "$2" ] || [ ! -f "$3" ]; then
+    echo "sizereport: no kernel $2 $3"
+    exit 1
+fi
+build=$1 elf=$2 image=$3
+shift 3
+echo "Kernel size report ($build build): $image $(stat -c %s "$image") bytes"
+size "$@" | awk '
+    NR == 1 { printf "%-20s %8s %8s %8s %8s\n", "Object", "Text", "Data", "Bss", "Total"; next }
+    {
+        n = split($6, f, "/")
+        printf "%-20s %8u %8u %8u %8u\n", f[n], $1, $2, $3, $4
+        text += $1; data += $2; bss += $3
+    }
+    END { printf "%-20s %8u %8u %8u %8u\n", "total", text, data, bss, text + data + bss }
+'
+size -A "$elf" | awk '
+    NR <= 2 { if (NR == 2) printf "%-20s %8s %10s\n", "Section", "Size", "Address"; next }
+    $3 > 0 { printf "%-20s %8u %#10x\n", $1, $2, $3 }
+'
+echo "BENCH size_image $(stat -c %s "$image") bytes"
+size -A "$elf" | awk 'NR > 2 && $3 > 0 { sub(/^\./, "", $1); gsub(/\./, "_", $1); printf "BENCH size_%s %u bytes\n", $1, $2 }'
+size "$@" | awk 'NR > 1 { n = split($6, f, "/"); sub(/\.o$/, "", f[n]); printf "BENCH size_obj_%s %u bytes\n", f[n], $4 }'